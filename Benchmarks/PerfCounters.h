@@ -0,0 +1,106 @@
+//
+//  PerfCounters.h
+//  Exercise: Memory Manager
+//
+
+#ifndef PerfCounters_h
+#define PerfCounters_h
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/// Hardware counters for the calling thread and any threads it starts while counting, read with perf_event_open. Each
+/// counter is opened on its own, so counters the CPU or kernel doesn't support are left out instead of failing the
+/// rest. On other platforms, or when perf events aren't permitted (see /proc/sys/kernel/perf_event_paranoid), no
+/// counters are available and counting does nothing.
+class PerfCounters {
+public:
+    struct Counter {
+        std::string name;
+        int fd;
+        uint64_t value;
+    };
+    
+private:
+    std::vector<Counter> _counters;
+    
+#if defined(__linux__)
+    void open(const char* name, const uint32_t type, const uint64_t config) {
+        perf_event_attr attributes;
+        memset(&attributes, 0, sizeof(attributes));
+        attributes.size = sizeof(attributes);
+        attributes.type = type;
+        attributes.config = config;
+        attributes.disabled = 1;
+        attributes.inherit = 1;
+        attributes.exclude_kernel = 1;
+        attributes.exclude_hv = 1;
+        const int fd = static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0));
+        if (fd >= 0) {
+            _counters.push_back({name, fd, 0});
+        }
+    }
+    
+    static uint64_t cacheConfig(const uint64_t cache, const uint64_t operation, const uint64_t result) {
+        return cache | (operation << 8) | (result << 16);
+    }
+#endif
+    
+public:
+    PerfCounters() {
+#if defined(__linux__)
+        open("cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+        open("instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+        open("l1d-misses", PERF_TYPE_HW_CACHE,
+             cacheConfig(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS));
+        open("llc-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+        open("dtlb-misses", PERF_TYPE_HW_CACHE,
+             cacheConfig(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS));
+#endif
+    }
+    
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+    
+    ~PerfCounters() {
+#if defined(__linux__)
+        for (auto i = _counters.begin(); i != _counters.end(); ++i) {
+            close(i->fd);
+        }
+#endif
+    }
+    
+    bool isAvailable() const {return !_counters.empty();}
+    const std::vector<Counter>& getCounters() const {return _counters;}
+    
+    /// Zeroes the counters and starts counting.
+    void start() {
+#if defined(__linux__)
+        for (auto i = _counters.begin(); i != _counters.end(); ++i) {
+            ioctl(i->fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(i->fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+    
+    /// Stops counting and reads the values counted since start.
+    void stop() {
+#if defined(__linux__)
+        for (auto i = _counters.begin(); i != _counters.end(); ++i) {
+            ioctl(i->fd, PERF_EVENT_IOC_DISABLE, 0);
+            uint64_t value = 0;
+            i->value = read(i->fd, &value, sizeof(value)) == sizeof(value) ? value : 0;
+        }
+#endif
+    }
+};
+
+#endif /* PerfCounters_h */
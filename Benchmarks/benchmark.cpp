@@ -0,0 +1,1158 @@
+//
+//  benchmark.cpp
+//  Exercise: Memory Manager
+//
+
+#include "MemoryPoolManager.h"
+#include "ConcurrentMemoryPoolManager.h"
+#include "LockFreeMemoryPoolManager.h"
+#include "PerCpuMemoryPoolManager.h"
+#include "CompactPoolManager.h"
+#include "PerfCounters.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Benchmarks a set of allocation workloads against MemoryPoolManager, the thread safe managers, malloc and new. Each
+// case is warmed up, then repeated, and the mean time of every repetition is kept so the spread between repetitions
+// can be reported along with the typical time. Run with --help for the options.
+
+/// Settings from the command line.
+struct Config {
+    /// Number of blocks each workload keeps allocated, and so the number of operations in one repetition.
+    unsigned int liveBlocks = 10000;
+    unsigned int warmups = 5;
+    unsigned int repetitions = 100;
+    unsigned int blocksPerPage = 4096;
+    bool perfCounters = false;
+    std::string format = "text";
+    std::string filter;
+};
+
+/// Timing of one workload, block size and allocator.
+struct Result {
+    std::string workload;
+    std::size_t blockSize = 0;
+    std::string allocator;
+    unsigned int operations = 0;
+    /// Mean nanoseconds per allocation and free of each repetition, sorted. Single slow operations are averaged into
+    /// their repetition, so percentiles of these show the spread between repetitions, not the latency tail.
+    std::vector<double> nanoseconds;
+    /// Hardware counters per allocation and free over all repetitions, if enabled.
+    std::vector<std::pair<std::string, double>> counters;
+    
+    /// Returns the nearest rank percentile of the repetition means, given as a fraction such as 0.9.
+    double percentile(const double fraction) const {
+        const std::size_t rank = static_cast<std::size_t>(std::ceil(fraction * nanoseconds.size()));
+        return nanoseconds[std::max<std::size_t>(rank, 1) - 1];
+    }
+    
+    double mean() const {
+        double total = 0;
+        for (double time : nanoseconds) {
+            total += time;
+        }
+        return total / nanoseconds.size();
+    }
+};
+
+/// Block of the given size, aligned like the memory malloc returns.
+template <std::size_t Size>
+struct Block {
+    alignas(std::max_align_t) unsigned char data[Size];
+};
+
+/// Block of the given size with no alignment, for pools of small types such as ids.
+template <std::size_t Size>
+struct SmallBlock {
+    unsigned char data[Size];
+};
+
+/// Memory used by the pages of a pool, in bytes.
+struct Footprint {
+    std::string workload;
+    std::size_t blockSize;
+    std::string allocator;
+    unsigned long long blocks;
+    std::size_t pageBytes;
+    
+    double bytesPerBlock() const {return static_cast<double>(pageBytes) / blocks;}
+};
+
+/// Page occupancy and hardware counters of one repetition of a long churn.
+struct ChurnInterval {
+    /// Percentage of the capacity of the pool's pages that holds live blocks, after trimming.
+    double occupancy = 0;
+    /// Hardware counters per allocation and free during the repetition, if enabled.
+    std::vector<std::pair<std::string, double>> counters;
+};
+
+/// Every timed repetition of a long churn with one allocator.
+struct ChurnIntervals {
+    std::string workload;
+    std::size_t blockSize = 0;
+    std::string allocator;
+    std::vector<ChurnInterval> intervals;
+};
+
+/// Writes a value into a block, as a program would when it starts using it.
+template <class T>
+void fill(T* block, const unsigned int value) {
+    block->data[0] = static_cast<unsigned char>(value);
+    block->data[sizeof(T) - 1] = static_cast<unsigned char>(value);
+}
+
+/// Returns true if a block still holds the value written into it.
+template <class T>
+bool check(T* block, const unsigned int value) {
+    return block->data[0] == static_cast<unsigned char>(value)
+        && block->data[sizeof(T) - 1] == static_cast<unsigned char>(value);
+}
+
+
+/// Allocator backed by a memory manager with pages of the configured number of blocks.
+template <class T, class Manager>
+class ManagerSubject {
+private:
+    Manager _manager;
+    
+public:
+    explicit ManagerSubject(const Config& config)
+    : _manager(config.blocksPerPage) {}
+    
+    T* allocate() {return _manager.allocateBlock();}
+    void deallocate(T* block) {_manager.freeBlock(block);}
+};
+
+/// Memory manager owned by the thread that allocates from it, which other threads free blocks back to through its
+/// remote-free list.
+template <class T>
+class OwnerSubject {
+private:
+    MemoryPoolManager<T, MallocPageSource, NoValidation, OwnerThreading> _manager;
+    
+public:
+    explicit OwnerSubject(const Config& config)
+    : _manager(config.blocksPerPage) {}
+    
+    void claimOwnership() {_manager.claimOwnership();}
+    T* allocate() {return _manager.allocateBlock();}
+    void deallocate(T* block) {_manager.freeBlock(block);}
+};
+
+/// Memory manager with hardened validation, checking the canaries of one in ValidationInterval frees.
+template <class T, unsigned int ValidationInterval, bool EncodeFreeList>
+class HardenedSubject {
+private:
+    MemoryPoolManager<T, MallocPageSource, HardenedValidation> _manager;
+    
+    static MemoryPoolOptions options() {
+        MemoryPoolOptions options;
+        options.validationInterval = ValidationInterval;
+        options.encodeFreeList = EncodeFreeList;
+        return options;
+    }
+    
+public:
+    explicit HardenedSubject(const Config& config)
+    : _manager(config.blocksPerPage, options()) {}
+    
+    T* allocate() {return _manager.allocateBlock();}
+    void deallocate(T* block) {_manager.freeBlock(block);}
+};
+
+/// Memory manager with debug validation, holding freed blocks in a quarantine of QuarantineSize blocks and
+/// poisoning them if Poison is true. Pages have the configured number of blocks unless BlocksPerPage is set.
+template <class T, class PageSource, unsigned int QuarantineSize, bool Poison, unsigned int BlocksPerPage = 0>
+class DebugSubject {
+private:
+    MemoryPoolManager<T, PageSource, DebugValidation> _manager;
+    
+    static MemoryPoolOptions options() {
+        MemoryPoolOptions options;
+        options.quarantineSize = QuarantineSize;
+        options.poisonFreedBlocks = Poison;
+        return options;
+    }
+    
+public:
+    explicit DebugSubject(const Config& config)
+    : _manager(BlocksPerPage != 0 ? BlocksPerPage : config.blocksPerPage, options()) {}
+    
+    T* allocate() {return _manager.allocateBlock();}
+    void deallocate(T* block) {_manager.freeBlock(block);}
+};
+
+/// Memory manager with full validation, finding the page of each freed block by searching the pages or, if Reserve is
+/// true, from the slot of reserved address space the block is in. Pages have the configured number of blocks unless
+/// BlocksPerPage is set.
+template <class T, unsigned int BlocksPerPage, bool Reserve>
+class PageLookupSubject {
+private:
+    MemoryPoolManager<T, MallocPageSource, FullValidation> _manager;
+    
+    static MemoryPoolOptions options() {
+        MemoryPoolOptions options;
+        options.reservedAddressSpace = Reserve ? size_t(1) << 36 : 0;
+        return options;
+    }
+    
+public:
+    explicit PageLookupSubject(const Config& config)
+    : _manager(BlocksPerPage != 0 ? BlocksPerPage : config.blocksPerPage, options()) {}
+    
+    T* allocate() {return _manager.allocateBlock();}
+    void deallocate(T* block) {_manager.freeBlock(block);}
+};
+
+/// Memory manager that keeps its list of available blocks out of the blocks, with indices of the given type. Pages have
+/// the configured number of blocks, or as many as the indices can count if that is fewer.
+template <class T, class Index, class PageSource = MallocPageSource>
+class CompactSubject {
+private:
+    CompactPoolManager<T, PageSource, Index> _manager;
+    
+public:
+    explicit CompactSubject(const Config& config)
+    : _manager(static_cast<unsigned int>(std::min<unsigned long long>(config.blocksPerPage,
+                                                                      std::numeric_limits<Index>::max() + 1ull))) {}
+    
+    T* allocate() {return _manager.allocateBlock();}
+    void deallocate(T* block) {_manager.freeBlock(block);}
+};
+
+/// Page source that keeps count of the bytes of pages currently allocated, and the most allocated at once, so the
+/// footprint of a pool can be measured. The pools using it allocate pages from one thread at a time.
+class CountingPageSource {
+public:
+    static std::size_t bytes;
+    static std::size_t peakBytes;
+    
+    static void* allocatePage(const std::size_t size) {
+        bytes += size;
+        peakBytes = std::max(peakBytes, bytes);
+        return MallocPageSource::allocatePage(size);
+    }
+    
+    static void releasePage(void* page, const std::size_t size) {
+        bytes -= size;
+        MallocPageSource::releasePage(page, size);
+    }
+};
+
+std::size_t CountingPageSource::bytes = 0;
+std::size_t CountingPageSource::peakBytes = 0;
+
+template <class T>
+class MallocSubject {
+public:
+    explicit MallocSubject(const Config&) {}
+    
+    T* allocate() {return static_cast<T*>(malloc(sizeof(T)));}
+    void deallocate(T* block) {free(block);}
+};
+
+template <class T>
+class NewSubject {
+public:
+    explicit NewSubject(const Config&) {}
+    
+    T* allocate() {return new T;}
+    void deallocate(T* block) {delete block;}
+};
+
+
+/// Order in which a batch of allocated blocks is freed.
+enum class FreeOrder {
+    lifo,
+    fifo,
+    random
+};
+
+/// Allocates the live set, then frees all of it in the given order.
+template <class T, class Subject>
+class BatchWorkload {
+private:
+    Subject _subject;
+    std::vector<T*> _blocks;
+    std::vector<unsigned int> _order;
+    unsigned int _errors = 0;
+    
+public:
+    BatchWorkload(const Config& config, const FreeOrder order)
+    : _subject(config)
+    , _blocks(config.liveBlocks)
+    , _order(config.liveBlocks) {
+        for (unsigned int i = 0; i < config.liveBlocks; ++i) {
+            _order[i] = order == FreeOrder::lifo ? config.liveBlocks - 1 - i : i;
+        }
+        if (order == FreeOrder::random) {
+            std::shuffle(_order.begin(), _order.end(), std::mt19937(42));
+        }
+    }
+    
+    unsigned int run() {
+        for (unsigned int i = 0; i < _blocks.size(); ++i) {
+            _blocks[i] = _subject.allocate();
+            fill(_blocks[i], i);
+        }
+        for (unsigned int i : _order) {
+            _errors += !check(_blocks[i], i);
+            _subject.deallocate(_blocks[i]);
+        }
+        return static_cast<unsigned int>(_blocks.size());
+    }
+    
+    unsigned int getErrors() const {return _errors;}
+};
+
+/// Keeps the live set allocated and repeatedly replaces a random one of its blocks, like a long running program whose
+/// memory use has leveled off.
+template <class T, class Subject>
+class ChurnWorkload {
+private:
+    Subject _subject;
+    std::vector<T*> _blocks;
+    std::vector<unsigned int> _values;
+    std::vector<unsigned int> _victims;
+    unsigned int _errors = 0;
+    
+public:
+    explicit ChurnWorkload(const Config& config)
+    : _subject(config)
+    , _blocks(config.liveBlocks)
+    , _values(config.liveBlocks)
+    , _victims(config.liveBlocks) {
+        for (unsigned int i = 0; i < config.liveBlocks; ++i) {
+            _blocks[i] = _subject.allocate();
+            _values[i] = i;
+            fill(_blocks[i], i);
+        }
+        std::mt19937 random(42);
+        std::uniform_int_distribution<unsigned int> index(0, config.liveBlocks - 1);
+        for (unsigned int& victim : _victims) {
+            victim = index(random);
+        }
+    }
+    
+    ~ChurnWorkload() {
+        for (T* block : _blocks) {
+            _subject.deallocate(block);
+        }
+    }
+    
+    unsigned int run() {
+        for (unsigned int victim : _victims) {
+            _errors += !check(_blocks[victim], _values[victim]);
+            _subject.deallocate(_blocks[victim]);
+            _blocks[victim] = _subject.allocate();
+            fill(_blocks[victim], ++_values[victim]);
+        }
+        return static_cast<unsigned int>(_victims.size());
+    }
+    
+    unsigned int getErrors() const {return _errors;}
+};
+
+/// Starts from a peak of four times the live set with three quarters of it freed at random, then keeps replacing
+/// random live blocks like ChurnWorkload, and the pool is trimmed between repetitions. With a single list of available
+/// blocks the survivors of the peak stay spread over every page, while preferring the fullest page packs them into as
+/// few pages as possible, so the two are compared by time, by cache and TLB misses, and by how full the pages are after
+/// each repetition. Pages have 256 blocks so that the pool has many of them. The blocks to replace are drawn during
+/// each repetition, since a fixed set of them would leave the rest of the survivors where they are forever.
+template <class T, class Modes>
+class LongChurnWorkload {
+private:
+    MemoryPoolManager<T, MallocPageSource, NoValidation, SingleThreaded, NoStats, Modes> _manager;
+    std::vector<T*> _blocks;
+    std::vector<unsigned int> _values;
+    std::mt19937 _random;
+    std::uniform_int_distribution<unsigned int> _index;
+    unsigned int _errors = 0;
+    
+    static const unsigned int blocksPerPage = 256;
+    
+public:
+    explicit LongChurnWorkload(const Config& config)
+    : _manager(blocksPerPage)
+    , _blocks(4 * config.liveBlocks)
+    , _values(config.liveBlocks)
+    , _random(42)
+    , _index(0, config.liveBlocks - 1) {
+        for (T*& block : _blocks) {
+            block = _manager.allocateBlock();
+        }
+        std::shuffle(_blocks.begin(), _blocks.end(), _random);
+        for (unsigned int i = config.liveBlocks; i < _blocks.size(); ++i) {
+            _manager.freeBlock(_blocks[i]);
+        }
+        _blocks.resize(config.liveBlocks);
+        for (unsigned int i = 0; i < config.liveBlocks; ++i) {
+            _values[i] = i;
+            fill(_blocks[i], i);
+        }
+        settle();
+    }
+    
+    ~LongChurnWorkload() {
+        for (T* block : _blocks) {
+            _manager.freeBlock(block);
+        }
+    }
+    
+    unsigned int run() {
+        for (unsigned int i = 0; i < _blocks.size(); ++i) {
+            const unsigned int victim = _index(_random);
+            _errors += !check(_blocks[victim], _values[victim]);
+            _manager.freeBlock(_blocks[victim]);
+            _blocks[victim] = _manager.allocateBlock();
+            fill(_blocks[victim], ++_values[victim]);
+        }
+        return static_cast<unsigned int>(_blocks.size());
+    }
+    
+    /// Trims the pool, outside of the timed repetitions, and returns the percentage of the capacity of the pages left
+    /// that holds live blocks.
+    double settle() {
+        _manager.trim();
+        return 100.0 * _blocks.size() / (static_cast<double>(_manager.getNumberOfPages()) * blocksPerPage);
+    }
+    
+    unsigned int getErrors() const {return _errors;}
+};
+
+/// How a frame workload discards the blocks allocated during a frame.
+enum class FrameEnd {
+    freeEach,
+    reset,
+    clearAllMemory
+};
+
+/// Allocates the live set during each frame, then discards all of it at the end of the frame by freeing every block,
+/// resetting the pool, or clearing all of its memory, like a pool for the objects of a frame or a request.
+template <class T, class Modes>
+class FrameWorkload {
+private:
+    MemoryPoolManager<T, MallocPageSource, NoValidation, SingleThreaded, NoStats, Modes> _manager;
+    std::vector<T*> _blocks;
+    const FrameEnd _end;
+    unsigned int _errors = 0;
+    
+public:
+    FrameWorkload(const Config& config, const FrameEnd end)
+    : _manager(config.blocksPerPage)
+    , _blocks(config.liveBlocks)
+    , _end(end) {}
+    
+    unsigned int run() {
+        for (unsigned int i = 0; i < _blocks.size(); ++i) {
+            _blocks[i] = _manager.allocateBlock();
+            fill(_blocks[i], i);
+        }
+        for (unsigned int i = 0; i < _blocks.size(); ++i) {
+            _errors += !check(_blocks[i], i);
+        }
+        if (_end == FrameEnd::freeEach) {
+            for (T* block : _blocks) {
+                _manager.freeBlock(block);
+            }
+        }
+        else if (_end == FrameEnd::reset) {
+            _manager.reset();
+        }
+        else {
+            _manager.clearAllMemory();
+        }
+        return static_cast<unsigned int>(_blocks.size());
+    }
+    
+    unsigned int getErrors() const {return _errors;}
+};
+
+/// Makes the calling thread the owner of the subject's pool, for subjects whose pools have an owner.
+template <class Subject>
+auto claimOwnership(Subject& subject, int) -> decltype(subject.claimOwnership()) {
+    subject.claimOwnership();
+}
+
+template <class Subject>
+void claimOwnership(Subject&, long) {}
+
+/// A producer thread allocates and fills blocks and passes them through a bounded queue to the calling thread, which
+/// checks and frees them, so every block is freed by a different thread than the one that allocated it. Each
+/// repetition includes starting the producer thread.
+template <class T, class Subject>
+class ProducerConsumerWorkload {
+private:
+    static constexpr unsigned int queueSize = 1024;
+    
+    Subject _subject;
+    const unsigned int _count;
+    std::vector<T*> _queue;
+    alignas(64) std::atomic<unsigned int> _produced;
+    alignas(64) std::atomic<unsigned int> _consumed;
+    unsigned int _errors = 0;
+    
+public:
+    explicit ProducerConsumerWorkload(const Config& config)
+    : _subject(config)
+    , _count(config.liveBlocks)
+    , _queue(queueSize) {}
+    
+    unsigned int run() {
+        _produced.store(0, std::memory_order_relaxed);
+        _consumed.store(0, std::memory_order_relaxed);
+        std::thread producer([this]() {
+            claimOwnership(_subject, 0);
+            for (unsigned int i = 0; i < _count; ++i) {
+                T* block = _subject.allocate();
+                fill(block, i);
+                while (i - _consumed.load(std::memory_order_acquire) == queueSize) {
+                    std::this_thread::yield();
+                }
+                _queue[i % queueSize] = block;
+                _produced.store(i + 1, std::memory_order_release);
+            }
+        });
+        for (unsigned int i = 0; i < _count; ++i) {
+            while (_produced.load(std::memory_order_acquire) == i) {
+                std::this_thread::yield();
+            }
+            T* block = _queue[i % queueSize];
+            _consumed.store(i + 1, std::memory_order_release);
+            _errors += !check(block, i);
+            _subject.deallocate(block);
+        }
+        producer.join();
+        return _count;
+    }
+    
+    unsigned int getErrors() const {return _errors;}
+};
+
+
+/// Threads, started once and kept for every repetition like the workers of a server, each allocate and fill their
+/// share of the live set, then check and free it, a number of times over. Each thread's share is at least a few dozen
+/// blocks, so with many threads more blocks are live. Each repetition includes waking the threads up.
+template <class T, class Subject>
+class ScalingWorkload {
+private:
+    static constexpr unsigned int rounds = 16;
+    
+    Subject _subject;
+    const unsigned int _threadCount;
+    const unsigned int _blocksPerThread;
+    std::vector<std::thread> _threads;
+    std::mutex _mutex;
+    std::condition_variable _started;
+    std::condition_variable _finished;
+    unsigned int _generation = 0;
+    unsigned int _finishedCount = 0;
+    bool _stopping = false;
+    std::atomic<unsigned int> _errors;
+    
+    void work(const unsigned int thread) {
+        std::vector<T*> blocks(_blocksPerThread);
+        unsigned int generation = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _started.wait(lock, [&]() {return _stopping || _generation != generation;});
+                if (_stopping) {
+                    return;
+                }
+                generation = _generation;
+            }
+            unsigned int errors = 0;
+            for (unsigned int round = 0; round < rounds; ++round) {
+                for (unsigned int i = 0; i < _blocksPerThread; ++i) {
+                    blocks[i] = _subject.allocate();
+                    fill(blocks[i], thread + i);
+                }
+                for (unsigned int i = 0; i < _blocksPerThread; ++i) {
+                    errors += !check(blocks[i], thread + i);
+                    _subject.deallocate(blocks[i]);
+                }
+            }
+            _errors += errors;
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (++_finishedCount == _threadCount) {
+                _finished.notify_one();
+            }
+        }
+    }
+    
+public:
+    static unsigned int blocksPerThread(const Config& config, const unsigned int threadCount) {
+        return std::max(config.liveBlocks / threadCount, 32u);
+    }
+    
+    ScalingWorkload(const Config& config, const unsigned int threadCount)
+    : _subject(config)
+    , _threadCount(threadCount)
+    , _blocksPerThread(blocksPerThread(config, threadCount))
+    , _errors(0) {
+        for (unsigned int t = 0; t < threadCount; ++t) {
+            _threads.emplace_back(&ScalingWorkload::work, this, t);
+        }
+    }
+    
+    ~ScalingWorkload() {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopping = true;
+        }
+        _started.notify_all();
+        for (std::thread& thread : _threads) {
+            thread.join();
+        }
+    }
+    
+    unsigned int run() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _finishedCount = 0;
+        ++_generation;
+        _started.notify_all();
+        _finished.wait(lock, [&]() {return _finishedCount == _threadCount;});
+        return _threadCount * _blocksPerThread * rounds;
+    }
+    
+    unsigned int getErrors() const {return _errors;}
+};
+
+
+/// Runs the cases and collects their results.
+class Benchmark {
+private:
+    const Config& _config;
+    PerfCounters _perfCounters;
+    std::vector<Result> _results;
+    std::vector<Footprint> _footprints;
+    std::vector<ChurnIntervals> _churnIntervals;
+    unsigned int _errors = 0;
+    
+    bool isSelected(const std::string& workload, const std::size_t blockSize, const std::string& allocator) {
+        const std::string name = workload + "/" + std::to_string(blockSize) + "/" + allocator;
+        return name.find(_config.filter) != std::string::npos;
+    }
+    
+    /// Warms up and times a workload, which is created only if the case is selected.
+    template <class Workload, class... Arguments>
+    void measure(const std::string& workload, const std::size_t blockSize, const std::string& allocator,
+                 Arguments... arguments) {
+        if (!isSelected(workload, blockSize, allocator)) {
+            return;
+        }
+        Workload instance(_config, arguments...);
+        for (unsigned int i = 0; i < _config.warmups; ++i) {
+            instance.run();
+        }
+        
+        Result result;
+        result.workload = workload;
+        result.blockSize = blockSize;
+        result.allocator = allocator;
+        unsigned long long totalOperations = 0;
+        if (_config.perfCounters) {
+            _perfCounters.start();
+        }
+        for (unsigned int i = 0; i < _config.repetitions; ++i) {
+            auto start = std::chrono::steady_clock::now();
+            result.operations = instance.run();
+            auto end = std::chrono::steady_clock::now();
+            std::chrono::duration<double, std::nano> diff = end - start;
+            result.nanoseconds.push_back(diff.count() / result.operations);
+            totalOperations += result.operations;
+        }
+        if (_config.perfCounters) {
+            _perfCounters.stop();
+            for (const PerfCounters::Counter& counter : _perfCounters.getCounters()) {
+                result.counters.emplace_back(counter.name, static_cast<double>(counter.value) / totalOperations);
+            }
+        }
+        std::sort(result.nanoseconds.begin(), result.nanoseconds.end());
+        _errors += instance.getErrors();
+        _results.push_back(result);
+    }
+    
+    /// Warms up and times a long churn like measure, but reads the hardware counters of every repetition on its own,
+    /// and settles the workload between repetitions without timing it.
+    template <class Workload>
+    void measureLongChurn(const std::string& workload, const std::size_t blockSize, const std::string& allocator) {
+        if (!isSelected(workload, blockSize, allocator)) {
+            return;
+        }
+        Workload instance(_config);
+        for (unsigned int i = 0; i < _config.warmups; ++i) {
+            instance.run();
+            instance.settle();
+        }
+        
+        Result result;
+        result.workload = workload;
+        result.blockSize = blockSize;
+        result.allocator = allocator;
+        ChurnIntervals churn;
+        churn.workload = workload;
+        churn.blockSize = blockSize;
+        churn.allocator = allocator;
+        std::vector<unsigned long long> counterTotals;
+        unsigned long long totalOperations = 0;
+        for (unsigned int i = 0; i < _config.repetitions; ++i) {
+            if (_config.perfCounters) {
+                _perfCounters.start();
+            }
+            auto start = std::chrono::steady_clock::now();
+            result.operations = instance.run();
+            auto end = std::chrono::steady_clock::now();
+            ChurnInterval interval;
+            if (_config.perfCounters) {
+                _perfCounters.stop();
+                const std::vector<PerfCounters::Counter>& counters = _perfCounters.getCounters();
+                counterTotals.resize(counters.size());
+                for (std::size_t c = 0; c < counters.size(); ++c) {
+                    interval.counters.emplace_back(counters[c].name,
+                                                   static_cast<double>(counters[c].value) / result.operations);
+                    counterTotals[c] += counters[c].value;
+                }
+            }
+            std::chrono::duration<double, std::nano> diff = end - start;
+            result.nanoseconds.push_back(diff.count() / result.operations);
+            totalOperations += result.operations;
+            interval.occupancy = instance.settle();
+            churn.intervals.push_back(interval);
+        }
+        for (std::size_t c = 0; c < counterTotals.size(); ++c) {
+            result.counters.emplace_back(_perfCounters.getCounters()[c].name,
+                                         static_cast<double>(counterTotals[c]) / totalOperations);
+        }
+        std::sort(result.nanoseconds.begin(), result.nanoseconds.end());
+        _errors += instance.getErrors();
+        _results.push_back(result);
+        _churnIntervals.push_back(churn);
+    }
+    
+    /// Measures the bytes of pages a pool uses to hold a hundred times the usual number of live blocks. The subject
+    /// must allocate its pages from CountingPageSource.
+    template <class T, class Subject>
+    void measureFootprint(const std::string& allocator) {
+        if (!isSelected("footprint", sizeof(T), allocator)) {
+            return;
+        }
+        const unsigned long long blockCount = 100ull * _config.liveBlocks;
+        CountingPageSource::bytes = 0;
+        {
+            Subject subject(_config);
+            for (unsigned long long i = 0; i < blockCount; ++i) {
+                fill(subject.allocate(), static_cast<unsigned int>(i));
+            }
+            _footprints.push_back({"footprint", sizeof(T), allocator, blockCount, CountingPageSource::bytes});
+        }
+    }
+    
+    /// Times the scaling workload with the given number of threads. For pools that allocate their pages from
+    /// CountingPageSource, also records the most bytes of pages they had allocated at once.
+    template <class T, class Subject>
+    void measureScaling(const std::string& allocator, const unsigned int threadCount, const bool countsPages) {
+        const std::string workload = "scaling-" + std::to_string(threadCount);
+        CountingPageSource::bytes = CountingPageSource::peakBytes = 0;
+        measure<ScalingWorkload<T, Subject>>(workload, sizeof(T), allocator, threadCount);
+        if (countsPages && isSelected(workload, sizeof(T), allocator)) {
+            const unsigned long long blockCount
+                = threadCount * ScalingWorkload<T, Subject>::blocksPerThread(_config, threadCount);
+            _footprints.push_back({workload, sizeof(T), allocator, blockCount, CountingPageSource::peakBytes});
+        }
+    }
+    
+    template <class T, class Subject>
+    void runSingleThreaded(const std::string& allocator) {
+        measure<BatchWorkload<T, Subject>>("lifo", sizeof(T), allocator, FreeOrder::lifo);
+        measure<BatchWorkload<T, Subject>>("fifo", sizeof(T), allocator, FreeOrder::fifo);
+        measure<BatchWorkload<T, Subject>>("random", sizeof(T), allocator, FreeOrder::random);
+        measure<ChurnWorkload<T, Subject>>("churn", sizeof(T), allocator);
+    }
+    
+    template <std::size_t Size>
+    void runBlockSize() {
+        typedef Block<Size> T;
+        runSingleThreaded<T, ManagerSubject<T, MemoryPoolManager<T, MallocPageSource, NoValidation>>>(
+            "MemoryPoolManager");
+        runSingleThreaded<T, MallocSubject<T>>("malloc");
+        runSingleThreaded<T, NewSubject<T>>("new");
+        
+        measure<ProducerConsumerWorkload<T, ManagerSubject<T,
+            MemoryPoolManager<T, MallocPageSource, NoValidation, MutexThreading>>>>(
+                "producer-consumer", Size, "MemoryPoolManager+MutexThreading");
+        measure<ProducerConsumerWorkload<T, OwnerSubject<T>>>(
+            "producer-consumer", Size, "MemoryPoolManager+OwnerThreading");
+        measure<ProducerConsumerWorkload<T, ManagerSubject<T, ConcurrentMemoryPoolManager<T>>>>(
+            "producer-consumer", Size, "ConcurrentMemoryPoolManager");
+        measure<ProducerConsumerWorkload<T, ManagerSubject<T, LockFreeMemoryPoolManager<T>>>>(
+            "producer-consumer", Size, "LockFreeMemoryPoolManager");
+        measure<ProducerConsumerWorkload<T, MallocSubject<T>>>("producer-consumer", Size, "malloc");
+        measure<ProducerConsumerWorkload<T, NewSubject<T>>>("producer-consumer", Size, "new");
+    }
+    
+    /// Compares the per CPU and per thread caches with one thread per core, and with 16 and 64 times as many threads.
+    template <std::size_t Size>
+    void runScaling() {
+        typedef Block<Size> T;
+        const unsigned int cores = std::max(std::thread::hardware_concurrency(), 1u);
+        for (unsigned int threadCount : {cores, 16 * cores, 64 * cores}) {
+            measureScaling<T, ManagerSubject<T, PerCpuMemoryPoolManager<T, CountingPageSource>>>(
+                "PerCpuMemoryPoolManager", threadCount, true);
+            measureScaling<T, ManagerSubject<T, ConcurrentMemoryPoolManager<T, CountingPageSource>>>(
+                "ConcurrentMemoryPoolManager", threadCount, true);
+            measureScaling<T, MallocSubject<T>>("malloc", threadCount, false);
+        }
+    }
+    
+    /// Compares hardened validation at several sampling rates, with and without an encoded free list, against full
+    /// validation. The same cases without validation are run with the rest of the block size.
+    template <std::size_t Size>
+    void runHardening() {
+        typedef Block<Size> T;
+        runSingleThreaded<T, HardenedSubject<T, 1, false>>("MemoryPoolManager+Hardened(1)");
+        runSingleThreaded<T, HardenedSubject<T, 16, false>>("MemoryPoolManager+Hardened(16)");
+        runSingleThreaded<T, HardenedSubject<T, 64, false>>("MemoryPoolManager+Hardened(64)");
+        runSingleThreaded<T, HardenedSubject<T, 1024, false>>("MemoryPoolManager+Hardened(1024)");
+        runSingleThreaded<T, HardenedSubject<T, 64, true>>("MemoryPoolManager+Hardened(64)+Encoded");
+        runSingleThreaded<T, HardenedSubject<T, 1024, true>>("MemoryPoolManager+Hardened(1024)+Encoded");
+        runSingleThreaded<T, ManagerSubject<T, MemoryPoolManager<T, MallocPageSource, FullValidation>>>(
+            "MemoryPoolManager+FullValidation");
+    }
+    
+    /// Compares the managers that keep the list of available blocks in the blocks and out of them, for block sizes
+    /// smaller than a pointer, by time and by the memory their pages use.
+    template <std::size_t Size>
+    void runSmallBlocks() {
+        typedef SmallBlock<Size> T;
+        runSingleThreaded<T, ManagerSubject<T, MemoryPoolManager<T, MallocPageSource, NoValidation>>>(
+            "MemoryPoolManager");
+        runSingleThreaded<T, CompactSubject<T, uint16_t>>("CompactPoolManager<uint16_t>");
+        runSingleThreaded<T, CompactSubject<T, uint32_t>>("CompactPoolManager<uint32_t>");
+        runSingleThreaded<T, MallocSubject<T>>("malloc");
+        
+        measureFootprint<T, ManagerSubject<T, MemoryPoolManager<T, CountingPageSource, NoValidation>>>(
+            "MemoryPoolManager");
+        measureFootprint<T, CompactSubject<T, uint16_t, CountingPageSource>>("CompactPoolManager<uint16_t>");
+        measureFootprint<T, CompactSubject<T, uint32_t, CountingPageSource>>("CompactPoolManager<uint32_t>");
+    }
+    
+    /// Compares discarding every block of a frame by freeing each of them, by resetting the pool and by clearing all of
+    /// its memory, with and without lazy page carving.
+    template <std::size_t Size>
+    void runFrames() {
+        runFrameEnds<Block<Size>, PoolModes<>>("MemoryPoolManager");
+        runFrameEnds<Block<Size>, PoolModes<LazyPageCarving>>("MemoryPoolManager+LazyPageCarving");
+    }
+    
+    /// Measures each way of discarding the blocks of a frame for a pool with the given modes.
+    template <class T, class Modes>
+    void runFrameEnds(const std::string& allocator) {
+        measure<FrameWorkload<T, Modes>>("frame", sizeof(T), allocator + "+freeBlock", FrameEnd::freeEach);
+        measure<FrameWorkload<T, Modes>>("frame", sizeof(T), allocator + "+reset", FrameEnd::reset);
+        measure<FrameWorkload<T, Modes>>("frame", sizeof(T), allocator + "+clearAllMemory", FrameEnd::clearAllMemory);
+    }
+    
+    /// Compares a single list of available blocks with preferring the fullest page over a long churn.
+    template <std::size_t Size>
+    void runLongChurn() {
+        typedef Block<Size> T;
+        measureLongChurn<LongChurnWorkload<T, PoolModes<>>>("long-churn", Size, "MemoryPoolManager");
+        measureLongChurn<LongChurnWorkload<T, PoolModes<PreferFullestPage>>>("long-churn", Size,
+                                                                             "MemoryPoolManager+PreferFullestPage");
+    }
+    
+    /// Compares finding the pages of freed blocks by searching the pages and from reserved address space, with small
+    /// pages so that there are hundreds of them, and with the configured number of blocks per page.
+    template <std::size_t Size>
+    void runPageLookup() {
+        typedef Block<Size> T;
+        runSingleThreaded<T, PageLookupSubject<T, 16, false>>("MemoryPoolManager+FullValidation(16)");
+#if defined(__unix__) || defined(__APPLE__)
+        runSingleThreaded<T, PageLookupSubject<T, 16, true>>("MemoryPoolManager+FullValidation(16)+Reserved");
+        runSingleThreaded<T, PageLookupSubject<T, 0, true>>("MemoryPoolManager+FullValidation+Reserved");
+#endif
+    }
+    
+    /// Compares debug validation with different quarantine sizes, with and without poisoning, and with guard pages
+    /// around every page or every block, against full validation.
+    template <std::size_t Size>
+    void runDebugging() {
+        typedef Block<Size> T;
+        runSingleThreaded<T, DebugSubject<T, MallocPageSource, 0, false>>("MemoryPoolManager+Debug");
+        runSingleThreaded<T, DebugSubject<T, MallocPageSource, 0, true>>("MemoryPoolManager+Debug+Poison");
+        runSingleThreaded<T, DebugSubject<T, MallocPageSource, 256, false>>("MemoryPoolManager+Debug(256)");
+        runSingleThreaded<T, DebugSubject<T, MallocPageSource, 256, true>>("MemoryPoolManager+Debug(256)+Poison");
+        runSingleThreaded<T, DebugSubject<T, MallocPageSource, 4096, true>>("MemoryPoolManager+Debug(4096)+Poison");
+#if defined(__unix__) || defined(__APPLE__)
+        runSingleThreaded<T, DebugSubject<T, GuardedPageSource, 256, true>>(
+            "MemoryPoolManager+Debug(256)+Poison+Guards");
+        runSingleThreaded<T, DebugSubject<T, GuardedPageSource, 256, true, 1>>(
+            "MemoryPoolManager+Debug(256)+Poison+BlockGuards");
+#endif
+    }
+    
+public:
+    explicit Benchmark(const Config& config)
+    : _config(config) {}
+    
+    bool hasPerfCounters() const {return _perfCounters.isAvailable();}
+    const std::vector<Result>& getResults() const {return _results;}
+    const std::vector<Footprint>& getFootprints() const {return _footprints;}
+    const std::vector<ChurnIntervals>& getChurnIntervals() const {return _churnIntervals;}
+    
+    /// Returns the number of times a block didn't hold the value written into it, which should be zero.
+    unsigned int getErrors() const {return _errors;}
+    
+    void run() {
+        runBlockSize<16>();
+        runBlockSize<64>();
+        runBlockSize<256>();
+        runBlockSize<1024>();
+        runHardening<16>();
+        runHardening<64>();
+        runDebugging<64>();
+        runPageLookup<64>();
+        runFrames<64>();
+        runFrames<1024>();
+        runLongChurn<64>();
+        runSmallBlocks<1>();
+        runSmallBlocks<2>();
+        runSmallBlocks<4>();
+        runScaling<64>();
+    }
+};
+
+
+void outputText(const Config& config, const std::vector<Result>& results, const std::vector<Footprint>& footprints,
+                const std::vector<ChurnIntervals>& churns) {
+    std::cout << "Per-repetition mean percentiles of nanoseconds per allocation and free, over " << config.repetitions
+              << " repetitions of " << config.liveBlocks << " operations, after " << config.warmups << " warm-up runs"
+              << std::endl;
+    std::cout << std::left << std::setw(18) << "workload" << std::right << std::setw(6) << "size" << "  "
+              << std::left << std::setw(48) << "allocator" << std::right;
+    for (const char* column : {"min", "p50", "p90", "p99", "max"}) {
+        std::cout << std::setw(9) << column;
+    }
+    if (!results.empty()) {
+        for (const auto& counter : results.front().counters) {
+            std::cout << std::setw(14) << counter.first;
+        }
+    }
+    std::cout << std::endl << std::fixed << std::setprecision(2);
+    for (const Result& result : results) {
+        std::cout << std::left << std::setw(18) << result.workload << std::right << std::setw(6) << result.blockSize
+                  << "  " << std::left << std::setw(48) << result.allocator << std::right;
+        for (double fraction : {0.0, 0.5, 0.9, 0.99, 1.0}) {
+            std::cout << std::setw(9) << result.percentile(fraction);
+        }
+        for (const auto& counter : result.counters) {
+            std::cout << std::setw(14) << counter.second;
+        }
+        std::cout << std::endl;
+    }
+    
+    if (!footprints.empty()) {
+        std::cout << std::endl << "Bytes of pages per block, with the given number of blocks allocated" << std::endl;
+        std::cout << std::left << std::setw(18) << "workload" << std::right << std::setw(6) << "size" << "  "
+                  << std::left << std::setw(48) << "allocator" << std::right << std::setw(9) << "blocks"
+                  << std::setw(9) << "bytes" << std::endl;
+        for (const Footprint& footprint : footprints) {
+            std::cout << std::left << std::setw(18) << footprint.workload << std::right << std::setw(6)
+                      << footprint.blockSize << "  " << std::left << std::setw(48) << footprint.allocator << std::right
+                      << std::setw(9) << footprint.blocks << std::setw(9) << footprint.bytesPerBlock() << std::endl;
+        }
+    }
+    
+    if (!churns.empty()) {
+        // the first and last repetitions, and the quarters in between
+        std::vector<std::size_t> repetitions;
+        for (std::size_t quarter = 0; quarter <= 4; ++quarter) {
+            const std::size_t repetition = std::max<std::size_t>(quarter * config.repetitions / 4, 1);
+            if (repetitions.empty() || repetitions.back() != repetition) {
+                repetitions.push_back(repetition);
+            }
+        }
+        std::cout << std::endl << "Percent of page capacity holding live blocks after trimming, and counters per "
+                  << "operation, by repetition" << std::endl;
+        std::cout << std::left << std::setw(18) << "workload" << std::right << std::setw(6) << "size" << "  "
+                  << std::left << std::setw(48) << "allocator" << std::right << std::setw(11) << "repetition"
+                  << std::setw(11) << "occupancy";
+        for (const auto& counter : churns.front().intervals.front().counters) {
+            std::cout << std::setw(14) << counter.first;
+        }
+        std::cout << std::endl;
+        for (const ChurnIntervals& churn : churns) {
+            for (std::size_t repetition : repetitions) {
+                const ChurnInterval& interval = churn.intervals[repetition - 1];
+                std::cout << std::left << std::setw(18) << churn.workload << std::right << std::setw(6)
+                          << churn.blockSize << "  " << std::left << std::setw(48) << churn.allocator << std::right
+                          << std::setw(11) << repetition << std::setw(11) << interval.occupancy;
+                for (const auto& counter : interval.counters) {
+                    std::cout << std::setw(14) << counter.second;
+                }
+                std::cout << std::endl;
+            }
+        }
+    }
+}
+
+void outputJson(const Config& config, const std::vector<Result>& results, const std::vector<Footprint>& footprints,
+                const std::vector<ChurnIntervals>& churns) {
+    std::cout << "{\"config\": {\"liveBlocks\": " << config.liveBlocks << ", \"warmups\": " << config.warmups
+              << ", \"repetitions\": " << config.repetitions << ", \"blocksPerPage\": " << config.blocksPerPage
+              << "}," << std::endl << " \"results\": [";
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        const Result& result = results[i];
+        std::cout << (i > 0 ? "," : "") << std::endl
+                  << "  {\"workload\": \"" << result.workload << "\", \"blockSize\": " << result.blockSize
+                  << ", \"allocator\": \"" << result.allocator << "\", \"operations\": " << result.operations
+                  << ", \"repetitionMeanNanosecondsPerOperation\": {\"min\": " << result.percentile(0)
+                  << ", \"p50\": " << result.percentile(0.5) << ", \"p90\": " << result.percentile(0.9)
+                  << ", \"p99\": " << result.percentile(0.99) << ", \"max\": " << result.percentile(1)
+                  << ", \"mean\": " << result.mean() << "}, \"countersPerOperation\": {";
+        for (std::size_t c = 0; c < result.counters.size(); ++c) {
+            std::cout << (c > 0 ? ", " : "") << "\"" << result.counters[c].first << "\": " << result.counters[c].second;
+        }
+        std::cout << "}}";
+    }
+    std::cout << std::endl << "]," << std::endl << " \"footprints\": [";
+    for (std::size_t i = 0; i < footprints.size(); ++i) {
+        const Footprint& footprint = footprints[i];
+        std::cout << (i > 0 ? "," : "") << std::endl
+                  << "  {\"workload\": \"" << footprint.workload << "\", \"blockSize\": " << footprint.blockSize << ", \"allocator\": \"" << footprint.allocator
+                  << "\", \"blocks\": " << footprint.blocks << ", \"pageBytes\": " << footprint.pageBytes
+                  << ", \"bytesPerBlock\": " << footprint.bytesPerBlock() << "}";
+    }
+    std::cout << std::endl << "]," << std::endl << " \"churnIntervals\": [";
+    for (std::size_t i = 0; i < churns.size(); ++i) {
+        const ChurnIntervals& churn = churns[i];
+        std::cout << (i > 0 ? "," : "") << std::endl
+                  << "  {\"workload\": \"" << churn.workload << "\", \"blockSize\": " << churn.blockSize
+                  << ", \"allocator\": \"" << churn.allocator << "\", \"intervals\": [";
+        for (std::size_t r = 0; r < churn.intervals.size(); ++r) {
+            const ChurnInterval& interval = churn.intervals[r];
+            std::cout << (r > 0 ? ", " : "") << "{\"occupancy\": " << interval.occupancy
+                      << ", \"countersPerOperation\": {";
+            for (std::size_t c = 0; c < interval.counters.size(); ++c) {
+                std::cout << (c > 0 ? ", " : "") << "\"" << interval.counters[c].first << "\": "
+                          << interval.counters[c].second;
+            }
+            std::cout << "}}";
+        }
+        std::cout << "]}";
+    }
+    std::cout << std::endl << "]}" << std::endl;
+}
+
+void outputCsv(const std::vector<Result>& results) {
+    std::cout << "workload,block_size,allocator,operations,"
+              << "rep_min_ns,rep_p50_ns,rep_p90_ns,rep_p99_ns,rep_max_ns,mean_ns";
+    if (!results.empty()) {
+        for (const auto& counter : results.front().counters) {
+            std::cout << "," << counter.first;
+        }
+    }
+    std::cout << std::endl;
+    for (const Result& result : results) {
+        std::cout << result.workload << "," << result.blockSize << "," << result.allocator << "," << result.operations;
+        for (double fraction : {0.0, 0.5, 0.9, 0.99, 1.0}) {
+            std::cout << "," << result.percentile(fraction);
+        }
+        std::cout << "," << result.mean();
+        for (const auto& counter : result.counters) {
+            std::cout << "," << counter.second;
+        }
+        std::cout << std::endl;
+    }
+}
+
+void outputUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [options]" << std::endl
+              << "  --blocks N        blocks kept allocated by each workload (default 10000)" << std::endl
+              << "  --warmups N       untimed runs before timing each case (default 5)" << std::endl
+              << "  --repetitions N   timed runs of each case (default 100)" << std::endl
+              << "  --page-blocks N   blocks per page of the memory managers (default 4096)" << std::endl
+              << "  --filter TEXT     only run cases whose workload/size/allocator name contains TEXT" << std::endl
+              << "  --format FORMAT   text, json or csv, which leaves out footprints and churn intervals (default text)"
+              << std::endl
+              << "  --perf            read cache and TLB miss counters with perf_event_open" << std::endl
+              << "  --quick           small sizes and few repetitions, to check that everything runs" << std::endl;
+}
+
+int main(int argc, const char* argv[]) {
+    Config config;
+    for (int i = 1; i < argc; ++i) {
+        const std::string option = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (option == "--blocks" && hasValue) {
+            config.liveBlocks = static_cast<unsigned int>(std::max(1, atoi(argv[++i])));
+        }
+        else if (option == "--warmups" && hasValue) {
+            config.warmups = static_cast<unsigned int>(std::max(0, atoi(argv[++i])));
+        }
+        else if (option == "--repetitions" && hasValue) {
+            config.repetitions = static_cast<unsigned int>(std::max(1, atoi(argv[++i])));
+        }
+        else if (option == "--page-blocks" && hasValue) {
+            config.blocksPerPage = static_cast<unsigned int>(std::max(1, atoi(argv[++i])));
+        }
+        else if (option == "--filter" && hasValue) {
+            config.filter = argv[++i];
+        }
+        else if (option == "--format" && hasValue
+                 && (std::string(argv[i + 1]) == "text" || std::string(argv[i + 1]) == "json"
+                     || std::string(argv[i + 1]) == "csv")) {
+            config.format = argv[++i];
+        }
+        else if (option == "--perf") {
+            config.perfCounters = true;
+        }
+        else if (option == "--quick") {
+            config.liveBlocks = 1000;
+            config.warmups = 1;
+            config.repetitions = 3;
+        }
+        else {
+            outputUsage(argv[0]);
+            return option == "--help" ? 0 : 2;
+        }
+    }
+    
+    Benchmark benchmark(config);
+    if (config.perfCounters && !benchmark.hasPerfCounters()) {
+        std::cerr << "Hardware counters are not available, so they are left out." << std::endl;
+        config.perfCounters = false;
+    }
+    benchmark.run();
+    
+    if (config.format == "json") {
+        outputJson(config, benchmark.getResults(), benchmark.getFootprints(), benchmark.getChurnIntervals());
+    }
+    else if (config.format == "csv") {
+        outputCsv(benchmark.getResults());
+    }
+    else {
+        outputText(config, benchmark.getResults(), benchmark.getFootprints(), benchmark.getChurnIntervals());
+    }
+    
+    if (benchmark.getErrors() > 0) {
+        std::cerr << benchmark.getErrors() << " blocks were overwritten while allocated." << std::endl;
+        return 1;
+    }
+    return 0;
+}
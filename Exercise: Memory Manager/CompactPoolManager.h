@@ -0,0 +1,237 @@
+//
+//  CompactPoolManager.h
+//  Exercise: Memory Manager
+//
+
+#ifndef CompactPoolManager_h
+#define CompactPoolManager_h
+
+#include "MemoryPoolManager.h"
+#include "PageSources.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+/// Memory Manager for small types that keeps its list of available blocks outside of the blocks. MemoryPoolManager
+/// links available blocks through the blocks themselves, so every block is at least the size of a pointer, which wastes
+/// most of the memory of pools of 1, 2 or 4 byte types. Here, every page instead keeps a stack of the indices of its
+/// available blocks, stored as Index values in front of the blocks, and blocks are packed sizeof(T) bytes apart. Each
+/// block costs sizeof(T) + sizeof(Index) bytes, and writing to a freed block can't corrupt the list of available
+/// blocks.
+///
+/// A page can hold at most as many blocks as Index can count, so 65536 with the default 16-bit indices. Pages with
+/// available blocks are kept in a list, and blocks are allocated from the first page in it until it runs out. Blocks of
+/// a page are handed out in address order the first time, and are only pushed on the page's stack once freed. Freeing
+/// a block looks up its page, first checking the page of the last freed block and otherwise searching the pages by
+/// address, so freeing is logarithmic in the number of pages in the worst case. Pages are only released when the
+/// manager is cleared.
+///
+/// This is a separate manager rather than a mode of MemoryPoolManager, since every feature of MemoryPoolManager
+/// (canaries, lazy carving, per-page free lists, trimming, the encoded free list and the quarantine) links available
+/// blocks through the blocks themselves.
+template <class T, class PageSource = MallocPageSource, class Index = uint16_t>
+class CompactPoolManager {
+    static_assert(std::is_integral<Index>::value && std::is_unsigned<Index>::value,
+                  "The index type of a CompactPoolManager must be an unsigned integer type.");
+    
+private:
+    /// Data at the start of each page of memory, followed by the stack of indices of the page's available blocks, and
+    /// then by the blocks.
+    struct Page {
+        T* blocks;
+        
+        /// Number of blocks handed out at least once, which are the first blocks of the page, and the number of
+        /// indices on the stack.
+        unsigned int carvedCount;
+        unsigned int availableCount;
+        
+        /// Next page in the list of pages with available blocks, and whether the page is in that list.
+        Page* nextAvailable;
+        bool listed;
+    };
+    
+    const unsigned int _blocksPerPage;
+    
+    /// All allocated pages, sorted by the address of their blocks, and the address of the first block of each of them
+    /// in the same order, kept apart so that searching them reads as little memory as possible.
+    std::vector<Page*> _pages;
+    std::vector<const T*> _pageBlocks;
+    
+    /// List of pages that have available blocks. Blocks are allocated from the first page in the list.
+    Page* _availablePages;
+    
+    /// Page of the last freed block, which is checked first when freeing a block.
+    Page* _lastFreedPage;
+    
+    unsigned int _blocksRemaining;
+    
+    
+    /// Returns the stack of indices of available blocks of the given page.
+    /// @param page The page to get the stack of.
+    static Index* pageStack(Page* page) {
+        return reinterpret_cast<Index*>(page + 1);
+    }
+    
+    /// Returns the number of bytes to allocate for a page. Page sources only guarantee a pointer's alignment, so there
+    /// is room to align the blocks.
+    size_t pageAllocationSize() {
+        return sizeof(Page) + sizeof(Index) * static_cast<size_t>(_blocksPerPage) + alignof(T) - 1
+            + sizeof(T) * static_cast<size_t>(_blocksPerPage);
+    }
+    
+    /// Returns true if the given block is within the blocks of the given page.
+    /// @param page The page to check.
+    /// @param block The block to look for.
+    bool containsBlock(const Page* page, const T* block) {
+        return block >= page->blocks && block < page->blocks + _blocksPerPage;
+    }
+    
+    /// Returns the page containing the given block, or null if the block is not in any page.
+    /// @param block The block to find the page of.
+    Page* findPage(const T* block) {
+        if (_pages.empty()) {
+            return nullptr;
+        }
+        
+        // the page with the highest block address that is still at or before the given block is the only page that
+        // could contain it. The search halves the range without branching on the comparisons, since frees of random
+        // blocks would mispredict about half of them.
+        const T* const* first = _pageBlocks.data();
+        size_t count = _pageBlocks.size();
+        while (count > 1) {
+            const size_t half = count / 2;
+            first = first[half] <= block ? first + half : first;
+            count -= half;
+        }
+        Page* page = _pages[static_cast<size_t>(first - _pageBlocks.data())];
+        return containsBlock(page, block) ? page : nullptr;
+    }
+    
+    /// Allocates a new page of memory, adds it to the sorted list of pages, and puts it first in the list of pages with
+    /// available blocks.
+    void allocatePage() {
+        char* memory = reinterpret_cast<char*>(PageSource::allocatePage(pageAllocationSize()));
+        Page* page = reinterpret_cast<Page*>(memory);
+        uintptr_t blocks = reinterpret_cast<uintptr_t>(pageStack(page) + _blocksPerPage);
+        blocks = (blocks + alignof(T) - 1) / alignof(T) * alignof(T);
+        page->blocks = reinterpret_cast<T*>(blocks);
+        page->carvedCount = 0;
+        page->availableCount = 0;
+        page->nextAvailable = _availablePages;
+        page->listed = true;
+        _availablePages = page;
+        auto position = std::upper_bound(_pageBlocks.begin(), _pageBlocks.end(), page->blocks);
+        _pages.insert(_pages.begin() + (position - _pageBlocks.begin()), page);
+        _pageBlocks.insert(position, page->blocks);
+        _blocksRemaining += _blocksPerPage;
+    }
+    
+public:
+    /// Constructor.
+    /// @param blocksPerPage Number of individual blocks of size T for each allocated page of memory. If this is zero,
+    ///     or more than Index can count, then an exception will be thrown.
+    CompactPoolManager(const unsigned int blocksPerPage)
+    : _blocksPerPage(blocksPerPage)
+    , _availablePages(nullptr)
+    , _lastFreedPage(nullptr)
+    , _blocksRemaining(0) {
+        // check for invalid block count
+        if (blocksPerPage == 0 || blocksPerPage - 1 > std::numeric_limits<Index>::max()) {
+            throw MemoryPoolException(MemoryPoolException::invalidSizeMsg);
+        }
+        
+        // allocate initial page
+        allocatePage();
+    }
+    
+    CompactPoolManager(const CompactPoolManager&) = delete;
+    CompactPoolManager& operator=(const CompactPoolManager&) = delete;
+    
+    /// Destructor
+    ~CompactPoolManager() {
+        clearAllMemory();
+    }
+    
+    const unsigned int getBlocksPerPage() {return _blocksPerPage;}
+    const unsigned int getNumberOfPages() {return static_cast<unsigned int>(_pages.size());}
+    const unsigned int getAvailableBlocksRemaining() {return _blocksRemaining;}
+    
+    
+    /// Returns an available block from one of the memory pages. If there are no more available, then a new page will be
+    /// allocated.
+    T* allocateBlock() {
+        if (!_availablePages) {
+            allocatePage();
+        }
+        
+        // freed blocks are reused first, then blocks that were never handed out
+        Page* page = _availablePages;
+        T* block;
+        if (page->availableCount > 0) {
+            block = page->blocks + pageStack(page)[--page->availableCount];
+        }
+        else {
+            block = page->blocks + page->carvedCount++;
+        }
+        
+        // take the page off the list once it has no more available blocks
+        if (page->availableCount == 0 && page->carvedCount == _blocksPerPage) {
+            _availablePages = page->nextAvailable;
+            page->listed = false;
+        }
+        --_blocksRemaining;
+        return block;
+    }
+    
+    /// Returns an allocated block back to the memory manager pool. Freeing a null pointer does nothing. If the block is
+    /// not at the address of a block in one of the pages, or every block of its page is already available, then an
+    /// exception will be thrown. Other duplicate frees are not detected.
+    /// @param block The block to free up.
+    void freeBlock(T* block) {
+        if (!block) {
+            return;
+        }
+        Page* page = _lastFreedPage;
+        if (!page || !containsBlock(page, block)) {
+            page = findPage(block);
+            if (!page) {
+                throw MemoryPoolException(MemoryPoolException::invalidFreedAddressMsg);
+            }
+            _lastFreedPage = page;
+        }
+        const ptrdiff_t byteOffset = reinterpret_cast<char*>(block) - reinterpret_cast<char*>(page->blocks);
+        if (byteOffset % sizeof(T) != 0) {
+            throw MemoryPoolException(MemoryPoolException::invalidFreedAddressMsg);
+        }
+        const size_t index = static_cast<size_t>(block - page->blocks);
+        if (index >= page->carvedCount || page->availableCount == page->carvedCount) {
+            throw MemoryPoolException(MemoryPoolException::duplicateFreeMsg);
+        }
+        
+        // push the block's index, and put the page back in the list if it had run out
+        pageStack(page)[page->availableCount++] = static_cast<Index>(index);
+        if (!page->listed) {
+            page->nextAvailable = _availablePages;
+            page->listed = true;
+            _availablePages = page;
+        }
+        ++_blocksRemaining;
+    }
+    
+    /// Deallocates all memory page allocations. Any allocated blocks from this memory manager will be invalid.
+    void clearAllMemory() {
+        for (auto i = _pages.begin(); i != _pages.end(); ++i) {
+            PageSource::releasePage(*i, pageAllocationSize());
+        }
+        _pages.clear();
+        _pageBlocks.clear();
+        _availablePages = nullptr;
+        _lastFreedPage = nullptr;
+        _blocksRemaining = 0;
+    }
+};
+
+#endif /* CompactPoolManager_h */
@@ -0,0 +1,243 @@
+//
+//  ConcurrentMemoryPoolManager.h
+//  Exercise: Memory Manager
+//
+
+#ifndef ConcurrentMemoryPoolManager_h
+#define ConcurrentMemoryPoolManager_h
+
+#include "MemoryPoolManager.h"
+#include "PageSources.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/// Thread safe front end for MemoryPoolManager. Each thread keeps a small private cache of blocks (a magazine) so that
+/// most allocations and frees never touch shared memory. Only when a thread's magazines are exhausted or overflowing
+/// does it trade a whole magazine of blocks with the shared central pool, which is guarded by a mutex.
+template <class T, class PageSource = MallocPageSource>
+class ConcurrentMemoryPoolManager {
+private:
+    /// Structure for building a linked list of cached blocks. Blocks from the underlying pool are always big enough to
+    /// hold a pointer.
+    struct Link {
+        Link* next;
+    };
+    
+    /// A stack of blocks linked through the blocks themselves.
+    struct Magazine {
+        Link* blocks;
+        unsigned int count;
+    };
+    
+    /// Shared state between all threads using the pool. Threads only hold weak references to it, so a thread that
+    /// outlives the pool will never touch freed pages.
+    struct Central {
+        Central(const unsigned int blocksPerPage)
+        : pool(blocksPerPage) {}
+        
+        std::mutex lock;
+        MemoryPoolManager<T, PageSource> pool;
+        
+        /// Full magazines that have been traded back by threads, each holding exactly magazineSize blocks.
+        std::vector<Link*> fullMagazines;
+    };
+    
+    /// Per thread cache entry for a single pool.
+    struct ThreadEntry {
+        std::weak_ptr<Central> central;
+        uint64_t poolId;
+        Magazine loaded;
+        Magazine previous;
+    };
+    
+    /// All cache entries for the current thread. When the thread exits, any cached blocks are handed back to pools that
+    /// are still alive.
+    struct ThreadCache {
+        ThreadCache()
+        : lastPoolId(0)
+        , last(nullptr) {}
+        
+        ~ThreadCache() {
+            for (auto i = entries.begin(); i != entries.end(); ++i) {
+                std::shared_ptr<Central> central = (*i)->central.lock();
+                if (central) {
+                    returnMagazine(*central, (*i)->loaded);
+                    returnMagazine(*central, (*i)->previous);
+                }
+            }
+        }
+        
+        uint64_t lastPoolId;
+        ThreadEntry* last;
+        std::vector<std::unique_ptr<ThreadEntry>> entries;
+    };
+    
+    const unsigned int _magazineSize;
+    const uint64_t _poolId;
+    std::shared_ptr<Central> _central;
+    
+    
+    /// Returns a unique, never reused identifier for a pool instance.
+    static uint64_t nextPoolId() {
+        static std::atomic<uint64_t> counter(0);
+        return ++counter;
+    }
+    
+    /// Returns the cache for the current thread.
+    static ThreadCache& threadCache() {
+        thread_local ThreadCache cache;
+        return cache;
+    }
+    
+    /// Hands all blocks in the given magazine back to the central pool.
+    /// @param central The central pool to return the blocks to.
+    /// @param magazine The magazine to empty.
+    static void returnMagazine(Central& central, Magazine& magazine) {
+        std::lock_guard<std::mutex> guard(central.lock);
+        Link* block = magazine.blocks;
+        while (block) {
+            Link* next = block->next;
+            central.pool.freeBlock(reinterpret_cast<T*>(block));
+            block = next;
+        }
+        magazine.blocks = nullptr;
+        magazine.count = 0;
+    }
+    
+    /// Returns the cache entry of this pool for the current thread, creating it if needed.
+    ThreadEntry& threadEntry() {
+        ThreadCache& cache = threadCache();
+        if (cache.lastPoolId == _poolId) {
+            return *cache.last;
+        }
+        
+        // search for an existing entry, dropping any entries for pools that no longer exist along the way
+        ThreadEntry* found = nullptr;
+        for (auto i = cache.entries.begin(); i != cache.entries.end();) {
+            if ((*i)->poolId == _poolId) {
+                found = i->get();
+                ++i;
+            }
+            else if ((*i)->central.expired()) {
+                i = cache.entries.erase(i);
+            }
+            else {
+                ++i;
+            }
+        }
+        if (!found) {
+            found = new ThreadEntry{_central, _poolId, {nullptr, 0}, {nullptr, 0}};
+            cache.entries.emplace_back(found);
+        }
+        
+        cache.lastPoolId = _poolId;
+        cache.last = found;
+        return *found;
+    }
+    
+    /// Fills the given empty magazine with a full magazine from the central pool.
+    /// @param magazine The magazine to fill.
+    void loadFullMagazine(Magazine& magazine) {
+        std::lock_guard<std::mutex> guard(_central->lock);
+        if (!_central->fullMagazines.empty()) {
+            magazine.blocks = _central->fullMagazines.back();
+            _central->fullMagazines.pop_back();
+        }
+        else {
+            // no traded magazines available, so build one from the underlying pool
+            Link* blocks = nullptr;
+            for (unsigned int i = 0; i < _magazineSize; ++i) {
+                Link* block = reinterpret_cast<Link*>(_central->pool.allocateBlock());
+                block->next = blocks;
+                blocks = block;
+            }
+            magazine.blocks = blocks;
+        }
+        magazine.count = _magazineSize;
+    }
+    
+    /// Hands a full magazine over to the central pool.
+    /// @param magazine The full magazine to give up. It will be empty afterwards.
+    void storeFullMagazine(Magazine& magazine) {
+        {
+            std::lock_guard<std::mutex> guard(_central->lock);
+            _central->fullMagazines.push_back(magazine.blocks);
+        }
+        magazine.blocks = nullptr;
+        magazine.count = 0;
+    }
+    
+public:
+    /// Constructor.
+    /// @param blocksPerPage Number of individual blocks of size T for each allocated page of memory. If this is zero,
+    ///     then an exception will be thrown.
+    /// @param magazineSize Number of blocks each thread caches and trades with the central pool at a time. If this is
+    ///     zero, then an exception will be thrown.
+    ConcurrentMemoryPoolManager(const unsigned int blocksPerPage, const unsigned int magazineSize = 64)
+    : _magazineSize(magazineSize)
+    , _poolId(nextPoolId())
+    , _central(std::make_shared<Central>(blocksPerPage)) {
+        if (_magazineSize == 0) {
+            throw MemoryPoolException(MemoryPoolException::invalidSizeMsg);
+        }
+    }
+    
+    ConcurrentMemoryPoolManager(const ConcurrentMemoryPoolManager&) = delete;
+    ConcurrentMemoryPoolManager& operator=(const ConcurrentMemoryPoolManager&) = delete;
+    
+    const unsigned int getMagazineSize() {return _magazineSize;}
+    const unsigned int getBlocksPerPage() {return _central->pool.getBlocksPerPage();}
+    const size_t getNumberOfPages() {
+        std::lock_guard<std::mutex> guard(_central->lock);
+        return _central->pool.getNumberOfPages();
+    }
+    
+    
+    /// Returns an available block. Blocks are taken from the current thread's cache, and the central pool is only
+    /// accessed when that cache is empty. Safe to call from any thread.
+    T* allocateBlock() {
+        ThreadEntry& entry = threadEntry();
+        Magazine& loaded = entry.loaded;
+        if (loaded.count == 0) {
+            if (entry.previous.count > 0) {
+                std::swap(loaded, entry.previous);
+            }
+            else {
+                loadFullMagazine(loaded);
+            }
+        }
+        
+        // pop block
+        Link* block = loaded.blocks;
+        loaded.blocks = block->next;
+        --loaded.count;
+        return reinterpret_cast<T*>(block);
+    }
+    
+    /// Returns an allocated block back to the pool. The block is cached by the current thread, and full magazines are
+    /// handed to the central pool. Blocks may be freed from a different thread than the one that allocated them.
+    /// @param block The block to free up.
+    void freeBlock(T* block) {
+        if (block) {
+            ThreadEntry& entry = threadEntry();
+            Magazine& loaded = entry.loaded;
+            if (loaded.count == _magazineSize) {
+                if (entry.previous.count > 0) {
+                    storeFullMagazine(entry.previous);
+                }
+                std::swap(loaded, entry.previous);
+            }
+            
+            // push block
+            Link* blockLink = reinterpret_cast<Link*>(block);
+            blockLink->next = loaded.blocks;
+            loaded.blocks = blockLink;
+            ++loaded.count;
+        }
+    }
+};
+
+#endif /* ConcurrentMemoryPoolManager_h */
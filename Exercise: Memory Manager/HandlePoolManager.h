@@ -0,0 +1,247 @@
+//
+//  HandlePoolManager.h
+//  Exercise: Memory Manager
+//
+
+#ifndef HandlePoolManager_h
+#define HandlePoolManager_h
+
+#include "MemoryPoolManager.h"
+#include "PageSources.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+/// Compact reference to a block in a HandlePoolManager, made of the block's slot index and the generation of the slot
+/// when the block was allocated. A default constructed handle is null and never resolves to a block.
+struct PoolHandle {
+    uint32_t index = 0;
+    uint32_t generation = 0;
+    
+    bool isNull() const {return generation == 0;}
+    bool operator==(const PoolHandle& other) const {return index == other.index && generation == other.generation;}
+    bool operator!=(const PoolHandle& other) const {return !(*this == other);}
+};
+
+/// Memory Manager that hands out handles instead of pointers. Every block has a slot holding a generation number that
+/// changes each time the block is freed, so resolving a handle to a freed block is detected in constant time instead
+/// of reading freed memory. The list of available slots is kept in the slot data, apart from the blocks, so writing
+/// through a stale pointer can't corrupt it either.
+///
+/// Slots are grouped in pages whose number of blocks is rounded up to a power of two, so finding the page and block of
+/// a handle is a shift and a mask. Pages are only released when the manager is cleared, so resolved pointers stay
+/// valid until their handle is freed.
+template <class T, class PageSource = MallocPageSource>
+class HandlePoolManager {
+private:
+    /// Data kept for every block, separately from the block itself.
+    struct Slot {
+        /// Generation of the block. Odd while the block is allocated, and even while it is available.
+        uint32_t generation;
+        /// Index of the next available slot, while the block is available.
+        uint32_t nextAvailable;
+    };
+    
+    /// Index that marks the end of the list of available slots.
+    const static uint32_t noSlot = std::numeric_limits<uint32_t>::max();
+    
+    const unsigned int _blocksPerPage;
+    const unsigned int _pageShift;
+    const uint32_t _pageMask;
+    
+    /// Slots and blocks of each page. Each page allocation starts with its slots, followed by its blocks.
+    std::vector<Slot*> _pageSlots;
+    std::vector<T*> _pageBlocks;
+    
+    /// First slot in the list of slots freed and available for reuse.
+    uint32_t _availableSlots;
+    
+    /// Number of slots handed out so far. Slots at and after this index have never been used.
+    uint32_t _usedSlots;
+    
+    /// Even generation that slots start from when they are first used. It moves past every generation handed out
+    /// when the manager is cleared, so handles from before the clear never match the new blocks in their slots.
+    uint32_t _freshGeneration;
+    
+    unsigned int _blocksRemaining;
+    
+    
+    /// Returns the smallest power of two that is at least the given count.
+    static unsigned int roundUpToPowerOfTwo(const unsigned int count) {
+        unsigned int power = 1;
+        while (power < count && power < (1u << 31)) {
+            power <<= 1;
+        }
+        return power;
+    }
+    
+    /// Returns the base two logarithm of the given power of two.
+    static unsigned int log2(unsigned int power) {
+        unsigned int shift = 0;
+        while (power > 1) {
+            power >>= 1;
+            ++shift;
+        }
+        return shift;
+    }
+    
+    /// Returns the offset of the blocks from the start of a page allocation, before aligning them.
+    size_t slotsSize() {
+        return sizeof(Slot) * static_cast<size_t>(_blocksPerPage);
+    }
+    
+    /// Returns the number of bytes to allocate for a page. Page sources only guarantee a pointer's alignment, so there
+    /// is room to align the blocks.
+    size_t pageAllocationSize() {
+        return slotsSize() + alignof(T) - 1 + sizeof(T) * static_cast<size_t>(_blocksPerPage);
+    }
+    
+    /// Allocates a new page of slots and blocks.
+    void allocatePage() {
+        if (static_cast<uint64_t>(_pageSlots.size() + 1) * _blocksPerPage > noSlot) {
+            throw MemoryPoolException(MemoryPoolException::invalidSizeMsg);
+        }
+        char* page = reinterpret_cast<char*>(PageSource::allocatePage(pageAllocationSize()));
+        uintptr_t blocks = reinterpret_cast<uintptr_t>(page) + slotsSize();
+        blocks = (blocks + alignof(T) - 1) / alignof(T) * alignof(T);
+        _pageSlots.push_back(reinterpret_cast<Slot*>(page));
+        _pageBlocks.push_back(reinterpret_cast<T*>(blocks));
+        _blocksRemaining += _blocksPerPage;
+    }
+    
+    /// Returns the slot with the given index.
+    Slot& slot(const uint32_t index) {
+        return _pageSlots[index >> _pageShift][index & _pageMask];
+    }
+    
+    /// Returns the slot of the given handle if the handle refers to an allocated block, or null otherwise.
+    Slot* liveSlot(const PoolHandle handle) {
+        if (handle.index >= _usedSlots) {
+            return nullptr;
+        }
+        Slot& handleSlot = slot(handle.index);
+        return handleSlot.generation == handle.generation && (handle.generation & 1) ? &handleSlot : nullptr;
+    }
+    
+public:
+    /// Constructor.
+    /// @param blocksPerPage Number of individual blocks of size T for each allocated page of memory, rounded up to a
+    ///     power of two. If this is zero, then an exception will be thrown.
+    HandlePoolManager(const unsigned int blocksPerPage)
+    : _blocksPerPage(roundUpToPowerOfTwo(blocksPerPage))
+    , _pageShift(log2(_blocksPerPage))
+    , _pageMask(_blocksPerPage - 1)
+    , _availableSlots(noSlot)
+    , _usedSlots(0)
+    , _freshGeneration(0)
+    , _blocksRemaining(0) {
+        // check for invalid block count
+        if (blocksPerPage == 0 || blocksPerPage > (1u << 31)) {
+            throw MemoryPoolException(MemoryPoolException::invalidSizeMsg);
+        }
+        
+        // allocate initial page
+        allocatePage();
+    }
+    
+    HandlePoolManager(const HandlePoolManager&) = delete;
+    HandlePoolManager& operator=(const HandlePoolManager&) = delete;
+    
+    /// Destructor
+    ~HandlePoolManager() {
+        clearAllMemory();
+    }
+    
+    const unsigned int getBlocksPerPage() {return _blocksPerPage;}
+    const unsigned int getNumberOfPages() {return static_cast<unsigned int>(_pageSlots.size());}
+    const unsigned int getAvailableBlocksRemaining() {return _blocksRemaining;}
+    
+    
+    /// Allocates a block and returns a handle to it. Freed slots are reused first, and a new page is allocated if all
+    /// slots are in use.
+    PoolHandle allocateHandle() {
+        uint32_t index;
+        if (_availableSlots != noSlot) {
+            index = _availableSlots;
+            _availableSlots = slot(index).nextAvailable;
+        }
+        else {
+            if (_usedSlots == _pageSlots.size() * _blocksPerPage) {
+                allocatePage();
+            }
+            index = _usedSlots++;
+            slot(index).generation = _freshGeneration;
+        }
+        
+        // an odd generation marks the block as allocated
+        Slot& allocatedSlot = slot(index);
+        ++allocatedSlot.generation;
+        --_blocksRemaining;
+        
+        PoolHandle handle;
+        handle.index = index;
+        handle.generation = allocatedSlot.generation;
+        return handle;
+    }
+    
+    /// Returns the block of the given handle, or null if the handle is null, has been freed, or doesn't belong to this
+    /// manager. The pointer stays valid until the handle is freed.
+    /// @param handle The handle to resolve.
+    T* resolve(const PoolHandle handle) {
+        if (!liveSlot(handle)) {
+            return nullptr;
+        }
+        return _pageBlocks[handle.index >> _pageShift] + (handle.index & _pageMask);
+    }
+    
+    /// Returns true if the given handle refers to an allocated block.
+    /// @param handle The handle to check.
+    bool isValid(const PoolHandle handle) {
+        return liveSlot(handle) != nullptr;
+    }
+    
+    /// Returns the block of the given handle back to the pool. Any copies of the handle will no longer resolve. Freeing
+    /// a null handle does nothing, and freeing a handle that has already been freed or doesn't belong to this manager
+    /// throws an exception.
+    /// @param handle The handle to free.
+    void freeHandle(const PoolHandle handle) {
+        if (handle.isNull()) {
+            return;
+        }
+        Slot* freedSlot = liveSlot(handle);
+        if (!freedSlot) {
+            throw MemoryPoolException(MemoryPoolException::staleHandleMsg);
+        }
+        
+        // an even generation marks the block as available, skipping zero so it never matches a null handle
+        if (++freedSlot->generation == 0) {
+            freedSlot->generation = 2;
+        }
+        freedSlot->nextAvailable = _availableSlots;
+        _availableSlots = handle.index;
+        ++_blocksRemaining;
+    }
+    
+    /// Deallocates all memory page allocations. Any handles and resolved pointers from this manager will be invalid.
+    void clearAllMemory() {
+        // the next slots start past the newest generation of any slot, rounded up to an even one
+        uint32_t newestGeneration = _freshGeneration;
+        for (uint32_t index = 0; index < _usedSlots; ++index) {
+            newestGeneration = std::max(newestGeneration, slot(index).generation);
+        }
+        _freshGeneration = (newestGeneration + 1) & ~uint32_t(1);
+        
+        for (auto i = _pageSlots.begin(); i != _pageSlots.end(); ++i) {
+            PageSource::releasePage(*i, pageAllocationSize());
+        }
+        _pageSlots.clear();
+        _pageBlocks.clear();
+        _availableSlots = noSlot;
+        _usedSlots = 0;
+        _blocksRemaining = 0;
+    }
+};
+
+#endif /* HandlePoolManager_h */
@@ -0,0 +1,245 @@
+//
+//  LockFreeMemoryPoolManager.h
+//  Exercise: Memory Manager
+//
+
+#ifndef LockFreeMemoryPoolManager_h
+#define LockFreeMemoryPoolManager_h
+
+#include "MemoryPoolManager.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+/// Thread safe Memory Manager whose list of available blocks is a lock-free stack. Unlike ConcurrentMemoryPoolManager,
+/// no per-thread state is kept, so it suits pools that are hit by many short-lived threads.
+///
+/// The head of the available block list is a single 64-bit word holding both the block pointer and a version tag that
+/// is incremented on every change, so a thread that was preempted between reading the head and swapping it can't
+/// mistake a block that was popped and pushed back in the meantime for an unchanged list (the ABA problem). Pages are
+/// added without a lock: a thread that finds the list empty allocates a page, links its blocks privately, and splices
+/// them onto the list with a single compare and swap.
+///
+/// On 64-bit platforms, the head word assumes that user space addresses fit in 48 bits, which leaves 19 bits for the
+/// tag. A thread would have to be preempted while 2^19 other changes are made to the list for the tag to wrap around
+/// to the value it read. Pages outside the low 48 bits of address space, such as with 5-level paging on Linux when the
+/// process asks for high addresses, can't be stored in the head word, so allocating one throws std::bad_alloc instead.
+template <class T>
+class LockFreeMemoryPoolManager {
+private:
+    /// Structure for building a linked list of memory pages or blocks. The next pointer of a block can be read by a
+    /// thread that is about to lose a race for it, so it is accessed atomically.
+    struct Link {
+        std::atomic<Link*> next;
+    };
+    
+    /// Number of low bits of a block address that are always zero, since blocks are aligned to at least a pointer.
+    static const unsigned alignmentBits = sizeof(void*) == 8 ? 3 : 2;
+    /// Number of bits of an address that the head word can hold. User space addresses on 64-bit platforms fit in 48
+    /// bits, and every page is checked against this when it is allocated.
+    static const unsigned addressBits = sizeof(void*) == 8 ? 48 : 32;
+    /// Number of bits of the head word used to store the block address, and the rest are used for the tag.
+    static const unsigned pointerBits = addressBits - alignmentBits;
+    static const uint64_t pointerMask = (uint64_t(1) << pointerBits) - 1;
+    static_assert(64 - pointerBits >= 16, "The tag of the list head needs enough bits to make ABA unlikely.");
+    
+    const unsigned int _blocksPerPage;
+    const unsigned int _blockSize;
+    
+    /// Linked list of all allocated pages of memory. Pages are only ever pushed onto it while the manager is in use.
+    std::atomic<Link*> _memoryPages;
+    
+    /// Tagged head of the linked list of all available blocks.
+    std::atomic<uint64_t> _availableBlocks;
+    
+    std::atomic<size_t> _numberOfPages;
+    std::atomic<size_t> _blocksRemaining;
+    
+    
+    /// Packs a block pointer and version tag into a head word.
+    static uint64_t packHead(Link* block, const uint64_t tag) {
+        return (static_cast<uint64_t>(reinterpret_cast<uintptr_t>(block)) >> alignmentBits)
+            | (tag << pointerBits);
+    }
+    
+    /// Returns the block pointer stored in a head word.
+    static Link* headBlock(const uint64_t head) {
+        return reinterpret_cast<Link*>(static_cast<uintptr_t>((head & pointerMask) << alignmentBits));
+    }
+    
+    /// Returns the version tag stored in a head word.
+    static uint64_t headTag(const uint64_t head) {
+        return head >> pointerBits;
+    }
+    
+    /// Returns the alignment of every block, which is at least the alignment of T and of a pointer.
+    static size_t blockAlignment() {
+        return std::max(alignof(T), alignof(Link));
+    }
+    
+    /// Rounds the given size up to a multiple of the block alignment.
+    static size_t alignUp(const size_t size) {
+        return (size + blockAlignment() - 1) / blockAlignment() * blockAlignment();
+    }
+    
+    /// Rounds the block size up so that every block is aligned.
+    static unsigned int alignedBlockSize() {
+        return static_cast<unsigned int>(alignUp(std::max(sizeof(T), sizeof(Link))));
+    }
+    
+    /// Pushes an already linked chain of blocks onto the list of available blocks.
+    /// @param first The first block in the chain.
+    /// @param last The last block in the chain. Its next pointer will be overwritten.
+    void pushBlocks(Link* first, Link* last) {
+        uint64_t head = _availableBlocks.load(std::memory_order_relaxed);
+        do {
+            last->next.store(headBlock(head), std::memory_order_relaxed);
+        } while (!_availableBlocks.compare_exchange_weak(head, packHead(first, headTag(head) + 1),
+                                                         std::memory_order_release,
+                                                         std::memory_order_relaxed));
+    }
+    
+    /// Pops a block from the list of available blocks. Returns null if the list is empty.
+    Link* popBlock() {
+        uint64_t head = _availableBlocks.load(std::memory_order_acquire);
+        Link* block;
+        while ((block = headBlock(head))) {
+            // if another thread takes this block first, the value read here may be garbage, but the tag will have
+            // changed and the swap below will fail
+            Link* next = block->next.load(std::memory_order_relaxed);
+            if (_availableBlocks.compare_exchange_weak(head, packHead(next, headTag(head) + 1),
+                                                       std::memory_order_acquire,
+                                                       std::memory_order_acquire)) {
+                return block;
+            }
+        }
+        return nullptr;
+    }
+    
+    /// Allocates a new page of memory, adds it to the page list, and adds all but one of its blocks to the list of
+    /// available blocks. The remaining block is returned to the caller, so a thread that grows the pool is always
+    /// guaranteed a block from it.
+    Link* allocatePage() {
+        // malloc only guarantees a pointer's alignment, so leave room to align the first block
+        const size_t pageSize = sizeof(Link) + blockAlignment() - 1 + static_cast<size_t>(_blockSize) * _blocksPerPage;
+        Link* page = reinterpret_cast<Link*>(malloc(pageSize));
+        if (!page) {
+            throw std::bad_alloc();
+        }
+        if (static_cast<uint64_t>(reinterpret_cast<uintptr_t>(page) + pageSize - 1) >> addressBits != 0) {
+            // the blocks can't be stored in the head word
+            free(page);
+            throw std::bad_alloc();
+        }
+        
+        // link up the blocks privately before publishing any of them
+        char* pos = reinterpret_cast<char*>(alignUp(reinterpret_cast<uintptr_t>(page) + sizeof(Link)));
+        Link* first = reinterpret_cast<Link*>(pos);
+        Link* block = first;
+        for (unsigned int i = 1; i < _blocksPerPage; ++i) {
+            Link* next = reinterpret_cast<Link*>(pos + static_cast<size_t>(_blockSize) * i);
+            new (&block->next) std::atomic<Link*>(next);
+            block = next;
+        }
+        new (&block->next) std::atomic<Link*>(nullptr);
+        
+        // add page to list
+        new (&page->next) std::atomic<Link*>(_memoryPages.load(std::memory_order_relaxed));
+        Link* expectedPage = page->next.load(std::memory_order_relaxed);
+        while (!_memoryPages.compare_exchange_weak(expectedPage, page, std::memory_order_release,
+                                                   std::memory_order_relaxed)) {
+            page->next.store(expectedPage, std::memory_order_relaxed);
+        }
+        
+        // update values
+        _numberOfPages.fetch_add(1, std::memory_order_relaxed);
+        _blocksRemaining.fetch_add(_blocksPerPage - 1, std::memory_order_relaxed);
+        
+        // keep the first block and publish the rest
+        if (first != block) {
+            pushBlocks(first->next.load(std::memory_order_relaxed), block);
+        }
+        return first;
+    }
+    
+public:
+    /// Constructor.
+    /// @param blocksPerPage Number of individual blocks of size T for each allocated page of memory. If this is zero,
+    ///     then an exception will be thrown.
+    LockFreeMemoryPoolManager(const unsigned int blocksPerPage)
+    : _blocksPerPage(blocksPerPage)
+    , _blockSize(alignedBlockSize())
+    , _memoryPages(nullptr)
+    , _availableBlocks(0)
+    , _numberOfPages(0)
+    , _blocksRemaining(0) {
+        static_assert(sizeof(void*) <= sizeof(uint64_t), "Block pointers must fit in the tagged list head.");
+        
+        // check for invalid block count
+        if (_blocksPerPage == 0) {
+            throw MemoryPoolException(MemoryPoolException::invalidSizeMsg);
+        }
+        
+        // allocate initial page and return its reserved block to the list
+        _blocksRemaining.fetch_add(1, std::memory_order_relaxed);
+        Link* block = allocatePage();
+        pushBlocks(block, block);
+    }
+    
+    LockFreeMemoryPoolManager(const LockFreeMemoryPoolManager&) = delete;
+    LockFreeMemoryPoolManager& operator=(const LockFreeMemoryPoolManager&) = delete;
+    
+    /// Destructor
+    ~LockFreeMemoryPoolManager() {
+        clearAllMemory();
+    }
+    
+    const unsigned int getBlocksPerPage() {return _blocksPerPage;}
+    const size_t getNumberOfPages() {return _numberOfPages.load(std::memory_order_relaxed);}
+    const size_t getAvailableBlocksRemaining() {return _blocksRemaining.load(std::memory_order_relaxed);}
+    
+    
+    /// Returns an available block from one of the memory pages. If there are no more available, then a new page will be
+    /// allocated. Safe to call from any thread.
+    T* allocateBlock() {
+        Link* block = popBlock();
+        if (block) {
+            _blocksRemaining.fetch_sub(1, std::memory_order_relaxed);
+        }
+        else {
+            block = allocatePage();
+        }
+        return reinterpret_cast<T*>(block);
+    }
+    
+    /// Returns an allocated block back to the memory manager pool. Safe to call from any thread.
+    /// @param block The block to free up.
+    void freeBlock(T* block) {
+        if (block) {
+            // count the block before publishing it so the count never drops below zero
+            _blocksRemaining.fetch_add(1, std::memory_order_relaxed);
+            Link* blockLink = reinterpret_cast<Link*>(block);
+            pushBlocks(blockLink, blockLink);
+        }
+    }
+    
+    /// Deallocates all memory page allocations. Any allocated blocks from this memory manage will be invalid. This is
+    /// not safe to call while other threads are using the manager.
+    void clearAllMemory() {
+        Link* pList = _memoryPages.load(std::memory_order_acquire);
+        Link* pageToDealloc;
+        while (pList) {
+            pageToDealloc = pList;
+            pList = pList->next.load(std::memory_order_relaxed);
+            free(pageToDealloc);
+        }
+        _memoryPages.store(nullptr);
+        _availableBlocks.store(0);
+        _numberOfPages.store(0);
+        _blocksRemaining.store(0);
+    }
+};
+
+#endif /* LockFreeMemoryPoolManager_h */
@@ -22,3 +22,5 @@ const char* MemoryPoolException::invalidSizeMsg = "Invalid block size for Fixed
 const char* MemoryPoolException::invalidFreedAddressMsg = "Invalid address location for the freed block.";
 const char* MemoryPoolException::memoryCorruptionMsg = "Memory corruption has been detected.";
 const char* MemoryPoolException::duplicateFreeMsg = "Memory Block has already been freed.";
+const char* MemoryPoolException::staleHandleMsg = "Handle has already been freed or is invalid.";
+const char* MemoryPoolException::useAfterFreeMsg = "A freed block has been written to.";
@@ -9,22 +9,52 @@
 #ifndef MemoryPoolManager_h
 #define MemoryPoolManager_h
 
+#include "MemoryPoolPolicies.h"
+#include "PageSources.h"
 #include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <exception>
 #include <algorithm>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <new>
+#include <random>
+#include <type_traits>
+#include <vector>
+
+template <class T, class PageSource = MallocPageSource, class Validation = DefaultValidationPolicy,
+          class Threading = SingleThreaded, class Stats = NoStats, class Modes = PoolModes<>,
+          unsigned int BlocksPerPage = 0>
+class MemoryPoolManager;
 
 /// Exception class for exceptions thrown in the memory manager.
 class MemoryPoolException : public std::exception {
     
 private:
-    template <class T>
+    template <class T, class PageSource, class Validation, class Threading, class Stats, class Modes,
+              unsigned int BlocksPerPage>
     friend class MemoryPoolManager;
+    template <class T, class PageSource>
+    friend class ConcurrentMemoryPoolManager;
+    template <class T, class PageSource>
+    friend class PerCpuMemoryPoolManager;
+    template <class T>
+    friend class LockFreeMemoryPoolManager;
+    template <class T, class PageSource>
+    friend class HandlePoolManager;
+    template <class T, class PageSource, class Index>
+    friend class CompactPoolManager;
     
     // Exception strings
     static const char* invalidSizeMsg;
     static const char* invalidFreedAddressMsg;
     static const char* memoryCorruptionMsg;
     static const char* duplicateFreeMsg;
+    static const char* staleHandleMsg;
+    static const char* useAfterFreeMsg;
     
     const char* _msg;
 public:
@@ -33,102 +63,981 @@ public:
 };
 
 
-/// Memory Manager for managing blocks of memory for a templated type.
-template <class T>
-class MemoryPoolManager {
+/// Optional settings for a Memory Manager.
+struct MemoryPoolOptions {
+    /// Only used with the AutoTrim mode. Number of empty pages kept when trimming automatically.
+    unsigned int maxEmptyPages = 0;
+    
+    /// Number of available blocks that maintain() keeps ready, by growing the pool ahead of time so that allocations
+    /// don't have to. If this is zero, then maintain() does nothing.
+    size_t lowWatermark = 0;
+    
+    /// If true, every block is aligned to and padded out to a whole number of cache lines, so that blocks written by
+    /// different threads never share a cache line.
+    bool cacheLineAligned = false;
+    
+    /// Only used with the GrowingPages mode, and must be left at its default otherwise, or an exception will be thrown.
+    /// Each new page has this many times the number of blocks of the page allocated before it, up to maxBlocksPerPage,
+    /// so pools can start out small and still need only a few page allocations to grow large. A factor of 1 keeps
+    /// every page at the number of blocks given to the constructor. If this is zero, then an exception will be thrown.
+    unsigned int pageGrowthFactor = 1;
+    
+    /// Only used with the GrowingPages mode, like pageGrowthFactor. Largest number of blocks in a page when growing.
+    /// Zero means there is no limit.
+    unsigned int maxBlocksPerPage = 0;
+    
+    /// Only used with the GrowingPages mode, like pageGrowthFactor. If set, this is called to choose the number of
+    /// blocks for each new page instead of using pageGrowthFactor. It is passed the number of pages allocated so far
+    /// and the number of blocks in the last page allocated. If it returns zero, then an exception will be thrown.
+    std::function<unsigned int(size_t numberOfPages, unsigned int lastBlocksPerPage)> pageGrowthPolicy;
+    
+    /// Only used with the HardenedValidation policy. One in this many frees, chosen at random, checks the canaries
+    /// around the freed block, so corruption is still caught in a long running program at a fraction of the cost of
+    /// checking every free. A value of 1 checks every free. If this is zero, then an exception will be thrown.
+    unsigned int validationInterval = 64;
+    
+    /// Only used with the HardenedValidation policy. If true, the pointer to the next available block kept in each
+    /// available block is XOR-encoded with a random key for the pool, so a write through a dangling pointer can't
+    /// redirect the list to an address of the writer's choosing. A decoded pointer that isn't aligned like a block
+    /// throws an exception.
+    bool encodeFreeList = false;
+    
+    /// Only used with the DebugValidation policy. Number of freed blocks held in a FIFO quarantine before they can be
+    /// allocated again, so a block isn't handed out again right after it is freed. Zero makes freed blocks available
+    /// right away.
+    unsigned int quarantineSize = 256;
+    
+    /// Only used with the DebugValidation policy. If true, freed blocks are filled with a poison pattern that is
+    /// checked when they leave the quarantine and again when they are allocated, and an exception is thrown if
+    /// anything wrote to a block after it was freed. Blocks of new pages are poisoned as well.
+    bool poisonFreedBlocks = true;
+    
+    /// If not zero, the pool reserves this many bytes of contiguous address space up front, with no memory behind it,
+    /// and commits its pages inside the range as it grows instead of getting them from the page source. Every page then
+    /// sits in a fixed size slot, so the page of a freed block is found with a shift instead of a search, and the pool
+    /// can grow well past 4 GiB on 64-bit platforms. Pages can't grow, so this can't be used with the GrowingPages
+    /// mode, or an exception will be thrown. If the range runs out of room for another page, or address space can't be
+    /// reserved on this platform, then std::bad_alloc will be thrown.
+    size_t reservedAddressSpace = 0;
+};
+
+
+/// Structure for building a linked list of blocks of a MemoryPoolManager.
+struct MemoryPoolLink {
+    MemoryPoolLink* next;
+};
+
+/// Data at the start of each page of memory of a MemoryPoolManager. Pages can differ in size when the pool grows, so
+/// each one records its own number of blocks.
+template <bool PreferFullestPage>
+struct MemoryPoolPage {
+    MemoryPoolPage* next;
+    unsigned int blockCount;
+};
+
+/// Page data with the PreferFullestPage mode, which adds the number of available blocks in the page, including blocks
+/// not carved off yet, the occupancy list the page is in, the page's own list of available blocks, and the neighbours
+/// of the page in its occupancy list.
+template <>
+struct MemoryPoolPage<true> {
+    MemoryPoolPage* next;
+    unsigned int blockCount;
+    unsigned int availableCount;
+    unsigned int occupancyList;
+    MemoryPoolLink* availableBlocks;
+    MemoryPoolPage* previousInList;
+    MemoryPoolPage* nextInList;
+};
+
+// Data that a MemoryPoolManager only has with some policies and modes. Each is a base class of the manager that is
+// empty when its feature is not used, so a pool carries no data for features it doesn't have.
+
+/// All allocated pages, keyed by the address of their first block. Used when occupancy is tracked or with the
+/// PreferFullestPage mode, to find the page a block belongs to in logarithmic time, and to visit pages in address
+/// order.
+template <class Page, bool IndexesPages>
+struct MemoryPoolPageIndex {};
+
+template <class Page>
+struct MemoryPoolPageIndex<Page, true> {
+    std::map<const char*, Page*> _pageIndex;
+};
+
+/// Ring of freed blocks held back from being reused, oldest first starting at the next slot, and whether freed blocks
+/// are poisoned. Empty slots are null. Only used when the validation policy quarantines freed blocks.
+template <bool Quarantines>
+struct MemoryPoolQuarantine {
+    explicit MemoryPoolQuarantine(const MemoryPoolOptions&) {}
+};
+
+template <>
+struct MemoryPoolQuarantine<true> {
+    std::vector<MemoryPoolLink*> _quarantine;
+    size_t _quarantineNext;
+    const bool _poisonFreedBlocks;
+    
+    explicit MemoryPoolQuarantine(const MemoryPoolOptions& options)
+    : _quarantine(options.quarantineSize, nullptr)
+    , _quarantineNext(0)
+    , _poisonFreedBlocks(options.poisonFreedBlocks) {}
+};
+
+/// Page growth settings. The maximum is the largest unsigned value when there is no limit. Only used with the
+/// GrowingPages mode.
+template <bool GrowingPages>
+struct MemoryPoolPageGrowth {
+    MemoryPoolPageGrowth(const unsigned int, const MemoryPoolOptions&) {}
+};
+
+template <>
+struct MemoryPoolPageGrowth<true> {
+    const unsigned int _pageGrowthFactor;
+    const unsigned int _maxBlocksPerPage;
+    const std::function<unsigned int(size_t, unsigned int)> _pageGrowthPolicy;
+    
+    MemoryPoolPageGrowth(const unsigned int blocksPerPage, const MemoryPoolOptions& options)
+    : _pageGrowthFactor(options.pageGrowthFactor)
+    , _maxBlocksPerPage(options.maxBlocksPerPage == 0 ? std::numeric_limits<unsigned int>::max()
+                                                      : std::max(options.maxBlocksPerPage, blocksPerPage))
+    , _pageGrowthPolicy(options.pageGrowthPolicy) {}
+};
+
+/// Position of the next block to carve off the newest page, and the end of the carvable blocks in that page. Pages
+/// that reset left to be carved after the newest page are chained through their next pointers to the end of the list
+/// of pages, along with the number of blocks in them. Only used with the LazyPageCarving mode.
+template <class Page, bool LazyPageCarving>
+struct MemoryPoolCarving {};
+
+template <class Page>
+struct MemoryPoolCarving<Page, true> {
+    char* _carvePosition = nullptr;
+    char* _carveEnd = nullptr;
+    Page* _uncarvedPages = nullptr;
+    size_t _uncarvedPageBlocks = 0;
+};
+
+/// Number of empty pages kept when trimming automatically, and the number of remaining blocks above which the next
+/// automatic trim happens. Only used with the AutoTrim mode.
+template <bool AutoTrim>
+struct MemoryPoolAutoTrim {
+    MemoryPoolAutoTrim(const unsigned int, const MemoryPoolOptions&) {}
+};
+
+template <>
+struct MemoryPoolAutoTrim<true> {
+    const unsigned int _maxEmptyPages;
+    size_t _autoTrimThreshold;
+    
+    MemoryPoolAutoTrim(const unsigned int blocksPerPage, const MemoryPoolOptions& options)
+    : _maxEmptyPages(options.maxEmptyPages)
+    , _autoTrimThreshold(static_cast<size_t>(options.maxEmptyPages + 1) * blocksPerPage) {}
+};
+
+/// Page that blocks are allocated from until it runs out, and lists of the other pages with available blocks by how
+/// full they are, with the fullest pages in the first list. Each bit of the mask is set while its list is not empty.
+/// Only used with the PreferFullestPage mode.
+template <class Page, bool PreferFullestPage>
+struct MemoryPoolOccupancyLists {};
+
+template <class Page>
+struct MemoryPoolOccupancyLists<Page, true> {
+    /// Number of occupancy lists for pages that are partly allocated. The list after them holds empty pages, and the
+    /// values after that mark pages that aren't in any list, or that are being released.
+    const static unsigned int occupancyClasses = 8;
+    const static unsigned int emptyPageList = occupancyClasses;
+    const static unsigned int unlisted = occupancyClasses + 1;
+    const static unsigned int releasing = occupancyClasses + 2;
+    
+    Page* _currentPage = nullptr;
+    Page* _occupancyLists[occupancyClasses + 1] = {};
+    unsigned int _occupancyMask = 0;
+};
+
+
+/// Memory Manager for managing blocks of memory for a templated type. Pages of memory are allocated and released
+/// through the PageSource class, which is malloc by default (see PageSources.h).
+///
+/// Validation, threading and stats are policies chosen at compile time, and so are the modes of the pool, given as a
+/// PoolModes (see MemoryPoolPolicies.h). If BlocksPerPage is not zero, then every page has that many blocks and the
+/// page layout is a compile time constant.
+template <class T, class PageSource, class Validation, class Threading, class Stats, class Modes,
+          unsigned int BlocksPerPage>
+class MemoryPoolManager
+    : private Threading
+    , private Stats
+    , private MemoryPoolPageIndex<MemoryPoolPage<Modes::preferFullestPage>,
+                                  Validation::tracksOccupancy || Modes::preferFullestPage>
+    , private MemoryPoolQuarantine<Validation::quarantines>
+    , private MemoryPoolPageGrowth<Modes::growingPages>
+    , private MemoryPoolCarving<MemoryPoolPage<Modes::preferFullestPage>, Modes::lazyPageCarving>
+    , private MemoryPoolAutoTrim<Modes::autoTrim>
+    , private MemoryPoolOccupancyLists<MemoryPoolPage<Modes::preferFullestPage>, Modes::preferFullestPage> {
 private:
-    // Padding type (and set data size) between blocks
-    typedef uint16_t padding;
+    static_assert(!Modes::growingPages || BlocksPerPage == 0,
+                  "Pages can't grow when their number of blocks is a constant.");
     
-    /// Data pattern for padding between blocks. Used for memory corruption checking.
-    const static uint16_t paddingSignature = 0xBEEF;
+    // Padding type (and set data size) between blocks, which holds a canary
+    typedef uint64_t padding;
     
-    /// Structure for building a linked list of memory pages or blocks
-    struct Link {
-        Link* next;
-    };
+    /// True if blocks are surrounded by canaries, which the validation policy checks for memory corruption.
+    static constexpr bool hasCanaries = Validation::enabled || Validation::hardened;
+    
+    /// Size of a cache line, used for cache line aligned blocks.
+#if defined(__APPLE__) && defined(__aarch64__)
+    const static unsigned int cacheLineSize = 128;
+#else
+    const static unsigned int cacheLineSize = 64;
+#endif
+    
+    typedef MemoryPoolLink Link;
+    typedef MemoryPoolPage<Modes::preferFullestPage> Page;
+    typedef MemoryPoolOccupancyLists<Page, Modes::preferFullestPage> OccupancyLists;
+    
+    /// True if the page index is kept, which is needed to find the page of a block.
+    static constexpr bool indexesPages = Validation::tracksOccupancy || Modes::preferFullestPage;
+    
+    /// Byte that freed blocks are filled with when they are poisoned.
+    const static unsigned char poisonByte = 0xDD;
     
     const unsigned int _blocksPerPage;
     const unsigned int _blockSize;
     
+    /// Alignment of every block, which is at least the alignment of T, and the distance in bytes from the start of one
+    /// block to the start of the next. With validations enabled, the padding after each block is included.
+    const unsigned int _blockAlignment;
+    const unsigned int _blockStride;
+    
     /// Linked list of all allocated pages of memory
-    Link* _memoryPages;
+    Page* _memoryPages;
     
     // Linked list of all available blocks in all pages of memory
     Link* _availableBlocks;
     
-    unsigned int _numberOfPages;
-    unsigned int _blocksRemaining;
+    size_t _numberOfPages;
+    size_t _blocksRemaining;
+    
+    /// Number of blocks in the next page to be allocated, which only changes with the GrowingPages mode.
+    unsigned int _nextPageBlocks;
+    
+    /// Number of available blocks that maintain() keeps ready.
+    const size_t _lowWatermark;
+    
+    /// Number of available blocks in a page, used while trimming.
+    struct PageUsage {
+        char* pageStart;
+        Page* page;
+        unsigned int availableBlocks;
+        bool release;
+    };
+    
+    /// Random value for the pool that canaries are made from, the key that encodes the free list, or zero when it isn't
+    /// encoded, and the number of frees left before the next one whose canaries are checked. Only used when the
+    /// validation policy uses canaries or is hardened.
+    const uint64_t _canarySecret;
+    const uintptr_t _freeListKey;
+    const unsigned int _validationInterval;
+    unsigned int _validationCountdown;
+    uint64_t _samplingState;
+    
+    /// Range of address space reserved for all pages, or null when pages come from the page source. Each page is
+    /// committed in a slot of a power of two bytes, so the slot of an address is found with a shift. Each slot holds
+    /// its page, or null if nothing is committed there, and slots emptied by trimming are reused first.
+    char* _reservation;
+    size_t _reservationSize;
+    unsigned int _slotShift;
+    std::vector<Page*> _slots;
+    std::vector<size_t> _freeSlots;
+    
+    
+    /// Number of 64-bit words in a page's occupancy bitmap. The bitmap follows the page's data and has one bit per
+    /// block, which is set while the block is allocated.
+    /// @param blockCount Number of blocks in the page.
+    static unsigned int bitmapWordCount(const unsigned int blockCount) {
+        return (blockCount + 63) / 64;
+    }
+    
+    /// Returns the occupancy bitmap of the given page.
+    /// @param page The page to get the bitmap for.
+    uint64_t* pageBitmap(Page* page) {
+        return reinterpret_cast<uint64_t*>(reinterpret_cast<char*>(page) + sizeof(Page));
+    }
+    
+    /// Returns the page containing the given block, or null if the block is before every page. Only used when pages are
+    /// indexed.
+    /// @param block The block to find the page of.
+    Page* findPage(const char* block) {
+        if (_reservation) {
+            return reservedPage(block);
+        }
+        auto pageEntry = this->_pageIndex.upper_bound(block);
+        return pageEntry == this->_pageIndex.begin() ? nullptr : std::prev(pageEntry)->second;
+    }
+    
+    /// Returns the page committed in the slot of reserved address space holding the given address, or null if the
+    /// address is outside the reservation or nothing is committed in its slot. Only used with reserved address space.
+    /// @param address The address to find the page of.
+    Page* reservedPage(const char* address) {
+        const uintptr_t offset = reinterpret_cast<uintptr_t>(address) - reinterpret_cast<uintptr_t>(_reservation);
+        const size_t slot = static_cast<size_t>(offset >> _slotShift);
+        return slot < _slots.size() ? _slots[slot] : nullptr;
+    }
+    
+    /// Returns the number of blocks in the given page, which is a constant if BlocksPerPage is set.
+    /// @param page The page to get the number of blocks of.
+    static unsigned int pageBlockCount(const Page* page) {
+        if constexpr (BlocksPerPage != 0) {
+            return BlocksPerPage;
+        }
+        else {
+            return page->blockCount;
+        }
+    }
+    
+    /// Returns the number of bytes at the start of a page used for page data, before any blocks or padding.
+    /// @param blockCount Number of blocks in the page.
+    static unsigned int pageHeaderSize(const unsigned int blockCount) {
+        if constexpr (Validation::tracksOccupancy) {
+            return sizeof(Page) + bitmapWordCount(blockCount) * sizeof(uint64_t);
+        }
+        else {
+            return sizeof(Page);
+        }
+    }
+    
+    /// Rounds the given size up to a multiple of the given power of two.
+    static size_t roundUp(const size_t size, const size_t multiple) {
+        return (size + multiple - 1) & ~(multiple - 1);
+    }
+    
+    /// Returns the alignment of blocks for the given options.
+    static unsigned int blockAlignment(const MemoryPoolOptions& options) {
+        size_t alignment = std::max(alignof(T), alignof(Link));
+        if (options.cacheLineAligned) {
+            alignment = std::max<size_t>(alignment, cacheLineSize);
+        }
+        return static_cast<unsigned int>(alignment);
+    }
+    
+    /// Returns the distance in bytes from the start of one block to the start of the next for the given block size and
+    /// alignment.
+    static unsigned int blockStride(const unsigned int blockSize, const unsigned int alignment) {
+        if constexpr (hasCanaries) {
+            return static_cast<unsigned int>(roundUp(blockSize + sizeof(padding), alignment));
+        }
+        else {
+            return static_cast<unsigned int>(roundUp(blockSize, alignment));
+        }
+    }
+    
+    /// Returns the number of blocks that have not been carved off yet, in the newest page and in pages left to carve by
+    /// reset.
+    size_t uncarvedBlockCount() {
+        return static_cast<size_t>((this->_carveEnd - this->_carvePosition) / _blockStride) + this->_uncarvedPageBlocks;
+    }
+    
+    
+    /// Returns the number of bytes to allocate for a page with the given number of blocks. Page sources only guarantee
+    /// a pointer's alignment, so there is room to align the first block.
+    /// @param blockCount Number of blocks in the page.
+    size_t pageAllocationSize(const unsigned int blockCount) {
+        size_t size = pageHeaderSize(blockCount) + (_blockAlignment - 1);
+        size += static_cast<size_t>(_blockStride) * blockCount;
+        if constexpr (hasCanaries) {
+            size += sizeof(padding);
+        }
+        return size;
+    }
+    
+    /// Returns the address of the first block in the given page, which is the first aligned address after the page
+    /// data and, with validations enabled, the padding before the block.
+    /// @param page The page to get the first block of.
+    char* firstBlock(Page* page) {
+        uintptr_t pos = reinterpret_cast<uintptr_t>(page) + pageHeaderSize(pageBlockCount(page));
+        if constexpr (hasCanaries) {
+            pos += sizeof(padding);
+        }
+        return reinterpret_cast<char*>(roundUp(pos, _blockAlignment));
+    }
+    
+    /// Returns the number of blocks for the page to allocate after one with the given number of blocks.
+    /// @param blockCount Number of blocks in the last page allocated.
+    unsigned int nextPageBlockCount(const unsigned int blockCount) {
+        if constexpr (Modes::growingPages) {
+            if (this->_pageGrowthPolicy) {
+                unsigned int nextBlockCount = this->_pageGrowthPolicy(_numberOfPages, blockCount);
+                if (nextBlockCount == 0) {
+                    throw MemoryPoolException(MemoryPoolException::invalidSizeMsg);
+                }
+                return nextBlockCount;
+            }
+            uint64_t nextBlockCount = static_cast<uint64_t>(blockCount) * this->_pageGrowthFactor;
+            return static_cast<unsigned int>(std::min<uint64_t>(nextBlockCount, this->_maxBlocksPerPage));
+        }
+        else {
+            return blockCount;
+        }
+    }
+    
+    /// Returns the number of bytes committed for each page when address space is reserved, which is the size of a page
+    /// rounded up to whole system pages.
+    size_t committedPageSize() {
+        return roundUp(pageAllocationSize(_blocksPerPage), AddressSpace::systemPageSize());
+    }
     
+    /// Reserves the address space for all pages, in slots of the smallest power of two that fits a committed page.
+    /// @param size Number of bytes to reserve, rounded down to whole slots.
+    void reserveAddressSpace(const size_t size) {
+        _slotShift = 0;
+        while ((size_t(1) << _slotShift) < committedPageSize()) {
+            ++_slotShift;
+        }
+        _reservationSize = size & ~((size_t(1) << _slotShift) - 1);
+        if (_reservationSize == 0) {
+            throw MemoryPoolException(MemoryPoolException::invalidSizeMsg);
+        }
+        _reservation = AddressSpace::reserve(_reservationSize);
+        if (!_reservation) {
+            throw std::bad_alloc();
+        }
+    }
+    
+    /// Commits a page in the first free slot of the reserved address space, reusing slots emptied by trimming before
+    /// new ones. Throws std::bad_alloc if the reservation is full.
+    Page* commitReservedPage() {
+        const bool reuseSlot = !_freeSlots.empty();
+        const size_t slot = reuseSlot ? _freeSlots.back() : _slots.size();
+        if (((slot + 1) << _slotShift) > _reservationSize) {
+            throw std::bad_alloc();
+        }
+        char* memory = _reservation + (slot << _slotShift);
+        if (!AddressSpace::commit(memory, committedPageSize())) {
+            throw std::bad_alloc();
+        }
+        
+        Page* page = reinterpret_cast<Page*>(memory);
+        if (reuseSlot) {
+            _freeSlots.pop_back();
+            _slots[slot] = page;
+        }
+        else {
+            _slots.push_back(page);
+        }
+        return page;
+    }
+    
+    /// Gives a page back to the page source, or decommits its slot when address space is reserved.
+    /// @param page The page to release, which must already be unlinked from the list of pages.
+    void releasePage(Page* page) {
+        if (_reservation) {
+            const size_t slot = static_cast<size_t>(reinterpret_cast<char*>(page) - _reservation) >> _slotShift;
+            AddressSpace::decommit(reinterpret_cast<char*>(page), committedPageSize());
+            _slots[slot] = nullptr;
+            _freeSlots.push_back(slot);
+        }
+        else {
+            PageSource::releasePage(page, pageAllocationSize(pageBlockCount(page)));
+        }
+    }
     
     /// Allocates a new page of memory, adds it to the page linked list, and sets up all the blocks in the page.
     void allocatePage() {
-        unsigned pageAllocationSize = sizeof(Link) + _blockSize * _blocksPerPage;
-#ifdef VALIDATIONS_ENABLED
-        pageAllocationSize += sizeof(padding) * (_blocksPerPage + 1);
-#endif
+        const unsigned int blockCount = _nextPageBlocks;
+        typename Stats::PageTimer timer(*this, blockCount);
+        
         // allocate page and add to list
-        Link* page = reinterpret_cast<Link*>(malloc(pageAllocationSize));
+        Page* page = _reservation ? commitReservedPage()
+                                  : reinterpret_cast<Page*>(PageSource::allocatePage(pageAllocationSize(blockCount)));
         page->next = _memoryPages;
+        page->blockCount = blockCount;
         _memoryPages = page;
         
-        // setup blocks
-        Link* block;
-        char* pos = reinterpret_cast<char*>(page) + sizeof(Link); // position pointer past page linked list data
-        for (int i = 0; i < _blocksPerPage; ++i) {
-#ifdef VALIDATIONS_ENABLED
-            // set padding signature
-            *reinterpret_cast<padding*>(pos) = paddingSignature;
-            pos += sizeof(padding);
-#endif
-            
-            // add block to list
-            block = reinterpret_cast<Link*>(pos);
-            block->next = _availableBlocks;
-            _availableBlocks = block;
-            pos += _blockSize;
-        }
+        char* pos = firstBlock(page);
         
-#ifdef VALIDATIONS_ENABLED
-        // set padding signature at the end
-        *reinterpret_cast<padding*>(pos) = paddingSignature;
-#endif
+        if constexpr (Validation::tracksOccupancy) {
+            // no blocks are allocated yet
+            memset(pageBitmap(page), 0, bitmapWordCount(blockCount) * sizeof(uint64_t));
+        }
+        if constexpr (indexesPages) {
+            this->_pageIndex[pos] = page;
+        }
         
         // update values
         ++_numberOfPages;
-        _blocksRemaining += _blocksPerPage;
+        _blocksRemaining += blockCount;
+        if constexpr (Modes::growingPages) {
+            _nextPageBlocks = nextPageBlockCount(blockCount);
+        }
+        Stats::onPageAllocated(blockCount);
+        
+        // when the fullest page is preferred, the page's blocks go on its own list and the page starts out empty
+        Link** availableBlocks = &_availableBlocks;
+        if constexpr (Modes::preferFullestPage) {
+            page->availableCount = blockCount;
+            page->availableBlocks = nullptr;
+            listPage(page, OccupancyLists::emptyPageList);
+            availableBlocks = &page->availableBlocks;
+        }
+        
+        if constexpr (Modes::lazyPageCarving) {
+            // blocks are set up as they are carved off
+            startCarving(page);
+        }
+        else {
+            linkPageBlocks(page, availableBlocks);
+        }
     }
     
-#ifdef VALIDATIONS_ENABLED
-    /// Checks if given block to be freed is at a valid memory address of where a block should be on any of the
-    /// allocated pages. Will thrown an exception if it is not valid.
-    /// @param blockToFree The block of memory to validate against.
-    void validateBlockLocation(char* blockToFree) {
-        Link* page = _memoryPages;
-        unsigned fullBlockSize = _blockSize + sizeof(padding);
-        std::ptrdiff_t blockDistance;
-        char* blockStartPosition;
-        bool foundValidLocation = false;
-        
-        // iterate through each page and check if the given block address is positioned where a block *should* be
-        while (!foundValidLocation && page) {
-            // the address location of the first block on a page is after the next page link pointer and the first
-            // few bytes of data signature padding
-            blockStartPosition = reinterpret_cast<char*>(page) + sizeof(Link) + sizeof(padding);
+    /// Sets up all the blocks of a page and links them in address order, so that blocks are handed out from the start
+    /// of the page, in front of the given list.
+    /// @param page The page to set up.
+    /// @param availableBlocks The list to add the page's blocks to.
+    void linkPageBlocks(Page* page, Link** availableBlocks) {
+        const unsigned int blockCount = pageBlockCount(page);
+        char* pos = firstBlock(page);
+        Link* firstLink = reinterpret_cast<Link*>(pos);
+        for (unsigned int i = 0; i < blockCount; ++i) {
+            if constexpr (hasCanaries) {
+                setPaddingSignatures(pos);
+            }
+            if constexpr (Validation::quarantines) {
+                if (this->_poisonFreedBlocks) {
+                    poisonBlock(pos);
+                }
+            }
             
-            // calculate the difference between the given block location and the location of the first block in the page
-            // if the difference is positive or zero, and is divisible by the size of a block plus the size of the
-            // padding after it, then the given block pointer is at the correct location
-            blockDistance = blockToFree - blockStartPosition;
-            foundValidLocation = blockDistance >= 0
-                && blockDistance / fullBlockSize < _blocksPerPage
-                && blockDistance % fullBlockSize == 0;
-            
-            // go to next page of memory
-            page = page->next;
+            // add block to list, linked to the block after it, or to the blocks already available after the last one
+            Link* block = reinterpret_cast<Link*>(pos);
+            pos += _blockStride;
+            setNext(block, i + 1 < blockCount ? reinterpret_cast<Link*>(pos) : *availableBlocks);
+        }
+        *availableBlocks = firstLink;
+    }
+    
+    /// Makes the given page the one that fresh blocks are carved off. Only used with lazy page carving.
+    void startCarving(Page* page) {
+        this->_carvePosition = firstBlock(page);
+        this->_carveEnd = this->_carvePosition + static_cast<size_t>(_blockStride) * pageBlockCount(page);
+    }
+    
+    /// Links the blocks of every page left to carve by reset into the available blocks, along with those of the newest
+    /// page. Only used with lazy page carving.
+    void carveAllBlocks() {
+        carveRemainingBlocks();
+        while (this->_uncarvedPages) {
+            this->_uncarvedPageBlocks -= pageBlockCount(this->_uncarvedPages);
+            startCarving(this->_uncarvedPages);
+            this->_uncarvedPages = this->_uncarvedPages->next;
+            carveRemainingBlocks();
+        }
+    }
+    
+    /// Returns the usage entry of the page containing the given address.
+    /// @param usages Usage entries for all pages, sorted by page address.
+    /// @param address An address within one of the pages.
+    static PageUsage& findPageUsage(std::vector<PageUsage>& usages, const void* address) {
+        auto next = std::upper_bound(usages.begin(), usages.end(), reinterpret_cast<const char*>(address),
+                                     [](const char* a, const PageUsage& usage) { return a < usage.pageStart; });
+        return *std::prev(next);
+    }
+    
+    /// Trims down to the configured number of empty pages once enough blocks have been freed since the last automatic
+    /// trim for there to be more empty pages than that, at the current page size. Only used with the AutoTrim mode.
+    void autoTrim() {
+        trim(this->_maxEmptyPages);
+        uint64_t threshold = _blocksRemaining + static_cast<uint64_t>(this->_maxEmptyPages + 1) * _nextPageBlocks;
+        this->_autoTrimThreshold = static_cast<size_t>(std::min<uint64_t>(threshold,
+                                                                          std::numeric_limits<size_t>::max()));
+    }
+    
+    /// Adds a page to the front of the given occupancy list, or marks it as unlisted.
+    /// @param page A page that isn't in any list.
+    /// @param list The list to add the page to.
+    void listPage(Page* page, const unsigned int list) {
+        page->occupancyList = list;
+        if (list == OccupancyLists::unlisted) {
+            return;
+        }
+        page->previousInList = nullptr;
+        page->nextInList = this->_occupancyLists[list];
+        if (page->nextInList) {
+            page->nextInList->previousInList = page;
+        }
+        this->_occupancyLists[list] = page;
+        this->_occupancyMask |= 1u << list;
+    }
+    
+    /// Removes a page from the occupancy list it is in, if any.
+    void unlistPage(Page* page) {
+        if (page->occupancyList == OccupancyLists::unlisted) {
+            return;
+        }
+        if (page->previousInList) {
+            page->previousInList->nextInList = page->nextInList;
+        }
+        else {
+            this->_occupancyLists[page->occupancyList] = page->nextInList;
+            if (!page->nextInList) {
+                this->_occupancyMask &= ~(1u << page->occupancyList);
+            }
+        }
+        if (page->nextInList) {
+            page->nextInList->previousInList = page->previousInList;
+        }
+        page->occupancyList = OccupancyLists::unlisted;
+    }
+    
+    /// Empties every occupancy list and forgets the current page, without changing any page.
+    void clearOccupancyLists() {
+        this->_currentPage = nullptr;
+        std::fill(std::begin(this->_occupancyLists), std::end(this->_occupancyLists), nullptr);
+        this->_occupancyMask = 0;
+    }
+    
+    /// Returns the occupancy list for a page that isn't the current page, based on its number of available blocks.
+    /// Full pages are not in any list, since nothing can be allocated from them.
+    unsigned int occupancyListFor(const Page* page) {
+        const unsigned int blockCount = pageBlockCount(page);
+        if (page->availableCount == 0) {
+            return OccupancyLists::unlisted;
+        }
+        if (page->availableCount == blockCount) {
+            return OccupancyLists::emptyPageList;
+        }
+        return static_cast<unsigned int>(static_cast<uint64_t>(page->availableCount) * OccupancyLists::occupancyClasses
+                                         / blockCount);
+    }
+    
+    /// Takes a block from the current page. If the current page has run out, the fullest page with available blocks
+    /// becomes the current page, allocating a new page first if no page has any. Only used when the fullest page is
+    /// preferred. Does not update the remaining block count.
+    Link* allocateFromFullestPage() {
+        Page* page = this->_currentPage;
+        if (!page || page->availableCount == 0) {
+            if (!this->_occupancyMask) {
+                allocatePage();
+            }
+            page = this->_occupancyLists[__builtin_ctz(this->_occupancyMask)];
+            unlistPage(page);
+            this->_currentPage = page;
+        }
+        
+        --page->availableCount;
+        Link* block = page->availableBlocks;
+        if constexpr (Modes::lazyPageCarving) {
+            // only the newest page can have blocks that haven't been carved off yet
+            if (!block) {
+                return carveBlock();
+            }
+        }
+        page->availableBlocks = nextOf(block);
+        return block;
+    }
+    
+    /// Pushes a freed block onto the list of its page and moves the page to the occupancy list matching its new number
+    /// of available blocks. Only used when the fullest page is preferred.
+    void returnBlockToPage(Link* block) {
+        Page* page = findPage(reinterpret_cast<const char*>(block));
+        setNext(block, page->availableBlocks);
+        page->availableBlocks = block;
+        ++page->availableCount;
+        if (page != this->_currentPage) {
+            const unsigned int list = occupancyListFor(page);
+            if (list != page->occupancyList) {
+                unlistPage(page);
+                listPage(page, list);
+            }
+        }
+    }
+    
+    /// Releases empty pages when the fullest page is preferred. Empty pages are already kept in their own list, so
+    /// unlike trim this doesn't need to walk the available blocks.
+    /// @param maxEmptyPages Number of empty pages to keep for reuse.
+    /// @return The number of pages released.
+    size_t trimEmptyPages(const unsigned int maxEmptyPages) {
+        // put the current page back in the lists so that it is released too if it is empty
+        if (this->_currentPage) {
+            listPage(this->_currentPage, occupancyListFor(this->_currentPage));
+            this->_currentPage = nullptr;
+        }
+        
+        // keep the first pages in the list of empty pages and mark the rest
+        Page* page = this->_occupancyLists[OccupancyLists::emptyPageList];
+        for (unsigned int i = 0; page && i < maxEmptyPages; ++i) {
+            page = page->nextInList;
+        }
+        size_t releasedPages = 0;
+        while (page) {
+            Page* nextPage = page->nextInList;
+            unlistPage(page);
+            page->occupancyList = OccupancyLists::releasing;
+            ++releasedPages;
+            page = nextPage;
+        }
+        if (releasedPages == 0) {
+            return 0;
+        }
+        
+        // unlink and deallocate the marked pages
+        Page** pageTail = &_memoryPages;
+        page = _memoryPages;
+        while (page) {
+            Page* nextPage = page->next;
+            if (page->occupancyList == OccupancyLists::releasing) {
+                char* blocks = firstBlock(page);
+                if constexpr (Modes::lazyPageCarving) {
+                    if (this->_carveEnd == blocks + static_cast<size_t>(_blockStride) * pageBlockCount(page)) {
+                        this->_carvePosition = this->_carveEnd = nullptr;
+                    }
+                }
+                this->_pageIndex.erase(blocks);
+                _blocksRemaining -= pageBlockCount(page);
+                Stats::onPageReleased(pageBlockCount(page));
+                releasePage(page);
+            }
+            else {
+                *pageTail = page;
+                pageTail = &page->next;
+            }
+            page = nextPage;
+        }
+        *pageTail = nullptr;
+        _numberOfPages -= releasedPages;
+        return releasedPages;
+    }
+    
+    /// Carves the next fresh block off the newest page, moving on to the next page left by reset or allocating a new
+    /// page first if the newest page has no blocks left to carve. Only used with lazy page carving. Does not update the
+    /// remaining block count.
+    Link* carveBlock() {
+        if (this->_carvePosition == this->_carveEnd) {
+            if (this->_uncarvedPages) {
+                // pages left by reset are carved before growing the pool
+                this->_uncarvedPageBlocks -= pageBlockCount(this->_uncarvedPages);
+                startCarving(this->_uncarvedPages);
+                this->_uncarvedPages = this->_uncarvedPages->next;
+            }
+            else {
+                allocatePage();
+            }
         }
         
-        if (!foundValidLocation) {
+        char* pos = this->_carvePosition;
+        this->_carvePosition += _blockStride;
+        if constexpr (hasCanaries) {
+            setPaddingSignatures(pos);
+        }
+        if constexpr (Validation::quarantines) {
+            if (this->_poisonFreedBlocks) {
+                poisonBlock(pos);
+            }
+        }
+        return reinterpret_cast<Link*>(pos);
+    }
+    
+    /// Links the blocks of the newest page that haven't been carved off yet into the available blocks, in address
+    /// order, so that another page can be allocated without losing them. Only used with lazy page carving.
+    void carveRemainingBlocks() {
+        if (this->_carvePosition == this->_carveEnd) {
+            return;
+        }
+        Link** availableBlocks = &_availableBlocks;
+        if constexpr (Modes::preferFullestPage) {
+            availableBlocks = &findPage(this->_carvePosition)->availableBlocks;
+        }
+        Link* first = carveBlock();
+        Link* last = first;
+        while (this->_carvePosition != this->_carveEnd) {
+            Link* block = carveBlock();
+            setNext(last, block);
+            last = block;
+        }
+        setNext(last, *availableBlocks);
+        *availableBlocks = first;
+    }
+    
+    /// Touches every system page of the newest page, so that the first use of its blocks doesn't page fault.
+    void prefaultNewestPage() {
+        volatile char* memory = reinterpret_cast<volatile char*>(_memoryPages);
+        const size_t size = _reservation ? committedPageSize() : pageAllocationSize(pageBlockCount(_memoryPages));
+        const size_t step = AddressSpace::systemPageSize();
+        for (size_t offset = 0; offset < size; offset += step) {
+            memory[offset] = memory[offset];
+        }
+    }
+    
+    /// Allocates and prefaults pages until at least the given number of blocks are available.
+    /// @param blockCount Number of available blocks to have.
+    /// @return The number of pages allocated.
+    size_t reserveBlocks(const size_t blockCount) {
+        const size_t blocksBefore = _blocksRemaining;
+        size_t allocatedPages = 0;
+        while (_blocksRemaining < blockCount) {
+            if constexpr (Modes::lazyPageCarving) {
+                carveRemainingBlocks();
+            }
+            allocatePage();
+            prefaultNewestPage();
+            ++allocatedPages;
+        }
+        
+        // the reserved blocks don't count towards the next automatic trim
+        if constexpr (Modes::autoTrim) {
+            this->_autoTrimThreshold += _blocksRemaining - blocksBefore;
+        }
+        return allocatedPages;
+    }
+    
+    /// Returns a random value for the secrets of a pool that uses canaries or is hardened, or zero otherwise.
+    static uint64_t randomSecret() {
+        if constexpr (hasCanaries) {
+            std::random_device device;
+            return (static_cast<uint64_t>(device()) << 32 | device()) | 1;
+        }
+        else {
+            return 0;
+        }
+    }
+    
+    /// Returns the canary expected at the given position. Each canary mixes the pool's secret with its own address, so
+    /// canaries differ between pools and between blocks, and one copied from elsewhere doesn't match.
+    /// @param position Address of the padding holding the canary.
+    padding canaryAt(const char* position) {
+        return _canarySecret ^ reinterpret_cast<uintptr_t>(position);
+    }
+    
+    /// Sets the canaries right before and right after the given block. Any alignment gap after the padding that follows
+    /// a block is left alone.
+    /// @param block The block to surround with canaries.
+    void setPaddingSignatures(char* block) {
+        const padding before = canaryAt(block - sizeof(padding));
+        const padding after = canaryAt(block + _blockSize);
+        memcpy(block - sizeof(padding), &before, sizeof(padding));
+        memcpy(block + _blockSize, &after, sizeof(padding));
+    }
+    
+    /// Returns the next block in a list of available blocks, decoding it if the free list is encoded.
+    /// @param link An available block.
+    Link* nextOf(const Link* link) {
+        if constexpr (Validation::hardened) {
+            if (_freeListKey) {
+                const uintptr_t next = reinterpret_cast<uintptr_t>(link->next) ^ _freeListKey
+                    ^ reinterpret_cast<uintptr_t>(link);
+                if (next & (_blockAlignment - 1)) {
+                    throw MemoryPoolException(MemoryPoolException::memoryCorruptionMsg);
+                }
+                return reinterpret_cast<Link*>(next);
+            }
+        }
+        return link->next;
+    }
+    
+    /// Sets the next block in a list of available blocks, encoding it if the free list is encoded. The encoding also
+    /// mixes in the block's own address, so the same pointer is stored differently in every block.
+    /// @param link An available block.
+    /// @param next The block after it in the list, or null.
+    void setNext(Link* link, Link* next) {
+        if constexpr (Validation::hardened) {
+            if (_freeListKey) {
+                link->next = reinterpret_cast<Link*>(reinterpret_cast<uintptr_t>(next) ^ _freeListKey
+                                                     ^ reinterpret_cast<uintptr_t>(link));
+                return;
+            }
+        }
+        link->next = next;
+    }
+    
+    /// Returns the number of frees until the next one whose canaries are checked. The count is random, averaging the
+    /// validation interval, so which frees are checked can't be predicted.
+    unsigned int nextValidationCountdown() {
+        if (_validationInterval <= 1) {
+            return 1;
+        }
+        // xorshift
+        _samplingState ^= _samplingState << 13;
+        _samplingState ^= _samplingState >> 7;
+        _samplingState ^= _samplingState << 17;
+        return 1 + static_cast<unsigned int>(_samplingState % (2 * static_cast<uint64_t>(_validationInterval) - 1));
+    }
+    
+    /// Checks the canaries of the given block if this free is one of the sampled ones. Only used when the validation
+    /// policy is hardened.
+    /// @param blockToFree The block being freed.
+    void validateSampledFree(char* blockToFree) {
+        if (--_validationCountdown == 0) {
+            _validationCountdown = nextValidationCountdown();
+            validateMemoryCorruption(blockToFree);
+        }
+    }
+    
+    /// Finds the bit in the occupancy bitmap of the page the given block is located in. Returns false if the block is
+    /// not at a valid memory address of where a block should be on any of the allocated pages.
+    /// @param block The block of memory to find.
+    /// @param bitmapWord Set to the word of the page's bitmap that holds the block's bit.
+    /// @param bitMask Set to the mask for the block's bit in that word.
+    bool findBlockOccupancy(const char* block, uint64_t*& bitmapWord, uint64_t& bitMask) {
+        Page* page;
+        const char* first;
+        if (_reservation) {
+            // the block's slot holds the only page that could contain it
+            page = reservedPage(block);
+            if (!page) {
+                return false;
+            }
+            first = firstBlock(page);
+        }
+        else {
+            // the page with the highest first block address that is still at or before the given block is the only
+            // page that could contain it
+            auto pageEntry = this->_pageIndex.upper_bound(block);
+            if (pageEntry == this->_pageIndex.begin()) {
+                return false;
+            }
+            pageEntry = std::prev(pageEntry);
+            page = pageEntry->second;
+            first = pageEntry->first;
+        }
+        
+        // if the distance from the first block is divisible by the distance between blocks, then the given block
+        // pointer is at the correct location
+        std::ptrdiff_t blockDistance = block - first;
+        if (blockDistance < 0 || blockDistance / _blockStride >= pageBlockCount(page)
+            || blockDistance % _blockStride != 0) {
+            return false;
+        }
+        
+        std::ptrdiff_t blockIndex = blockDistance / _blockStride;
+        bitmapWord = pageBitmap(page) + blockIndex / 64;
+        bitMask = uint64_t(1) << (blockIndex % 64);
+        return true;
+    }
+    
+    /// Sets the occupancy bit for a block that was just taken from the list of available blocks.
+    /// @param block The allocated block.
+    void markBlockAllocated(const char* block) {
+        uint64_t* bitmapWord;
+        uint64_t bitMask;
+        if (findBlockOccupancy(block, bitmapWord, bitMask)) {
+            *bitmapWord |= bitMask;
+        }
+    }
+    
+    /// Clears the occupancy bit for a block that is being freed without validation.
+    /// @param block The freed block.
+    void markBlockAvailable(const char* block) {
+        uint64_t* bitmapWord;
+        uint64_t bitMask;
+        if (findBlockOccupancy(block, bitmapWord, bitMask)) {
+            *bitmapWord &= ~bitMask;
+        }
+    }
+    
+    /// Checks if given block to be freed is at a valid memory address of where a block should be on any of the
+    /// allocated pages. Will thrown an exception if it is not valid.
+    /// @param blockToFree The block of memory to validate against.
+    /// @param bitmapWord Set to the word of the page's occupancy bitmap that holds the block's bit.
+    /// @param bitMask Set to the mask for the block's bit in that word.
+    void validateBlockLocation(char* blockToFree, uint64_t*& bitmapWord, uint64_t& bitMask) {
+        if (!findBlockOccupancy(blockToFree, bitmapWord, bitMask)) {
             throw MemoryPoolException(MemoryPoolException::invalidFreedAddressMsg);
         }
     }
@@ -137,114 +1046,744 @@ private:
     /// If it doesn't, then this will throw an exception.
     /// @param blockToFree The block of memory to validate against.
     void validateMemoryCorruption(char* blockToFree) {
-        char* pos = blockToFree - sizeof(padding);
-        unsigned int fullBlockSize = _blockSize + sizeof(padding);
-        if (*reinterpret_cast<padding*>(pos) != paddingSignature
-            || *reinterpret_cast<padding*>(pos+fullBlockSize) != paddingSignature) {
+        padding before;
+        padding after;
+        memcpy(&before, blockToFree - sizeof(padding), sizeof(padding));
+        memcpy(&after, blockToFree + _blockSize, sizeof(padding));
+        if (before != canaryAt(blockToFree - sizeof(padding)) || after != canaryAt(blockToFree + _blockSize)) {
             throw MemoryPoolException(MemoryPoolException::memoryCorruptionMsg);
         }
     }
     
-    /// Checks if the given block to be freed is already in the linked list of available blocks. If it is, then this
-    /// means that the block is already freed and cannot be freed again, so this will throw an exception.
-    /// @param blockToFree The block of memory to validate against.
-    void validateMultiFree(char* blockToFree) {
-        Link* block = reinterpret_cast<Link*>(blockToFree);
-        Link* pList = _availableBlocks;
-        while (pList && pList != block) {
-            pList = pList->next;
+    /// Fills the given block with the poison pattern. Only used when freed blocks are poisoned.
+    /// @param block The block to poison.
+    void poisonBlock(char* block) {
+        memset(block, poisonByte, _blockSize);
+    }
+    
+    /// Checks that the given block still holds the poison pattern from the given offset on. If it doesn't, then the
+    /// block was written to after it was freed, and this will throw an exception.
+    /// @param block The block to check.
+    /// @param offset Offset of the first byte to check, which skips the pointer kept in blocks on a list.
+    void validatePoison(const char* block, const size_t offset) {
+        if (offset >= _blockSize) {
+            return;
+        }
+        // every byte matches the first one if the range matches itself shifted by a byte
+        if (static_cast<unsigned char>(block[offset]) != poisonByte
+            || memcmp(block + offset, block + offset + 1, _blockSize - offset - 1) != 0) {
+            throw MemoryPoolException(MemoryPoolException::useAfterFreeMsg);
+        }
+    }
+    
+    /// Checks the poison of a block about to be handed out, if freed blocks are poisoned. A block that fails the check
+    /// counts as allocated but is never handed out or reused.
+    /// @param block The block being allocated.
+    void validateReusedBlock(const Link* block) {
+        if constexpr (Validation::quarantines) {
+            if (this->_poisonFreedBlocks) {
+                validatePoison(reinterpret_cast<const char*>(block), sizeof(Link));
+            }
+        }
+    }
+    
+    /// Poisons the given freed block if freed blocks are poisoned and puts it in the quarantine. Once the quarantine is
+    /// full, the block that has been in it the longest is pushed out and returned, after checking its poison, and it is
+    /// the one that becomes available. Returns null while the quarantine is filling up, or the given block itself if
+    /// there is no quarantine. If the pushed out block fails its check, then it is dropped and never reused.
+    /// @param block The block being freed.
+    Link* quarantineBlock(Link* block) {
+        if (this->_poisonFreedBlocks) {
+            poisonBlock(reinterpret_cast<char*>(block));
+        }
+        if (this->_quarantine.empty()) {
+            return block;
+        }
+        Link* released = this->_quarantine[this->_quarantineNext];
+        this->_quarantine[this->_quarantineNext] = block;
+        this->_quarantineNext = (this->_quarantineNext + 1) % this->_quarantine.size();
+        if (released && this->_poisonFreedBlocks) {
+            validatePoison(reinterpret_cast<char*>(released), 0);
+        }
+        return released;
+    }
+    
+    /// Returns the number of freed blocks waiting in the quarantine.
+    size_t quarantinedBlockCount() {
+        size_t count = 0;
+        if constexpr (Validation::quarantines) {
+            for (Link* block : this->_quarantine) {
+                count += block ? 1 : 0;
+            }
         }
-        if (pList) {
+        return count;
+    }
+    
+    /// Empties the quarantine without making its blocks available.
+    void clearQuarantine() {
+        if constexpr (Validation::quarantines) {
+            std::fill(this->_quarantine.begin(), this->_quarantine.end(), nullptr);
+            this->_quarantineNext = 0;
+        }
+    }
+    
+    /// Checks if the given block to be freed is already marked as available in its page's occupancy bitmap. If it is,
+    /// then this means that the block is already freed and cannot be freed again, so this will throw an exception.
+    /// @param bitmapWord The word of the page's occupancy bitmap that holds the block's bit.
+    /// @param bitMask The mask for the block's bit in that word.
+    void validateMultiFree(const uint64_t* bitmapWord, const uint64_t bitMask) {
+        if (!(*bitmapWord & bitMask)) {
             throw MemoryPoolException(MemoryPoolException::duplicateFreeMsg);
         }
     }
-#endif
+    
+    /// Frees the blocks that other threads have freed since the last collection. Only called by the owner when the
+    /// threading policy collects remote frees, so the blocks are validated and counted as if the owner freed them. If
+    /// freeing one of them throws, then the blocks after it are put back for the next collection before rethrowing.
+    ///
+    /// A block freed twice by other threads links into itself, which makes the list loop, so without validation that
+    /// is undefined behaviour, like any other duplicate free.
+    void collectRemoteFrees() {
+        void* block = Threading::takeRemoteFrees();
+        while (block) {
+            // the block's link is overwritten once it is freed
+            void* next;
+            memcpy(&next, block, sizeof(next));
+            try {
+                freeBlock(reinterpret_cast<T*>(block));
+            }
+            catch (...) {
+                requeueRemoteFrees(next);
+                throw;
+            }
+            block = next;
+        }
+    }
+    
+    /// Puts a run of blocks freed by other threads back on their list, after freeing a block before them failed. If
+    /// the failed block was a duplicate free, then its link was already the owner's, so the run ends at the first block
+    /// that is already available. A run with more blocks than the pool has can only be a loop left by a duplicate
+    /// free, and is dropped instead.
+    /// @param first The first block of the run, or null.
+    void requeueRemoteFrees(void* first) {
+        if (!first || !isRemoteFree(first)) {
+            return;
+        }
+        size_t totalBlocks = 0;
+        for (Page* page = _memoryPages; page; page = page->next) {
+            totalBlocks += pageBlockCount(page);
+        }
+        void* last = first;
+        for (size_t count = 1;; ++count) {
+            void* next;
+            memcpy(&next, last, sizeof(next));
+            if (!next || !isRemoteFree(next)) {
+                break;
+            }
+            if (count >= totalBlocks) {
+                return;
+            }
+            last = next;
+        }
+        Threading::pushRemoteFrees(first, last);
+    }
+    
+    /// Returns false if the given block from the remote list is in the pool and already available, which means the
+    /// list only led to it through the owner's own links.
+    /// @param block The block to check.
+    bool isRemoteFree(void* block) {
+        if constexpr (Validation::tracksOccupancy) {
+            uint64_t* bitmapWord;
+            uint64_t bitMask;
+            if (findBlockOccupancy(reinterpret_cast<const char*>(block), bitmapWord, bitMask)) {
+                return (*bitmapWord & bitMask) != 0;
+            }
+        }
+        return true;
+    }
     
 public:
     /// Constructor.
     /// @param blocksPerPage Number of individual blocks of size T for each allocated page of memory. If this is zero,
-    ///     then an exception will be thrown.
-    MemoryPoolManager<T>(const unsigned int blocksPerPage)
-    : _blocksPerPage(blocksPerPage)
+    ///     or if BlocksPerPage is set and this is different, then an exception will be thrown.
+    /// @param options Optional settings for the manager, including how the number of blocks grows for later pages with
+    ///     the GrowingPages mode.
+    MemoryPoolManager(const unsigned int blocksPerPage, const MemoryPoolOptions& options = MemoryPoolOptions())
+    : MemoryPoolQuarantine<Validation::quarantines>(options)
+    , MemoryPoolPageGrowth<Modes::growingPages>(blocksPerPage, options)
+    , MemoryPoolAutoTrim<Modes::autoTrim>(blocksPerPage, options)
+    , _blocksPerPage(blocksPerPage)
     , _blockSize(std::max(sizeof(T), sizeof(void*))) // block size must be at least big enough to store a pointer
+    , _blockAlignment(blockAlignment(options))
+    , _blockStride(blockStride(_blockSize, _blockAlignment))
     , _memoryPages(nullptr)
     , _availableBlocks(nullptr)
     , _numberOfPages(0)
-    , _blocksRemaining(0) {
-        // check for invalid block count
-        if (_blocksPerPage == 0) {
+    , _blocksRemaining(0)
+    , _nextPageBlocks(blocksPerPage)
+    , _lowWatermark(options.lowWatermark)
+    , _canarySecret(randomSecret())
+    , _freeListKey(Validation::hardened && options.encodeFreeList ? static_cast<uintptr_t>(randomSecret()) : 0)
+    , _validationInterval(options.validationInterval)
+    , _validationCountdown(1)
+    , _samplingState(_canarySecret)
+    , _reservation(nullptr)
+    , _reservationSize(0)
+    , _slotShift(0) {
+        // check for invalid block count and validation interval
+        if (_blocksPerPage == 0 || _validationInterval == 0
+            || (BlocksPerPage != 0 && _blocksPerPage != BlocksPerPage)) {
             throw MemoryPoolException(MemoryPoolException::invalidSizeMsg);
         }
         
+        // pages only grow with the GrowingPages mode, and pages in reserved address space all have the same size
+        if constexpr (Modes::growingPages) {
+            if (this->_pageGrowthFactor == 0 || options.reservedAddressSpace != 0) {
+                throw MemoryPoolException(MemoryPoolException::invalidSizeMsg);
+            }
+        }
+        else if (options.pageGrowthFactor != 1 || options.maxBlocksPerPage != 0 || options.pageGrowthPolicy) {
+            throw MemoryPoolException(MemoryPoolException::invalidSizeMsg);
+        }
+        if (options.reservedAddressSpace != 0) {
+            reserveAddressSpace(options.reservedAddressSpace);
+        }
+        
         // allocate initial page
-        allocatePage();
+        try {
+            allocatePage();
+        }
+        catch (...) {
+            if (_reservation) {
+                AddressSpace::release(_reservation, _reservationSize);
+            }
+            throw;
+        }
     }
     
+    /// Constructor for managers with a constant number of blocks per page.
+    /// @param options Optional settings for the manager.
+    template <unsigned int FixedBlocksPerPage = BlocksPerPage,
+              typename = typename std::enable_if<FixedBlocksPerPage != 0>::type>
+    explicit MemoryPoolManager(const MemoryPoolOptions& options = MemoryPoolOptions())
+    : MemoryPoolManager(BlocksPerPage, options) {}
+    
     /// Destructor
     ~MemoryPoolManager() {
         clearAllMemory();
+        if (_reservation) {
+            AddressSpace::release(_reservation, _reservationSize);
+        }
     }
     
     const unsigned int getBlocksPerPage() {return _blocksPerPage;}
-    const unsigned int getNumberOfPages() {return _numberOfPages;}
-    const unsigned int getAvailableBlocksRemaining() {return _blocksRemaining;}
+    const unsigned int getNextPageBlocks() {return _nextPageBlocks;}
+    const size_t getNumberOfPages() {return _numberOfPages;}
+    const size_t getAvailableBlocksRemaining() {return _blocksRemaining;}
+    const Stats& getStats() {return *this;}
+    
+    /// Makes the calling thread the owner of the pool. Only available with a threading policy that collects remote
+    /// frees, such as OwnerThreading, and no other thread may use the pool while ownership changes.
+    void claimOwnership() {
+        static_assert(Threading::collectsRemoteFrees,
+                      "claimOwnership needs a threading policy that collects remote frees, such as OwnerThreading.");
+        Threading::claimOwnership();
+    }
     
     
     /// Returns an available block from one of the memory pages. If there are no more available, then a new page will be
     ///  allocated.
     T* allocateBlock() {
-        // allocate a new page if no more available blocks
-        if (!_availableBlocks) {
+        typename Threading::Lock lock(*this);
+        typename Stats::AllocationTimer timer(*this);
+        if constexpr (Threading::collectsRemoteFrees) {
+            // blocks freed by other threads are collected before growing the pool
+            if (_blocksRemaining == 0) {
+                collectRemoteFrees();
+            }
+        }
+        Link* block;
+        if constexpr (Modes::preferFullestPage) {
+            // every page keeps its own list of available blocks
+            block = allocateFromFullestPage();
+        }
+        else if (_availableBlocks) {
+            // pop block
+            block = _availableBlocks;
+            _availableBlocks = nextOf(block);
+        }
+        else if constexpr (Modes::lazyPageCarving) {
+            block = carveBlock();
+        }
+        else {
+            // allocate a new page since there are no more available blocks, then pop block
             allocatePage();
+            block = _availableBlocks;
+            _availableBlocks = nextOf(block);
         }
         
-        // pop block
-        Link* block = _availableBlocks;
-        _availableBlocks = block->next;
-        
         // update values
         --_blocksRemaining;
+        Stats::onAllocate(1, _blocksRemaining);
+        validateReusedBlock(block);
+        
+        if constexpr (Validation::tracksOccupancy) {
+            markBlockAllocated(reinterpret_cast<char*>(block));
+        }
         
         return reinterpret_cast<T*>(block);
     }
     
+    /// Fills the given array with available blocks from the memory pages, allocating as many new pages as needed up
+    /// front. The blocks are taken off the list of available blocks as a single run instead of one at a time.
+    /// @param blocks Array to fill with the allocated blocks. Must have room for at least count pointers.
+    /// @param count Number of blocks to allocate.
+    void allocateBlocks(T** blocks, const unsigned int count) {
+        typename Threading::Lock lock(*this);
+        if (count == 0) {
+            return;
+        }
+        if constexpr (Threading::collectsRemoteFrees) {
+            if (_blocksRemaining < count) {
+                collectRemoteFrees();
+            }
+        }
+        
+        // blocks come from different pages when the fullest page is preferred
+        if constexpr (Modes::preferFullestPage) {
+            for (unsigned int i = 0; i < count; ++i) {
+                blocks[i] = allocateBlock();
+            }
+            return;
+        }
+        
+        // blocks are taken from the list first, and with lazy page carving the rest are carved off afterwards
+        unsigned int listCount = count;
+        if constexpr (Modes::lazyPageCarving) {
+            listCount = static_cast<unsigned int>(std::min<size_t>(count, _blocksRemaining - uncarvedBlockCount()));
+        }
+        else {
+            // allocate new pages if there are not enough available blocks
+            while (_blocksRemaining < count) {
+                allocatePage();
+            }
+        }
+        
+        // walk the run of blocks to hand out, then detach the whole run from the list
+        if (listCount > 0) {
+            Link* block = _availableBlocks;
+            for (unsigned int i = 0; i < listCount - 1; ++i) {
+                blocks[i] = reinterpret_cast<T*>(block);
+                block = nextOf(block);
+            }
+            blocks[listCount - 1] = reinterpret_cast<T*>(block);
+            _availableBlocks = nextOf(block);
+        }
+        if constexpr (Modes::lazyPageCarving) {
+            for (unsigned int i = listCount; i < count; ++i) {
+                blocks[i] = reinterpret_cast<T*>(carveBlock());
+            }
+        }
+        
+        // update values
+        _blocksRemaining -= count;
+        Stats::onAllocate(count, _blocksRemaining);
+        if constexpr (Validation::quarantines) {
+            for (unsigned int i = 0; i < count; ++i) {
+                validateReusedBlock(reinterpret_cast<Link*>(blocks[i]));
+            }
+        }
+        
+        if constexpr (Validation::tracksOccupancy) {
+            for (unsigned int i = 0; i < count; ++i) {
+                markBlockAllocated(reinterpret_cast<char*>(blocks[i]));
+            }
+        }
+    }
+    
     
     /// Returns an allocated block back to the memory manager pool. If performValidations param is passed as true, then
     /// validation checks will be performs and can throw exceptions if the given block is invalid or if buffer overflow/
-    /// underflow has occurred with the block.
+    /// underflow has occurred with the block. With a threading policy that collects remote frees, a block freed by a
+    /// thread other than the owner is only pushed onto the remote list, and is checked when the owner collects it.
     /// @param block The block to free up.
     void freeBlock(T* block) {
+        typename Threading::Lock lock(*this);
+        if constexpr (Threading::collectsRemoteFrees) {
+            if (block && !Threading::isOwner()) {
+                Threading::pushRemoteFrees(block, block);
+                return;
+            }
+        }
         if (block) {
-
-#ifdef VALIDATIONS_ENABLED
-            // perform validation checks on block pointer
-            char* blockBytes = reinterpret_cast<char*>(block);
-            validateBlockLocation(blockBytes);
-            validateMemoryCorruption(blockBytes);
-            validateMultiFree(blockBytes);
-#endif
+            if constexpr (Validation::enabled) {
+                // perform validation checks on block pointer
+                char* blockBytes = reinterpret_cast<char*>(block);
+                uint64_t* bitmapWord;
+                uint64_t bitMask;
+                validateBlockLocation(blockBytes, bitmapWord, bitMask);
+                validateMemoryCorruption(blockBytes);
+                validateMultiFree(bitmapWord, bitMask);
+                
+                // mark block as available
+                *bitmapWord &= ~bitMask;
+            }
+            else if constexpr (Validation::tracksOccupancy) {
+                markBlockAvailable(reinterpret_cast<char*>(block));
+            }
+            else if constexpr (Validation::hardened) {
+                validateSampledFree(reinterpret_cast<char*>(block));
+            }
             
-            // push block back to list
+            // push block back to list, or with a quarantine, the block it pushes out of the quarantine
             Link* blockLink = reinterpret_cast<Link*>(block);
-            blockLink->next = _availableBlocks;
-            _availableBlocks = blockLink;
+            if constexpr (Validation::quarantines) {
+                blockLink = quarantineBlock(blockLink);
+                if (!blockLink) {
+                    Stats::onFree(1);
+                    return;
+                }
+            }
+            if constexpr (Modes::preferFullestPage) {
+                returnBlockToPage(blockLink);
+            }
+            else {
+                setNext(blockLink, _availableBlocks);
+                _availableBlocks = blockLink;
+            }
             
             // update values
             ++_blocksRemaining;
+            Stats::onFree(1);
+            
+            if constexpr (Modes::autoTrim) {
+                if (_blocksRemaining > this->_autoTrimThreshold) {
+                    autoTrim();
+                }
+            }
+        }
+    }
+    
+    /// Returns an array of allocated blocks back to the memory manager pool. The blocks are linked together into a run
+    /// and added to the list of available blocks all at once. Null pointers in the array are skipped. When occupancy is
+    /// tracked, such as with validations enabled, or with the PreferFullestPage mode, every block is freed
+    /// individually, as in freeBlock.
+    /// @param blocks Array of blocks to free up.
+    /// @param count Number of blocks in the array.
+    void freeBlocks(T* const* blocks, const unsigned int count) {
+        typename Threading::Lock lock(*this);
+        if constexpr (Threading::collectsRemoteFrees) {
+            if (!Threading::isOwner()) {
+                // link the blocks together in place, then push the run onto the remote list at once
+                void* first = nullptr;
+                void* last = nullptr;
+                for (unsigned int i = 0; i < count; ++i) {
+                    if (blocks[i]) {
+                        if (last) {
+                            memcpy(last, &blocks[i], sizeof(void*));
+                        }
+                        else {
+                            first = blocks[i];
+                        }
+                        last = blocks[i];
+                    }
+                }
+                if (last) {
+                    Threading::pushRemoteFrees(first, last);
+                }
+                return;
+            }
+        }
+        if constexpr (indexesPages) {
+            for (unsigned int i = 0; i < count; ++i) {
+                freeBlock(blocks[i]);
+            }
+        }
+        else {
+            // link the blocks together in place, then splice the run onto the front of the list
+            Link* first = nullptr;
+            Link* last = nullptr;
+            unsigned int freedCount = 0;
+            for (unsigned int i = 0; i < count; ++i) {
+                if (blocks[i]) {
+                    if constexpr (Validation::hardened) {
+                        validateSampledFree(reinterpret_cast<char*>(blocks[i]));
+                    }
+                    Link* blockLink = reinterpret_cast<Link*>(blocks[i]);
+                    if (last) {
+                        setNext(last, blockLink);
+                    }
+                    else {
+                        first = blockLink;
+                    }
+                    last = blockLink;
+                    ++freedCount;
+                }
+            }
+            if (last) {
+                setNext(last, _availableBlocks);
+                _availableBlocks = first;
+            }
+            
+            // update values
+            _blocksRemaining += freedCount;
+            Stats::onFree(freedCount);
+            
+            if constexpr (Modes::autoTrim) {
+                if (_blocksRemaining > this->_autoTrimThreshold) {
+                    autoTrim();
+                }
+            }
+        }
+    }
+    
+    /// Calls the given function with every allocated block, visiting pages in address order and the blocks of each page
+    /// in address order, so loops that update every live object walk memory sequentially. The occupancy bitmaps are
+    /// scanned a word at a time, so a run of 64 available blocks is skipped with a single check. Only available when the
+    /// validation policy tracks occupancy. Blocks must not be allocated or freed from within the function.
+    /// @param function Function or lambda taking a T* for each allocated block.
+    template <class Function>
+    void forEachLive(Function function) {
+        static_assert(Validation::tracksOccupancy,
+                      "forEachLive needs a validation policy that tracks occupancy, such as OccupancyTracking.");
+        typename Threading::Lock lock(*this);
+        for (auto pageEntry = this->_pageIndex.begin(); pageEntry != this->_pageIndex.end(); ++pageEntry) {
+            char* first = const_cast<char*>(pageEntry->first);
+            const uint64_t* bitmap = pageBitmap(pageEntry->second);
+            const unsigned int wordCount = bitmapWordCount(pageBlockCount(pageEntry->second));
+            for (unsigned int word = 0; word < wordCount; ++word) {
+                // visit the set bits from lowest to highest, clearing each one from the local copy as it is visited
+                uint64_t bits = bitmap[word];
+                while (bits) {
+                    const unsigned int blockIndex = word * 64 + static_cast<unsigned int>(__builtin_ctzll(bits));
+                    function(reinterpret_cast<T*>(first + static_cast<size_t>(blockIndex) * _blockStride));
+                    bits &= bits - 1;
+                }
+            }
+        }
+    }
+    
+    /// Grows the pool until at least the given number of blocks are available, touching the memory of every new page so
+    /// that allocating its blocks later doesn't page fault. Reserving ahead of a burst of allocations keeps the cost of
+    /// growing the pool out of the allocations. Reserved pages are still released by trim once they are empty.
+    /// @param blockCount Number of available blocks to have.
+    /// @return The number of pages allocated.
+    size_t reserve(const size_t blockCount) {
+        typename Threading::Lock lock(*this);
+        return reserveBlocks(blockCount);
+    }
+    
+    /// Grows the pool the same way as reserve if fewer than the low watermark of available blocks are left. This is
+    /// meant to be called where latency doesn't matter, such as between requests or frames, or from a helper thread
+    /// for a pool with MutexThreading, so that allocations in between never grow the pool themselves.
+    /// @return The number of pages allocated.
+    size_t maintain() {
+        typename Threading::Lock lock(*this);
+        return reserveBlocks(_lowWatermark);
+    }
+    
+    /// Releases pages that have no allocated blocks back to the system. The blocks of those pages are removed from the
+    /// list of available blocks. This walks the whole list of available blocks, so it is meant to be called
+    /// occasionally, such as after a burst of allocations has been freed.
+    /// @param maxEmptyPages Number of empty pages to keep for reuse.
+    /// @return The number of pages released.
+    size_t trim(const unsigned int maxEmptyPages = 0) {
+        typename Threading::Lock lock(*this);
+        if constexpr (Threading::collectsRemoteFrees) {
+            collectRemoteFrees();
+        }
+        if constexpr (Modes::preferFullestPage) {
+            return trimEmptyPages(maxEmptyPages);
+        }
+        
+        // pages left to carve by reset are linked up first, so that only the newest page has blocks left to carve
+        if constexpr (Modes::lazyPageCarving) {
+            if (this->_uncarvedPages) {
+                carveAllBlocks();
+            }
+        }
+        
+        // count the available blocks in each page, including blocks not yet carved off the newest page
+        std::vector<PageUsage> usages;
+        usages.reserve(_numberOfPages);
+        for (Page* page = _memoryPages; page; page = page->next) {
+            usages.push_back({reinterpret_cast<char*>(page), page, 0, false});
+        }
+        std::sort(usages.begin(), usages.end(),
+                  [](const PageUsage& a, const PageUsage& b) { return a.pageStart < b.pageStart; });
+        for (Link* block = _availableBlocks; block; block = nextOf(block)) {
+            ++findPageUsage(usages, block).availableBlocks;
+        }
+        if constexpr (Modes::lazyPageCarving) {
+            if (this->_carvePosition != this->_carveEnd) {
+                findPageUsage(usages, this->_carvePosition).availableBlocks += uncarvedBlockCount();
+            }
+        }
+        
+        // choose the empty pages to release
+        size_t emptyPages = 0;
+        size_t releasedPages = 0;
+        size_t releasedBlocks = 0;
+        for (auto usage = usages.begin(); usage != usages.end(); ++usage) {
+            if (usage->availableBlocks == pageBlockCount(usage->page) && ++emptyPages > maxEmptyPages) {
+                usage->release = true;
+                ++releasedPages;
+                releasedBlocks += pageBlockCount(usage->page);
+            }
+        }
+        if (releasedPages == 0) {
+            return 0;
+        }
+        
+        // drop the blocks of released pages from the list of available blocks
+        Link* last = nullptr;
+        for (Link* block = _availableBlocks; block; block = nextOf(block)) {
+            if (!findPageUsage(usages, block).release) {
+                if (last) {
+                    setNext(last, block);
+                }
+                else {
+                    _availableBlocks = block;
+                }
+                last = block;
+            }
+        }
+        if (last) {
+            setNext(last, nullptr);
+        }
+        else {
+            _availableBlocks = nullptr;
+        }
+        if constexpr (Modes::lazyPageCarving) {
+            if (this->_carvePosition != this->_carveEnd && findPageUsage(usages, this->_carvePosition).release) {
+                this->_carvePosition = this->_carveEnd = nullptr;
+            }
+        }
+        
+        // unlink and deallocate the released pages
+        Page** pageTail = &_memoryPages;
+        Page* page = _memoryPages;
+        while (page) {
+            Page* nextPage = page->next;
+            if (findPageUsage(usages, page).release) {
+                if constexpr (indexesPages) {
+                    this->_pageIndex.erase(firstBlock(page));
+                }
+                Stats::onPageReleased(pageBlockCount(page));
+                releasePage(page);
+            }
+            else {
+                *pageTail = page;
+                pageTail = &page->next;
+            }
+            page = nextPage;
+        }
+        *pageTail = nullptr;
+        
+        // update values
+        _numberOfPages -= releasedPages;
+        _blocksRemaining -= releasedBlocks;
+        return releasedPages;
+    }
+    
+    /// Makes every block of every page available again without releasing any pages, discarding all allocated blocks at
+    /// once, such as at the end of a frame or request. Any allocated blocks from this memory manager will be invalid.
+    /// With lazy page carving, the pages are carved again as blocks are allocated, so this takes time in proportion to
+    /// the number of pages, plus clearing the occupancy bitmaps when occupancy is tracked. Otherwise every block is
+    /// linked into the list of available blocks again, as when its page was allocated.
+    void reset() {
+        typename Threading::Lock lock(*this);
+        
+        // blocks in the quarantine or freed by other threads have already been freed, the rest are freed here
+        size_t totalBlocks = 0;
+        for (Page* page = _memoryPages; page; page = page->next) {
+            totalBlocks += pageBlockCount(page);
+        }
+        Stats::onFree(totalBlocks - _blocksRemaining - quarantinedBlockCount());
+        clearQuarantine();
+        if constexpr (Threading::collectsRemoteFrees) {
+            Threading::takeRemoteFrees();
+        }
+        
+        // no blocks are allocated
+        if constexpr (Validation::tracksOccupancy) {
+            for (Page* page = _memoryPages; page; page = page->next) {
+                memset(pageBitmap(page), 0, bitmapWordCount(pageBlockCount(page)) * sizeof(uint64_t));
+            }
+        }
+        
+        // the blocks made available don't count towards the next automatic trim
+        if constexpr (Modes::autoTrim) {
+            this->_autoTrimThreshold += totalBlocks - _blocksRemaining;
+        }
+        _availableBlocks = nullptr;
+        _blocksRemaining = totalBlocks;
+        
+        if constexpr (Modes::preferFullestPage) {
+            // every page starts out empty with all of its blocks on its own list
+            clearOccupancyLists();
+            if constexpr (Modes::lazyPageCarving) {
+                this->_carvePosition = this->_carveEnd = nullptr;
+            }
+            for (Page* page = _memoryPages; page; page = page->next) {
+                page->availableCount = pageBlockCount(page);
+                page->availableBlocks = nullptr;
+                linkPageBlocks(page, &page->availableBlocks);
+                listPage(page, OccupancyLists::emptyPageList);
+            }
+        }
+        else if constexpr (Modes::lazyPageCarving) {
+            // carving starts over from the newest page and moves on through the rest
+            this->_carvePosition = this->_carveEnd = nullptr;
+            this->_uncarvedPages = _memoryPages;
+            this->_uncarvedPageBlocks = totalBlocks;
+        }
+        else {
+            for (Page* page = _memoryPages; page; page = page->next) {
+                linkPageBlocks(page, &_availableBlocks);
+            }
         }
     }
     
     /// Deallocates all memory page allocations. Any allocated blocks from this memory manage will be invalid.
     void clearAllMemory() {
-        Link* pList = _memoryPages;
-        Link* pageToDealloc;
+        typename Threading::Lock lock(*this);
+        
+        // blocks still allocated are freed along with their pages
+        size_t totalBlocks = 0;
+        for (Page* page = _memoryPages; page; page = page->next) {
+            totalBlocks += pageBlockCount(page);
+        }
+        Stats::onFree(totalBlocks - _blocksRemaining - quarantinedBlockCount());
+        
+        Page* pList = _memoryPages;
+        Page* pageToDealloc;
         while (pList) {
             pageToDealloc = pList;
             pList = pList->next;
-            free(pageToDealloc);
+            Stats::onPageReleased(pageBlockCount(pageToDealloc));
+            releasePage(pageToDealloc);
+        }
+        _memoryPages = nullptr;
+        _availableBlocks = nullptr;
+        if constexpr (Modes::lazyPageCarving) {
+            this->_carvePosition = this->_carveEnd = nullptr;
+            this->_uncarvedPages = nullptr;
+            this->_uncarvedPageBlocks = 0;
         }
-        _memoryPages = _availableBlocks = nullptr;
         _numberOfPages = _blocksRemaining = 0;
+        if constexpr (indexesPages) {
+            this->_pageIndex.clear();
+        }
+        _slots.clear();
+        _freeSlots.clear();
+        if constexpr (Modes::preferFullestPage) {
+            clearOccupancyLists();
+        }
+        clearQuarantine();
+        if constexpr (Threading::collectsRemoteFrees) {
+            Threading::takeRemoteFrees();
+        }
     }
 };
 
@@ -0,0 +1,249 @@
+//
+//  MemoryPoolPolicies.h
+//  Exercise: Memory Manager
+//
+
+#ifndef MemoryPoolPolicies_h
+#define MemoryPoolPolicies_h
+
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+
+// Policies are template parameters of MemoryPoolManager that are resolved at compile time, so pools with different
+// policies can live side by side in one program and a disabled policy adds no code or data to the manager.
+
+/// Validation policy that performs no checks. Blocks are packed with no padding between them.
+struct NoValidation {
+    static constexpr bool enabled = false;
+    static constexpr bool tracksOccupancy = false;
+    static constexpr bool hardened = false;
+    static constexpr bool quarantines = false;
+};
+
+/// Validation policy that performs no checks, but keeps a bitmap in each page of which blocks are allocated so that
+/// live blocks can be visited with forEachLive. Blocks are packed with no padding between them, though every
+/// allocation and free has to look up its page to update its bit.
+struct OccupancyTracking {
+    static constexpr bool enabled = false;
+    static constexpr bool tracksOccupancy = true;
+    static constexpr bool hardened = false;
+    static constexpr bool quarantines = false;
+};
+
+/// Validation policy that checks every freed block for an invalid address, a duplicate free, and corruption of the
+/// canaries around the block, throwing a MemoryPoolException if any check fails. Occupancy is tracked as well, since
+/// the checks need it.
+struct FullValidation {
+    static constexpr bool enabled = true;
+    static constexpr bool tracksOccupancy = true;
+    static constexpr bool hardened = false;
+    static constexpr bool quarantines = false;
+};
+
+/// Validation policy meant to be left on in production. Every block is surrounded by canaries, but only one in
+/// MemoryPoolOptions::validationInterval frees, chosen at random, checks them, and the free list can be encoded with
+/// MemoryPoolOptions::encodeFreeList. There is no occupancy bitmap, so invalid addresses and duplicate frees are not
+/// detected.
+struct HardenedValidation {
+    static constexpr bool enabled = false;
+    static constexpr bool tracksOccupancy = false;
+    static constexpr bool hardened = true;
+    static constexpr bool quarantines = false;
+};
+
+/// Validation policy for debugging heap bugs in tests and stress runs. It makes every check that FullValidation does,
+/// and freed blocks are also held in a FIFO quarantine of MemoryPoolOptions::quarantineSize blocks before they can be
+/// allocated again, so a dangling pointer keeps pointing at a block nothing else is using for a while. With
+/// MemoryPoolOptions::poisonFreedBlocks, freed blocks are filled with a pattern that is checked when they leave the
+/// quarantine and again when they are reused, which catches writes through dangling pointers. Pair it with
+/// GuardedPageSource to also fault on overflows past the end of a page.
+struct DebugValidation {
+    static constexpr bool enabled = true;
+    static constexpr bool tracksOccupancy = true;
+    static constexpr bool hardened = false;
+    static constexpr bool quarantines = true;
+};
+
+/// Validation policy used when none is given. Defining VALIDATIONS_ENABLED makes every pool validated by default, as
+/// before validation became a policy.
+#ifdef VALIDATIONS_ENABLED
+typedef FullValidation DefaultValidationPolicy;
+#else
+typedef NoValidation DefaultValidationPolicy;
+#endif
+
+/// Threading policy for pools used by one thread at a time. Taking the lock does nothing.
+struct SingleThreaded {
+    static constexpr bool collectsRemoteFrees = false;
+    
+    struct Lock {
+        explicit Lock(SingleThreaded&) {}
+    };
+};
+
+/// Threading policy that guards every call that changes the manager with a mutex, so one pool can be shared between
+/// threads. The mutex is recursive since some calls are made up of others, such as freeing a batch of validated blocks.
+class MutexThreading {
+private:
+    std::recursive_mutex _mutex;
+    
+public:
+    static constexpr bool collectsRemoteFrees = false;
+    
+    class Lock {
+    private:
+        std::lock_guard<std::recursive_mutex> _guard;
+    
+    public:
+        explicit Lock(MutexThreading& threading)
+        : _guard(threading._mutex) {}
+    };
+};
+
+/// Threading policy for pools that one thread, the owner, allocates from, while any thread may free blocks back. Frees
+/// from other threads push the blocks onto a lock-free list with a single compare-and-swap, and the owner takes the
+/// whole list with one exchange and frees the blocks itself once it runs out of available blocks, or when it trims. The
+/// owner's allocations and frees take no lock and don't touch the list until then, and the list sits on its own cache
+/// line so pushes from other threads don't slow down the owner's other data. Only the owner may call anything other
+/// than freeBlock and freeBlocks. The owner is the thread that constructed the pool, until another thread claims it.
+/// The list is linked through the freed blocks, so freeing a block twice from other threads is undefined unless the
+/// pool validates, since the block then links to itself and the owner's collection never ends.
+class OwnerThreading {
+private:
+    std::thread::id _owner;
+    
+    /// Head of the list of blocks freed by other threads, linked through the first bytes of the blocks.
+    alignas(64) std::atomic<void*> _remoteFrees;
+    
+public:
+    static constexpr bool collectsRemoteFrees = true;
+    
+    struct Lock {
+        explicit Lock(OwnerThreading&) {}
+    };
+    
+    OwnerThreading()
+    : _owner(std::this_thread::get_id())
+    , _remoteFrees(nullptr) {}
+    
+    /// Makes the calling thread the owner. No other thread may use the pool while ownership changes.
+    void claimOwnership() {
+        _owner = std::this_thread::get_id();
+    }
+    
+    bool isOwner() const {
+        return std::this_thread::get_id() == _owner;
+    }
+    
+    /// Pushes a run of blocks, already linked from first to last through their first bytes, onto the list of blocks
+    /// freed by other threads.
+    /// @param first The first block of the run.
+    /// @param last The last block of the run, whose link is overwritten.
+    void pushRemoteFrees(void* first, void* last) {
+        void* head = _remoteFrees.load(std::memory_order_relaxed);
+        do {
+            memcpy(last, &head, sizeof(head));
+        } while (!_remoteFrees.compare_exchange_weak(head, first,
+                                                     std::memory_order_release, std::memory_order_relaxed));
+    }
+    
+    /// Takes every block freed by other threads so far, and returns the first of them, or null if there are none.
+    void* takeRemoteFrees() {
+        if (!_remoteFrees.load(std::memory_order_relaxed)) {
+            return nullptr;
+        }
+        return _remoteFrees.exchange(nullptr, std::memory_order_acquire);
+    }
+};
+
+/// Stats policy that records nothing. Besides its hooks, a stats policy has an AllocationTimer that the manager creates
+/// for the duration of each allocateBlock call, and a PageTimer created for the duration of each page allocation.
+struct NoStats {
+    struct AllocationTimer {
+        explicit AllocationTimer(NoStats&) {}
+    };
+    
+    struct PageTimer {
+        PageTimer(NoStats&, const unsigned int) {}
+    };
+    
+    /// Called after blocks are allocated, with the number of blocks allocated and the number of available blocks left
+    /// in the pool. The other hooks are passed the number of blocks freed, or the number of blocks in the page.
+    void onAllocate(const size_t, const size_t) {}
+    void onFree(const size_t) {}
+    void onPageAllocated(const size_t) {}
+    void onPageReleased(const size_t) {}
+};
+
+/// Stats policy that counts allocations, frees and pages, and keeps the highest number of blocks allocated at once.
+/// Nothing is timed.
+class CountingStats : public NoStats {
+private:
+    unsigned long long _allocations = 0;
+    unsigned long long _frees = 0;
+    unsigned long long _pagesAllocated = 0;
+    unsigned long long _pagesReleased = 0;
+    unsigned long long _liveBlocks = 0;
+    unsigned long long _peakLiveBlocks = 0;
+    
+public:
+    void onAllocate(const size_t count, const size_t) {
+        _allocations += count;
+        _liveBlocks += count;
+        if (_liveBlocks > _peakLiveBlocks) {
+            _peakLiveBlocks = _liveBlocks;
+        }
+    }
+    
+    void onFree(const size_t count) {
+        _frees += count;
+        _liveBlocks -= count;
+    }
+    
+    void onPageAllocated(const size_t) {++_pagesAllocated;}
+    void onPageReleased(const size_t) {++_pagesReleased;}
+    
+    unsigned long long getAllocations() const {return _allocations;}
+    unsigned long long getFrees() const {return _frees;}
+    unsigned long long getPagesAllocated() const {return _pagesAllocated;}
+    unsigned long long getPagesReleased() const {return _pagesReleased;}
+    unsigned long long getLiveBlocks() const {return _liveBlocks;}
+    unsigned long long getPeakLiveBlocks() const {return _peakLiveBlocks;}
+};
+
+/// Mode in which allocating a page does not link up all of its blocks. Instead, fresh blocks are carved off the newest
+/// page one at a time with a bump pointer as they are needed, and the list of available blocks only holds blocks that
+/// have been freed. Growing the pool becomes constant time and memory for blocks that are never used is never touched.
+struct LazyPageCarving {};
+
+/// Mode in which pages that have no allocated blocks are released back to the system automatically as blocks are
+/// freed, keeping at most MemoryPoolOptions::maxEmptyPages of them around for reuse.
+struct AutoTrim {};
+
+/// Mode in which every page keeps its own list of available blocks, and blocks are allocated from one page until it
+/// runs out and then from the fullest page that has any available, like a slab allocator. Blocks in use stay packed
+/// into as few pages as possible, so more pages become empty and can be trimmed, at the cost of looking up the page of
+/// every freed block.
+struct PreferFullestPage {};
+
+/// Mode in which later pages can have more blocks than the first, following MemoryPoolOptions::pageGrowthFactor and
+/// maxBlocksPerPage, or MemoryPoolOptions::pageGrowthPolicy. Without it, every page has the number of blocks given to
+/// the constructor.
+struct GrowingPages {};
+
+/// Modes of a pool, given as the Modes parameter of MemoryPoolManager, such as PoolModes<LazyPageCarving, AutoTrim>.
+/// Like the policies, modes are chosen at compile time, so a pool without a mode has none of its branches in
+/// allocateBlock and freeBlock, and none of its data.
+template <class... Modes>
+struct PoolModes {
+    static constexpr bool lazyPageCarving = (false || ... || std::is_same<Modes, LazyPageCarving>::value);
+    static constexpr bool autoTrim = (false || ... || std::is_same<Modes, AutoTrim>::value);
+    static constexpr bool preferFullestPage = (false || ... || std::is_same<Modes, PreferFullestPage>::value);
+    static constexpr bool growingPages = (false || ... || std::is_same<Modes, GrowingPages>::value);
+};
+
+#endif /* MemoryPoolPolicies_h */
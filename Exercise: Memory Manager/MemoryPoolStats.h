@@ -0,0 +1,323 @@
+//
+//  MemoryPoolStats.h
+//  Exercise: Memory Manager
+//
+
+#ifndef MemoryPoolStats_h
+#define MemoryPoolStats_h
+
+#include "MemoryPoolPolicies.h"
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// Copy of the statistics of a pool at one point in time, which can be written out as JSON or text.
+struct PoolStatsSnapshot {
+    /// A page allocated when the pool ran out of blocks.
+    struct PageGrowth {
+        /// Nanoseconds from the creation of the pool to the start of the page allocation.
+        unsigned long long timeNanoseconds;
+        unsigned int blockCount;
+        /// Nanoseconds spent allocating the page.
+        unsigned long long durationNanoseconds;
+    };
+    
+    unsigned long long allocations = 0;
+    unsigned long long frees = 0;
+    unsigned long long liveBlocks = 0;
+    unsigned long long peakLiveBlocks = 0;
+    unsigned long long pagesAllocated = 0;
+    unsigned long long pagesReleased = 0;
+    unsigned long long pageAllocationNanoseconds = 0;
+    std::vector<PageGrowth> pageGrowth;
+    
+    /// One in this many calls to allocateBlock is timed.
+    unsigned int latencySampleInterval = 0;
+    /// Number of timed allocations by latency. Bucket i counts the ones that took less than 2^i nanoseconds and, past
+    /// the first bucket, at least 2^(i-1). The last bucket also counts anything slower.
+    std::vector<unsigned long long> latencyHistogram;
+    
+    /// Returns the number of timed allocations.
+    unsigned long long getLatencySamples() const {
+        unsigned long long samples = 0;
+        for (unsigned long long count : latencyHistogram) {
+            samples += count;
+        }
+        return samples;
+    }
+    
+    /// Returns the upper bound in nanoseconds of the histogram bucket holding the given fraction of timed allocations,
+    /// such as 0.99 for the 99th percentile, or zero if nothing was timed.
+    unsigned long long getLatencyPercentile(const double fraction) const {
+        const unsigned long long samples = getLatencySamples();
+        unsigned long long seen = 0;
+        for (size_t i = 0; i < latencyHistogram.size(); ++i) {
+            seen += latencyHistogram[i];
+            if (seen > 0 && seen >= fraction * samples) {
+                return 1ull << i;
+            }
+        }
+        return 0;
+    }
+    
+    std::string toJson() const {
+        std::ostringstream out;
+        out << "{\"allocations\": " << allocations
+            << ", \"frees\": " << frees
+            << ", \"liveBlocks\": " << liveBlocks
+            << ", \"peakLiveBlocks\": " << peakLiveBlocks
+            << ", \"pagesAllocated\": " << pagesAllocated
+            << ", \"pagesReleased\": " << pagesReleased
+            << ", \"pageAllocationNanoseconds\": " << pageAllocationNanoseconds
+            << ", \"pageGrowth\": [";
+        for (size_t i = 0; i < pageGrowth.size(); ++i) {
+            out << (i > 0 ? ", " : "")
+                << "{\"timeNanoseconds\": " << pageGrowth[i].timeNanoseconds
+                << ", \"blockCount\": " << pageGrowth[i].blockCount
+                << ", \"durationNanoseconds\": " << pageGrowth[i].durationNanoseconds << "}";
+        }
+        out << "], \"latencySampleInterval\": " << latencySampleInterval << ", \"latencyHistogram\": [";
+        for (size_t i = 0; i < latencyHistogram.size(); ++i) {
+            out << (i > 0 ? ", " : "") << latencyHistogram[i];
+        }
+        out << "]}";
+        return out.str();
+    }
+    
+    std::string toText() const {
+        std::ostringstream out;
+        out << "allocations:          " << allocations << "\n"
+            << "frees:                " << frees << "\n"
+            << "live blocks:          " << liveBlocks << " (peak " << peakLiveBlocks << ")\n"
+            << "pages:                " << pagesAllocated << " allocated, " << pagesReleased << " released\n"
+            << "page allocation time: " << pageAllocationNanoseconds << " ns\n";
+        for (size_t i = 0; i < pageGrowth.size(); ++i) {
+            out << "  page " << i + 1 << " at " << pageGrowth[i].timeNanoseconds << " ns: "
+                << pageGrowth[i].blockCount << " blocks in " << pageGrowth[i].durationNanoseconds << " ns\n";
+        }
+        out << "allocation latency:   " << getLatencySamples() << " samples, 1 in " << latencySampleInterval << "\n";
+        for (size_t i = 0; i < latencyHistogram.size(); ++i) {
+            if (latencyHistogram[i] > 0) {
+                out << "  < " << (1ull << i) << " ns: " << latencyHistogram[i] << "\n";
+            }
+        }
+        return out.str();
+    }
+};
+
+/// Stats policy that counts allocations, frees and pages, keeps the highest number of blocks allocated at once, records
+/// when each page was allocated and how long it took, and times one in every LatencySampleInterval calls to
+/// allocateBlock into a histogram. Use snapshot to read them.
+///
+/// With ThreadShards, allocation and free counters and the histogram are kept in a separate shard for every thread
+/// that uses the pool, each on its own cache lines, so threads sharing a pool don't contend over the counters. The
+/// shards are summed when a snapshot is taken. Without it, all threads write to one shard, which is only safe when the
+/// pool's threading policy serializes the calls. Only MemoryPoolManager takes a stats policy, and its threading
+/// policies already serialize the hooks, or leave them all to one owning thread, so shards only keep the counters'
+/// cache lines from moving between threads that take turns holding a MutexThreading lock. The concurrent, lock-free
+/// and per-CPU managers record no stats.
+template <unsigned int LatencySampleInterval = 64, bool ThreadShards = false>
+class DetailedStats {
+    static_assert(LatencySampleInterval > 0, "the latency sample interval must be at least one");
+    
+public:
+    static constexpr unsigned int latencyBucketCount = 32;
+    
+private:
+    typedef std::chrono::steady_clock Clock;
+    
+    /// Counters written by a single thread.
+    struct alignas(64) Shard {
+        std::atomic<unsigned long long> allocations{0};
+        std::atomic<unsigned long long> frees{0};
+        std::atomic<unsigned long long> latencyHistogram[latencyBucketCount] = {};
+        /// Number of calls to allocateBlock left before the next one is timed.
+        unsigned int untilSample = LatencySampleInterval;
+    };
+    
+    /// Adds to a counter that only the calling thread writes, which needs no atomic read-modify-write.
+    static void add(std::atomic<unsigned long long>& counter, const unsigned long long amount) {
+        counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+    
+    static unsigned long long nanosecondsBetween(const Clock::time_point start, const Clock::time_point end) {
+        const std::chrono::nanoseconds duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start);
+        return static_cast<unsigned long long>(duration.count());
+    }
+    
+    /// Identifies this object in the shard cache of each thread. Unlike its address, it is never reused.
+    const unsigned long long _id;
+    const Clock::time_point _created;
+    
+    /// Guards the list of shards and the page growth records.
+    mutable std::mutex _mutex;
+    std::vector<std::unique_ptr<Shard>> _shards;
+    std::map<std::thread::id, Shard*> _threadShards;
+    std::vector<PoolStatsSnapshot::PageGrowth> _pageGrowth;
+    unsigned long long _pageAllocationNanoseconds = 0;
+    
+    /// Values that only change on page allocations, or when a new peak is reached, so they are rarely written.
+    std::atomic<unsigned long long> _pagesAllocated{0};
+    std::atomic<unsigned long long> _pagesReleased{0};
+    std::atomic<unsigned long long> _capacity{0};
+    std::atomic<unsigned long long> _peakLiveBlocks{0};
+    
+    static unsigned long long nextId() {
+        static std::atomic<unsigned long long> id{0};
+        return ++id;
+    }
+    
+    /// Returns the shard of the calling thread. Each thread caches the shards of the last few pools it used, indexed
+    /// by id, so the registry is only searched on a cache miss.
+    Shard& localShard() {
+        if constexpr (!ThreadShards) {
+            return *_shards.front();
+        }
+        else {
+            struct CachedShard {
+                unsigned long long owner = 0;
+                Shard* shard = nullptr;
+            };
+            thread_local CachedShard cache[8];
+            CachedShard& cached = cache[_id % 8];
+            if (cached.owner != _id) {
+                std::lock_guard<std::mutex> guard(_mutex);
+                Shard*& shard = _threadShards[std::this_thread::get_id()];
+                if (!shard) {
+                    _shards.emplace_back(new Shard());
+                    shard = _shards.back().get();
+                }
+                cached.owner = _id;
+                cached.shard = shard;
+            }
+            return *cached.shard;
+        }
+    }
+    
+public:
+    /// Times a call to allocateBlock if it is the one to be sampled.
+    class AllocationTimer {
+    private:
+        Shard& _shard;
+        const bool _sampled;
+        Clock::time_point _start;
+    
+    public:
+        explicit AllocationTimer(DetailedStats& stats)
+        : _shard(stats.localShard())
+        , _sampled(--_shard.untilSample == 0) {
+            if (_sampled) {
+                _shard.untilSample = LatencySampleInterval;
+                _start = Clock::now();
+            }
+        }
+        
+        ~AllocationTimer() {
+            if (_sampled) {
+                const unsigned long long nanoseconds = nanosecondsBetween(_start, Clock::now());
+                unsigned int bucket = 0;
+                while (bucket < latencyBucketCount - 1 && (nanoseconds >> bucket) != 0) {
+                    ++bucket;
+                }
+                add(_shard.latencyHistogram[bucket], 1);
+            }
+        }
+    };
+    
+    /// Records when a page allocation started and how long it took, unless it failed.
+    class PageTimer {
+    private:
+        DetailedStats& _stats;
+        const unsigned int _blockCount;
+        const int _uncaughtExceptions;
+        const Clock::time_point _start;
+    
+    public:
+        PageTimer(DetailedStats& stats, const unsigned int blockCount)
+        : _stats(stats)
+        , _blockCount(blockCount)
+        , _uncaughtExceptions(std::uncaught_exceptions())
+        , _start(Clock::now()) {}
+        
+        ~PageTimer() {
+            if (std::uncaught_exceptions() > _uncaughtExceptions) {
+                return;
+            }
+            PoolStatsSnapshot::PageGrowth growth;
+            growth.timeNanoseconds = nanosecondsBetween(_stats._created, _start);
+            growth.blockCount = _blockCount;
+            growth.durationNanoseconds = nanosecondsBetween(_start, Clock::now());
+            std::lock_guard<std::mutex> guard(_stats._mutex);
+            _stats._pageGrowth.push_back(growth);
+            _stats._pageAllocationNanoseconds += growth.durationNanoseconds;
+        }
+    };
+    
+    DetailedStats()
+    : _id(nextId())
+    , _created(Clock::now()) {
+        if constexpr (!ThreadShards) {
+            _shards.emplace_back(new Shard());
+        }
+    }
+    
+    DetailedStats(const DetailedStats&) = delete;
+    DetailedStats& operator=(const DetailedStats&) = delete;
+    
+    void onAllocate(const size_t count, const size_t blocksRemaining) {
+        add(localShard().allocations, count);
+        
+        // the peak is shared, but only written when it goes up
+        const unsigned long long liveBlocks = _capacity.load(std::memory_order_relaxed) - blocksRemaining;
+        if (liveBlocks > _peakLiveBlocks.load(std::memory_order_relaxed)) {
+            _peakLiveBlocks.store(liveBlocks, std::memory_order_relaxed);
+        }
+    }
+    
+    void onFree(const size_t count) {
+        add(localShard().frees, count);
+    }
+    
+    void onPageAllocated(const size_t blockCount) {
+        _pagesAllocated.fetch_add(1, std::memory_order_relaxed);
+        _capacity.fetch_add(blockCount, std::memory_order_relaxed);
+    }
+    
+    void onPageReleased(const size_t blockCount) {
+        _pagesReleased.fetch_add(1, std::memory_order_relaxed);
+        _capacity.fetch_sub(blockCount, std::memory_order_relaxed);
+    }
+    
+    /// Returns a copy of the statistics, summing the shards of every thread. Counters written by other threads while
+    /// the snapshot is taken may or may not be included.
+    PoolStatsSnapshot snapshot() const {
+        PoolStatsSnapshot result;
+        result.latencySampleInterval = LatencySampleInterval;
+        result.latencyHistogram.resize(latencyBucketCount);
+        result.pagesAllocated = _pagesAllocated.load(std::memory_order_relaxed);
+        result.pagesReleased = _pagesReleased.load(std::memory_order_relaxed);
+        result.peakLiveBlocks = _peakLiveBlocks.load(std::memory_order_relaxed);
+        
+        std::lock_guard<std::mutex> guard(_mutex);
+        for (const std::unique_ptr<Shard>& shard : _shards) {
+            result.allocations += shard->allocations.load(std::memory_order_relaxed);
+            result.frees += shard->frees.load(std::memory_order_relaxed);
+            for (unsigned int i = 0; i < latencyBucketCount; ++i) {
+                result.latencyHistogram[i] += shard->latencyHistogram[i].load(std::memory_order_relaxed);
+            }
+        }
+        result.liveBlocks = result.allocations - result.frees;
+        result.pageGrowth = _pageGrowth;
+        result.pageAllocationNanoseconds = _pageAllocationNanoseconds;
+        return result;
+    }
+};
+
+#endif /* MemoryPoolStats_h */
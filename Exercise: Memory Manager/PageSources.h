@@ -0,0 +1,250 @@
+//
+//  PageSources.h
+//  Exercise: Memory Manager
+//
+
+#ifndef PageSources_h
+#define PageSources_h
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Page sources decide where the Memory Manager gets its pages of memory from. A page source is a class with two static
+// functions:
+//     static void* allocatePage(size_t size);
+//     static void releasePage(void* page, size_t size);
+// allocatePage returns at least size bytes aligned to at least a pointer, or throws std::bad_alloc. releasePage is
+// given the same size the page was allocated with.
+
+/// Page source that allocates pages from the heap with malloc. This is the default.
+class MallocPageSource {
+public:
+    static void* allocatePage(const size_t size) {
+        void* page = malloc(size);
+        if (!page) {
+            throw std::bad_alloc();
+        }
+        return page;
+    }
+    
+    static void releasePage(void* page, const size_t) {
+        free(page);
+    }
+};
+
+#if defined(__unix__) || defined(__APPLE__)
+namespace PageSourceUtils {
+    /// Size of a transparent or explicit huge page.
+    const size_t hugePageSize = 2 * 1024 * 1024;
+    
+    /// Rounds the given size up to a multiple of the given power of two.
+    inline size_t roundUp(const size_t size, const size_t multiple) {
+        return (size + multiple - 1) & ~(multiple - 1);
+    }
+    
+    /// Writes to every system page in the given range, so that they are all backed by memory before they are used.
+    inline void prefault(void* memory, const size_t size) {
+        const size_t systemPageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        volatile char* bytes = reinterpret_cast<volatile char*>(memory);
+        for (size_t offset = 0; offset < size; offset += systemPageSize) {
+            bytes[offset] = 0;
+        }
+    }
+    
+    /// Maps anonymous memory with the given extra flags. Returns null if the mapping failed.
+    inline void* map(const size_t size, const int extraFlags) {
+        void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | extraFlags, -1, 0);
+        return memory == MAP_FAILED ? nullptr : memory;
+    }
+    
+    /// Maps anonymous memory aligned to a huge page and asks for it to be backed by transparent huge pages where the
+    /// platform supports it. The size must be a multiple of the huge page size. Throws std::bad_alloc on failure.
+    inline void* mapHugePageAligned(const size_t size) {
+        // map an extra huge page, then unmap the unaligned parts at either end
+        char* memory = reinterpret_cast<char*>(map(size + hugePageSize, 0));
+        if (!memory) {
+            throw std::bad_alloc();
+        }
+        char* aligned = reinterpret_cast<char*>(roundUp(reinterpret_cast<uintptr_t>(memory), hugePageSize));
+        if (aligned != memory) {
+            munmap(memory, aligned - memory);
+        }
+        munmap(aligned + size, memory + hugePageSize - aligned);
+#ifdef MADV_HUGEPAGE
+        madvise(aligned, size, MADV_HUGEPAGE);
+#endif
+        return aligned;
+    }
+}
+
+/// Page source that maps pages directly from the system with anonymous mmap, bypassing the heap. Sizes are rounded up
+/// to whole system pages, and the memory is only backed as it is first touched unless Prefault is true, in which case
+/// all of it is backed up front (with MAP_POPULATE where available) so that first touches don't fault on the hot path.
+template <bool Prefault = false>
+class MmapPageSource {
+public:
+    static void* allocatePage(const size_t size) {
+#ifdef MAP_POPULATE
+        void* page = PageSourceUtils::map(size, Prefault ? MAP_POPULATE : 0);
+#else
+        void* page = PageSourceUtils::map(size, 0);
+#endif
+        if (!page) {
+            throw std::bad_alloc();
+        }
+#ifndef MAP_POPULATE
+        if (Prefault) {
+            PageSourceUtils::prefault(page, size);
+        }
+#endif
+        return page;
+    }
+    
+    static void releasePage(void* page, const size_t size) {
+        munmap(page, size);
+    }
+};
+
+/// Page source that maps pages aligned to 2 MiB and marks them with MADV_HUGEPAGE, so that the kernel backs them with
+/// transparent huge pages. Large pools then need far fewer TLB entries. Sizes are rounded up to whole huge pages, so
+/// this suits pages of a few megabytes or more. If Prefault is true, all of the memory is touched up front.
+template <bool Prefault = false>
+class TransparentHugePageSource {
+public:
+    static void* allocatePage(const size_t size) {
+        void* page = PageSourceUtils::mapHugePageAligned(PageSourceUtils::roundUp(size, PageSourceUtils::hugePageSize));
+        if (Prefault) {
+            PageSourceUtils::prefault(page, size);
+        }
+        return page;
+    }
+    
+    static void releasePage(void* page, const size_t size) {
+        munmap(page, PageSourceUtils::roundUp(size, PageSourceUtils::hugePageSize));
+    }
+};
+
+/// Page source that maps pages from the system's reserved pool of explicit huge pages with MAP_HUGETLB, populating them
+/// up front if Prefault is true. If not enough huge pages are reserved, or the platform doesn't have them, then pages
+/// fall back to transparent huge pages. Sizes are rounded up to whole huge pages.
+template <bool Prefault = false>
+class HugeTlbPageSource {
+public:
+    static void* allocatePage(const size_t size) {
+#ifdef MAP_HUGETLB
+        const size_t mappedSize = PageSourceUtils::roundUp(size, PageSourceUtils::hugePageSize);
+        void* page = PageSourceUtils::map(mappedSize, MAP_HUGETLB | (Prefault ? MAP_POPULATE : 0));
+        if (page) {
+            return page;
+        }
+#endif
+        return TransparentHugePageSource<Prefault>::allocatePage(size);
+    }
+    
+    static void releasePage(void* page, const size_t size) {
+        munmap(page, PageSourceUtils::roundUp(size, PageSourceUtils::hugePageSize));
+    }
+};
+
+/// Page source for debugging that maps every page between two guard pages protected with mprotect, so any access just
+/// before or after a page faults right away. Each page is placed as close to the guard page after it as alignment
+/// allows, so an overflow off the end of the last block in a page faults within a few bytes instead of silently
+/// corrupting other memory. Pools with one block per page get a guard page after every block. Every page costs at
+/// least three system pages of address space and a system call to map and to protect, so this is only meant for tests
+/// and stress runs.
+class GuardedPageSource {
+private:
+    /// Alignment of the returned pages, which is enough for any type.
+    static const size_t pageAlignment = alignof(std::max_align_t);
+    
+    static size_t systemPageSize() {
+        return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    }
+    
+    /// Returns the number of bytes between the end of the guard page before a page and the start of the page.
+    static size_t pageOffset(const size_t size) {
+        return (PageSourceUtils::roundUp(size, systemPageSize()) - size) & ~(pageAlignment - 1);
+    }
+    
+public:
+    static void* allocatePage(const size_t size) {
+        // map the guard pages and the page together with no access, then open up the middle
+        const size_t guardSize = systemPageSize();
+        const size_t usableSize = PageSourceUtils::roundUp(size, guardSize);
+        void* memory = mmap(nullptr, usableSize + 2 * guardSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+        char* usable = reinterpret_cast<char*>(memory) + guardSize;
+        if (mprotect(usable, usableSize, PROT_READ | PROT_WRITE) != 0) {
+            munmap(memory, usableSize + 2 * guardSize);
+            throw std::bad_alloc();
+        }
+        return usable + pageOffset(size);
+    }
+    
+    static void releasePage(void* page, const size_t size) {
+        const size_t guardSize = systemPageSize();
+        char* memory = reinterpret_cast<char*>(page) - pageOffset(size) - guardSize;
+        munmap(memory, PageSourceUtils::roundUp(size, guardSize) + 2 * guardSize);
+    }
+};
+#endif
+
+// A pool can also reserve one contiguous range of address space up front and commit its pages inside it as it grows,
+// instead of getting them from a page source (see MemoryPoolOptions::reservedAddressSpace). Reserving address space
+// needs mmap, so elsewhere reserve always fails.
+namespace AddressSpace {
+#if defined(__unix__) || defined(__APPLE__)
+    inline size_t systemPageSize() {
+        return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    }
+    
+    /// Flags for mappings of reserved address space, which isn't counted against the system's commit limit.
+    inline int reservedFlags() {
+#ifdef MAP_NORESERVE
+        return MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+#else
+        return MAP_PRIVATE | MAP_ANONYMOUS;
+#endif
+    }
+    
+    /// Reserves the given number of bytes of address space with no access and no memory behind it. Returns null if the
+    /// reservation failed.
+    inline char* reserve(const size_t size) {
+        void* memory = mmap(nullptr, size, PROT_NONE, reservedFlags(), -1, 0);
+        return memory == MAP_FAILED ? nullptr : reinterpret_cast<char*>(memory);
+    }
+    
+    /// Makes a range of reserved address space readable and writable. It is only backed by memory as it is first
+    /// touched. Returns false if the range couldn't be committed.
+    inline bool commit(char* memory, const size_t size) {
+        return mprotect(memory, size, PROT_READ | PROT_WRITE) == 0;
+    }
+    
+    /// Gives the memory behind a committed range back to the system and makes the range inaccessible again, while
+    /// keeping it reserved. The range is replaced by a fresh reserved mapping in a single call.
+    inline void decommit(char* memory, const size_t size) {
+        mmap(memory, size, PROT_NONE, reservedFlags() | MAP_FIXED, -1, 0);
+    }
+    
+    /// Releases a whole reservation, including anything committed in it.
+    inline void release(char* memory, const size_t size) {
+        munmap(memory, size);
+    }
+#else
+    inline size_t systemPageSize() {return 4096;}
+    inline char* reserve(const size_t size) {return nullptr;}
+    inline bool commit(char* memory, const size_t size) {return false;}
+    inline void decommit(char* memory, const size_t size) {}
+    inline void release(char* memory, const size_t size) {}
+#endif
+}
+
+#endif /* PageSources_h */
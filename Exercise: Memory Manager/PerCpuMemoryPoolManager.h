@@ -0,0 +1,223 @@
+//
+//  PerCpuMemoryPoolManager.h
+//  Exercise: Memory Manager
+//
+
+#ifndef PerCpuMemoryPoolManager_h
+#define PerCpuMemoryPoolManager_h
+
+#include "MemoryPoolManager.h"
+#include "PageSources.h"
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+/// Thread safe front end for MemoryPoolManager that caches blocks per CPU instead of per thread. Each CPU has a shard
+/// holding a list of available blocks, and calls use the shard of the CPU the calling thread runs on, found with
+/// sched_getcpu. Unlike ConcurrentMemoryPoolManager, whose every thread keeps its own magazines, the cached blocks are
+/// bounded by the number of shards however many threads use the pool, which suits thousands of threads on a few dozen
+/// cores.
+///
+/// A thread can be moved to another CPU between finding its shard and using it, so every shard has a lock. It is
+/// almost never contended, since only the threads running on one CPU use its shard. When a shard runs dry, it steals
+/// half of the blocks of the nearest neighbouring shard that has any, and otherwise takes a batch from the shared
+/// central pool. When a shard holds two batches and another block is freed, a batch is handed back to the central pool.
+/// On platforms without sched_getcpu, threads are spread over the shards by their id.
+template <class T, class PageSource = MallocPageSource>
+class PerCpuMemoryPoolManager {
+private:
+    /// Structure for building a linked list of cached blocks. Blocks from the underlying pool are always big enough to
+    /// hold a pointer.
+    struct Link {
+        Link* next;
+    };
+    
+    /// Cache of available blocks for one CPU, on its own cache lines so that CPUs don't share them. Shards are locked
+    /// with a spin lock instead of a mutex, since they are almost never contended, and unlocking one is then a plain
+    /// store. A thread that finds a shard locked yields while it waits, in case the holder was preempted.
+    struct alignas(64) Shard {
+        std::atomic<bool> locked{false};
+        Link* blocks = nullptr;
+        unsigned int count = 0;
+        
+        bool try_lock() {
+            return !locked.exchange(true, std::memory_order_acquire);
+        }
+        
+        void lock() {
+            while (!try_lock()) {
+                while (locked.load(std::memory_order_relaxed)) {
+                    std::this_thread::yield();
+                }
+            }
+        }
+        
+        void unlock() {
+            locked.store(false, std::memory_order_release);
+        }
+    };
+    
+    /// Number of neighbouring shards a dry shard tries to steal from before going to the central pool.
+    static constexpr unsigned int stealDistance = 4;
+    
+    const unsigned int _shardCount;
+    const unsigned int _batchSize;
+    std::unique_ptr<Shard[]> _shards;
+    
+    std::mutex _centralLock;
+    MemoryPoolManager<T, PageSource> _central;
+    
+    /// Batches that have been handed back by shards, each holding exactly batchSize blocks.
+    std::vector<Link*> _fullBatches;
+    
+    
+    /// Returns the number of shards to use when none is given, which is one per CPU.
+    static unsigned int defaultShardCount() {
+        return std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    
+    /// Returns the index of the shard for the CPU the calling thread is running on.
+    unsigned int currentShard() {
+#if defined(__linux__)
+        const int cpu = sched_getcpu();
+        if (cpu >= 0) {
+            return static_cast<unsigned int>(cpu) % _shardCount;
+        }
+#endif
+        return static_cast<unsigned int>(std::hash<std::thread::id>()(std::this_thread::get_id()) % _shardCount);
+    }
+    
+    /// Takes the given number of blocks off the front of a shard's list and returns them as a null terminated list.
+    /// @param shard The shard to take blocks from, which must be locked and hold at least count blocks.
+    /// @param count Number of blocks to take. Must not be zero.
+    static Link* takeBlocks(Shard& shard, const unsigned int count) {
+        Link* first = shard.blocks;
+        Link* last = first;
+        for (unsigned int i = 1; i < count; ++i) {
+            last = last->next;
+        }
+        shard.blocks = last->next;
+        shard.count -= count;
+        last->next = nullptr;
+        return first;
+    }
+    
+    /// Fills an empty shard, first by stealing from its neighbours and otherwise from the central pool. Neighbours are
+    /// only tried, never waited for, since the caller already holds the lock of its own shard.
+    /// @param shard The empty shard to fill, which must be locked.
+    /// @param index The index of the shard.
+    void refillShard(Shard& shard, const unsigned int index) {
+        const unsigned int neighbours = std::min(stealDistance, _shardCount - 1);
+        for (unsigned int i = 1; i <= neighbours; ++i) {
+            Shard& victim = _shards[(index + i) % _shardCount];
+            std::unique_lock<Shard> guard(victim, std::try_to_lock);
+            if (guard.owns_lock() && victim.count > 0) {
+                const unsigned int stolenCount = (victim.count + 1) / 2;
+                shard.blocks = takeBlocks(victim, stolenCount);
+                shard.count = stolenCount;
+                return;
+            }
+        }
+        
+        // no neighbour had blocks to spare, so take a batch from the central pool
+        std::lock_guard<std::mutex> guard(_centralLock);
+        if (!_fullBatches.empty()) {
+            shard.blocks = _fullBatches.back();
+            _fullBatches.pop_back();
+        }
+        else {
+            // no batches handed back, so build one from the underlying pool
+            for (unsigned int i = 0; i < _batchSize; ++i) {
+                Link* block = reinterpret_cast<Link*>(_central.allocateBlock());
+                block->next = shard.blocks;
+                shard.blocks = block;
+            }
+        }
+        shard.count = _batchSize;
+    }
+    
+public:
+    /// Constructor.
+    /// @param blocksPerPage Number of individual blocks of size T for each allocated page of memory. If this is zero,
+    ///     then an exception will be thrown.
+    /// @param batchSize Number of blocks a shard takes from or hands back to the central pool at a time. If this is
+    ///     zero, then an exception will be thrown.
+    /// @param shardCount Number of shards, or zero for one per CPU. CPUs share shards if there are fewer.
+    PerCpuMemoryPoolManager(const unsigned int blocksPerPage, const unsigned int batchSize = 32,
+                            const unsigned int shardCount = 0)
+    : _shardCount(shardCount == 0 ? defaultShardCount() : shardCount)
+    , _batchSize(batchSize)
+    , _shards(new Shard[_shardCount])
+    , _central(blocksPerPage) {
+        if (_batchSize == 0) {
+            throw MemoryPoolException(MemoryPoolException::invalidSizeMsg);
+        }
+    }
+    
+    PerCpuMemoryPoolManager(const PerCpuMemoryPoolManager&) = delete;
+    PerCpuMemoryPoolManager& operator=(const PerCpuMemoryPoolManager&) = delete;
+    
+    const unsigned int getShardCount() {return _shardCount;}
+    const unsigned int getBatchSize() {return _batchSize;}
+    const unsigned int getBlocksPerPage() {return _central.getBlocksPerPage();}
+    const size_t getNumberOfPages() {
+        std::lock_guard<std::mutex> guard(_centralLock);
+        return _central.getNumberOfPages();
+    }
+    
+    
+    /// Returns an available block from the shard of the current CPU, refilling the shard if it is empty. Safe to call
+    /// from any thread.
+    T* allocateBlock() {
+        const unsigned int index = currentShard();
+        Shard& shard = _shards[index];
+        std::lock_guard<Shard> guard(shard);
+        if (shard.count == 0) {
+            refillShard(shard, index);
+        }
+        
+        // pop block
+        Link* block = shard.blocks;
+        shard.blocks = block->next;
+        --shard.count;
+        return reinterpret_cast<T*>(block);
+    }
+    
+    /// Returns an allocated block back to the shard of the current CPU. If the shard already holds two batches, then
+    /// one batch is handed back to the central pool. Blocks may be freed from any thread.
+    /// @param block The block to free up.
+    void freeBlock(T* block) {
+        if (!block) {
+            return;
+        }
+        Link* overflow = nullptr;
+        {
+            Shard& shard = _shards[currentShard()];
+            std::lock_guard<Shard> guard(shard);
+            if (shard.count == 2 * _batchSize) {
+                overflow = takeBlocks(shard, _batchSize);
+            }
+            
+            // push block
+            Link* blockLink = reinterpret_cast<Link*>(block);
+            blockLink->next = shard.blocks;
+            shard.blocks = blockLink;
+            ++shard.count;
+        }
+        
+        // the shard's lock is released before taking the central pool's lock
+        if (overflow) {
+            std::lock_guard<std::mutex> guard(_centralLock);
+            _fullBatches.push_back(overflow);
+        }
+    }
+};
+
+#endif /* PerCpuMemoryPoolManager_h */
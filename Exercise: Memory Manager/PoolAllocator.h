@@ -0,0 +1,162 @@
+//
+//  PoolAllocator.h
+//  Exercise: Memory Manager
+//
+
+#ifndef PoolAllocator_h
+#define PoolAllocator_h
+
+#include "MemoryPoolManager.h"
+#include <cstddef>
+#include <limits>
+#include <map>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <typeindex>
+
+/// Set of Memory Managers, one for each type that is allocated through the allocators sharing the set. Managers are
+/// created the first time their type is allocated, and all of them share the same settings.
+class PoolSet {
+private:
+    const unsigned int _blocksPerPage;
+    const MemoryPoolOptions _options;
+    std::map<std::type_index, std::shared_ptr<void>> _pools;
+    
+public:
+    /// Constructor.
+    /// @param blocksPerPage Number of blocks for each allocated page of memory, for every manager in the set.
+    /// @param options Optional settings for every manager in the set.
+    PoolSet(const unsigned int blocksPerPage, const MemoryPoolOptions& options = MemoryPoolOptions())
+    : _blocksPerPage(blocksPerPage)
+    , _options(options) {}
+    
+    PoolSet(const PoolSet&) = delete;
+    PoolSet& operator=(const PoolSet&) = delete;
+    
+    const unsigned int getNumberOfPools() {return static_cast<unsigned int>(_pools.size());}
+    
+    /// Returns the manager for the given type, creating it if this is the first time it is needed.
+    template <class T>
+    MemoryPoolManager<T>& pool() {
+        std::shared_ptr<void>& entry = _pools[std::type_index(typeid(T))];
+        if (!entry) {
+            entry = std::make_shared<MemoryPoolManager<T>>(_blocksPerPage, _options);
+        }
+        return *static_cast<MemoryPoolManager<T>*>(entry.get());
+    }
+};
+
+/// Allocator that meets the C++ Allocator requirements, so that node based containers such as std::list, std::map,
+/// std::set and std::unordered_map can take their nodes from Memory Managers instead of the global heap. Single
+/// objects are allocated from the manager for their type. Arrays of more than one object, such as the bucket array of
+/// an unordered map, fall back to the global operator new, which is passed the alignment of over-aligned types.
+///
+/// Copies of an allocator, including copies rebound to other types, share the same set of managers and compare equal.
+/// Like MemoryPoolManager, it is not thread safe.
+template <class T>
+class PoolAllocator {
+private:
+    template <class U>
+    friend class PoolAllocator;
+    
+    std::shared_ptr<PoolSet> _pools;
+    
+    /// Manager for T within the set, looked up the first time it is needed.
+    MemoryPoolManager<T>* _pool;
+    
+    MemoryPoolManager<T>& pool() {
+        if (!_pool) {
+            _pool = &_pools->pool<T>();
+        }
+        return *_pool;
+    }
+    
+public:
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+    
+    template <class U>
+    struct rebind {
+        typedef PoolAllocator<U> other;
+    };
+    
+    /// Constructor. Creates a new set of managers.
+    /// @param blocksPerPage Number of blocks for each allocated page of memory. If this is zero, then an exception will
+    ///     be thrown when the first object is allocated.
+    /// @param options Optional settings for the managers.
+    explicit PoolAllocator(const unsigned int blocksPerPage = 1024,
+                           const MemoryPoolOptions& options = MemoryPoolOptions())
+    : _pools(std::make_shared<PoolSet>(blocksPerPage, options))
+    , _pool(nullptr) {}
+    
+    /// Constructor. Shares the managers of the given allocator.
+    /// @param pools The set of managers to allocate from.
+    explicit PoolAllocator(const std::shared_ptr<PoolSet>& pools)
+    : _pools(pools)
+    , _pool(nullptr) {}
+    
+    PoolAllocator(const PoolAllocator& other) noexcept
+    : _pools(other._pools)
+    , _pool(other._pool) {}
+    
+    /// Constructor for rebinding. Shares the managers of the given allocator.
+    template <class U>
+    PoolAllocator(const PoolAllocator<U>& other) noexcept
+    : _pools(other._pools)
+    , _pool(nullptr) {}
+    
+    PoolAllocator& operator=(const PoolAllocator& other) noexcept {
+        _pools = other._pools;
+        _pool = other._pool;
+        return *this;
+    }
+    
+    const std::shared_ptr<PoolSet>& getPools() const {return _pools;}
+    
+    /// Returns the largest number of objects that can be allocated at once.
+    std::size_t max_size() const noexcept {return std::numeric_limits<std::size_t>::max() / sizeof(T);}
+    
+    
+    /// Allocates memory for the given number of objects. A single object comes from the manager for T. If more objects
+    /// are asked for than max_size, then std::bad_array_new_length will be thrown.
+    /// @param n Number of objects.
+    T* allocate(const std::size_t n) {
+        if (n == 1) {
+            return pool().allocateBlock();
+        }
+        if (n > max_size()) {
+            throw std::bad_array_new_length();
+        }
+        if constexpr (alignof(T) > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+            return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(alignof(T))));
+        }
+        else {
+            return static_cast<T*>(::operator new(n * sizeof(T)));
+        }
+    }
+    
+    /// Frees memory allocated by this allocator or one equal to it.
+    /// @param block The memory to free.
+    /// @param n Number of objects the memory was allocated for.
+    void deallocate(T* block, const std::size_t n) {
+        if (n == 1) {
+            pool().freeBlock(block);
+        }
+        else if constexpr (alignof(T) > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+            ::operator delete(block, std::align_val_t(alignof(T)));
+        }
+        else {
+            ::operator delete(block);
+        }
+    }
+    
+    template <class U>
+    bool operator==(const PoolAllocator<U>& other) const {return _pools == other._pools;}
+    template <class U>
+    bool operator!=(const PoolAllocator<U>& other) const {return _pools != other._pools;}
+};
+
+#endif /* PoolAllocator_h */
@@ -0,0 +1,162 @@
+//
+//  SizeClassMemoryResource.h
+//  Exercise: Memory Manager
+//
+
+#ifndef SizeClassMemoryResource_h
+#define SizeClassMemoryResource_h
+
+#include "MemoryPoolManager.h"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <utility>
+
+/// Memory resource that serves allocations of varying sizes from a set of size classes, each backed by a Memory
+/// Manager of fixed size blocks. A request is rounded up to the smallest size class that fits it, so pmr containers
+/// and strings of any element type can share one set of pools. Requests larger than the largest size class, or with
+/// stricter alignment than std::max_align_t, are passed on to an upstream resource.
+///
+/// Each size class's manager is created the first time that size class is used. Like MemoryPoolManager, it is not
+/// thread safe.
+class SizeClassMemoryResource : public std::pmr::memory_resource {
+public:
+    /// Block sizes of the size classes. Sizes are spaced 16 bytes apart up to 128 bytes and then by quarter powers of
+    /// two, so a request never wastes more than about a fifth of its block.
+    static constexpr std::size_t sizeClasses[] = {
+        16, 32, 48, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 448, 512,
+        640, 768, 896, 1024, 1280, 1536, 1792, 2048, 2560, 3072, 3584, 4096
+    };
+    static constexpr std::size_t numberOfSizeClasses = sizeof(sizeClasses) / sizeof(sizeClasses[0]);
+    static constexpr std::size_t maxBlockSize = sizeClasses[numberOfSizeClasses - 1];
+    
+private:
+    /// Every size class is a multiple of this.
+    static constexpr std::size_t sizeGranularity = 16;
+    
+    /// Interface to the manager of a single size class.
+    class SizeClassPoolBase {
+    public:
+        virtual ~SizeClassPoolBase() {}
+        virtual void* allocate() = 0;
+        virtual void deallocate(void* block) = 0;
+    };
+    
+    /// Manager for blocks of the given size.
+    template <std::size_t Size>
+    class SizeClassPool : public SizeClassPoolBase {
+    private:
+        struct Block {
+            alignas(std::max_align_t) unsigned char data[Size];
+        };
+        
+        MemoryPoolManager<Block> _pool;
+    
+    public:
+        SizeClassPool(const unsigned int blocksPerPage, const MemoryPoolOptions& options)
+        : _pool(blocksPerPage, options) {}
+        
+        void* allocate() override {return _pool.allocateBlock();}
+        void deallocate(void* block) override {_pool.freeBlock(static_cast<Block*>(block));}
+    };
+    
+    typedef std::unique_ptr<SizeClassPoolBase> (*PoolFactory)(std::size_t, const MemoryPoolOptions&);
+    
+    /// Creates the manager for a size class, with pages of about the given number of bytes.
+    template <std::size_t Size>
+    static std::unique_ptr<SizeClassPoolBase> createPool(const std::size_t pageSize, const MemoryPoolOptions& options) {
+        const unsigned int blocksPerPage = static_cast<unsigned int>(std::max<std::size_t>(1, pageSize / Size));
+        return std::unique_ptr<SizeClassPoolBase>(new SizeClassPool<Size>(blocksPerPage, options));
+    }
+    
+    template <std::size_t... Index>
+    static constexpr std::array<PoolFactory, numberOfSizeClasses> poolFactories(std::index_sequence<Index...>) {
+        return {{&createPool<sizeClasses[Index]>...}};
+    }
+    
+    /// Returns the size class for each request size in steps of the size granularity.
+    static std::array<uint8_t, maxBlockSize / sizeGranularity + 1> sizeClassTable() {
+        std::array<uint8_t, maxBlockSize / sizeGranularity + 1> table{};
+        std::size_t sizeClass = 0;
+        for (std::size_t i = 0; i < table.size(); ++i) {
+            while (sizeClasses[sizeClass] < i * sizeGranularity) {
+                ++sizeClass;
+            }
+            table[i] = static_cast<uint8_t>(sizeClass);
+        }
+        return table;
+    }
+    
+    const std::size_t _pageSize;
+    const MemoryPoolOptions _options;
+    std::pmr::memory_resource* const _upstream;
+    std::array<std::unique_ptr<SizeClassPoolBase>, numberOfSizeClasses> _pools;
+    
+    /// Returns the index of the size class for the given size, which must be at most the largest size class.
+    static std::size_t sizeClassIndex(const std::size_t bytes) {
+        static const std::array<uint8_t, maxBlockSize / sizeGranularity + 1> table = sizeClassTable();
+        return table[(bytes + sizeGranularity - 1) / sizeGranularity];
+    }
+    
+    /// Returns true if the given request is served by a size class instead of the upstream resource.
+    static bool isPooled(const std::size_t bytes, const std::size_t alignment) {
+        return bytes <= maxBlockSize && alignment <= alignof(std::max_align_t);
+    }
+    
+protected:
+    void* do_allocate(const std::size_t bytes, const std::size_t alignment) override {
+        if (!isPooled(bytes, alignment)) {
+            return _upstream->allocate(bytes, alignment);
+        }
+        const std::size_t index = sizeClassIndex(bytes);
+        std::unique_ptr<SizeClassPoolBase>& pool = _pools[index];
+        if (!pool) {
+            static const std::array<PoolFactory, numberOfSizeClasses> factories =
+                poolFactories(std::make_index_sequence<numberOfSizeClasses>());
+            pool = factories[index](_pageSize, _options);
+        }
+        return pool->allocate();
+    }
+    
+    void do_deallocate(void* block, const std::size_t bytes, const std::size_t alignment) override {
+        if (!isPooled(bytes, alignment)) {
+            _upstream->deallocate(block, bytes, alignment);
+        }
+        else {
+            _pools[sizeClassIndex(bytes)]->deallocate(block);
+        }
+    }
+    
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+    
+public:
+    /// Constructor.
+    /// @param pageSize Approximate number of bytes in each page of memory allocated for a size class. Size classes
+    ///     larger than this get one block per page.
+    /// @param upstream Resource for requests that don't fit any size class.
+    /// @param options Optional settings for the manager of every size class.
+    explicit SizeClassMemoryResource(const std::size_t pageSize = 64 * 1024,
+                                     std::pmr::memory_resource* upstream = std::pmr::get_default_resource(),
+                                     const MemoryPoolOptions& options = MemoryPoolOptions())
+    : _pageSize(pageSize)
+    , _options(options)
+    , _upstream(upstream) {}
+    
+    SizeClassMemoryResource(const SizeClassMemoryResource&) = delete;
+    SizeClassMemoryResource& operator=(const SizeClassMemoryResource&) = delete;
+    
+    std::pmr::memory_resource* getUpstreamResource() const {return _upstream;}
+    
+    /// Returns the block size that requests of the given number of bytes are rounded up to, or zero if they are passed
+    /// to the upstream resource.
+    static std::size_t blockSizeFor(const std::size_t bytes) {
+        return bytes <= maxBlockSize ? sizeClasses[sizeClassIndex(bytes)] : 0;
+    }
+};
+
+#endif /* SizeClassMemoryResource_h */
@@ -7,14 +7,37 @@
 //
 
 #include <iostream>
+#include <string>
 #include "MemoryPoolManager.h"
 #include "test_cases.h"
 #include "profiling.h"
 
 int main(int argc, const char * argv[]) {
     std::cout << "Performing test cases for Memory Manager..." << std::endl << std::endl;
-    testMemoryManager();
+    const unsigned int failedTests = testMemoryManager();
     std::cout << std::endl;
+    
+    // with --tests, only the test cases are run, and the exit status tells if any failed
+    if (argc > 1 && std::string(argv[1]) == "--tests") {
+        return failedTests == 0 ? 0 : 1;
+    }
+    
     profileMemoryManger();
+    profileBatchAllocations();
+    profileLazyPageCarving();
+    profileReserve();
+    profileTrim();
+    profilePageSources();
+    profileFalseSharing();
+    profilePoolAllocator();
+    profileSizeClassMemoryResource();
+    profileHandles();
+    profileFullestPage();
+    profileLiveIteration();
+    profilePolicies();
+    profileStats();
+    profileConcurrentMemoryManager();
+    profileLockFreeMemoryManager();
+    profileValidatedFrees();
     return 0;
 }
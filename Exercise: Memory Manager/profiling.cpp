@@ -8,10 +8,35 @@
 
 #include "profiling.h"
 #include "MemoryPoolManager.h"
+#include "ConcurrentMemoryPoolManager.h"
+#include "LockFreeMemoryPoolManager.h"
+#include "PoolAllocator.h"
+#include "HandlePoolManager.h"
+#include "SizeClassMemoryResource.h"
+#include "MemoryPoolStats.h"
 #include <cstdlib>
+#include <algorithm>
 #include <chrono>
 #include <vector>
 #include <iostream>
+#include <mutex>
+#include <thread>
+#include <cstring>
+#include <list>
+#include <map>
+#include <memory_resource>
+#include <string>
+#include <unordered_map>
+#include <random>
+#include <limits>
+#include <utility>
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#elif defined(__linux__)
+#include <fstream>
+#include <malloc.h>
+#include <unistd.h>
+#endif
 
 template <class T>
 void performMalloc(const unsigned numberOfAllocations) {
@@ -25,10 +50,16 @@ void performMalloc(const unsigned numberOfAllocations) {
     free(blocks);
 }
 
-template <class T>
-void performMemoryManagerAllocations(const unsigned numberOfAllocations, const unsigned blocksPerPage) {
+/// Memory Manager with the default policies and the given modes.
+template <class T, class... Modes>
+using ModalPoolManager = MemoryPoolManager<T, MallocPageSource, DefaultValidationPolicy, SingleThreaded, NoStats,
+                                           PoolModes<Modes...>>;
+
+template <class T, class... Modes>
+void performMemoryManagerAllocations(const unsigned numberOfAllocations, const unsigned blocksPerPage,
+                                     const MemoryPoolOptions& options = MemoryPoolOptions()) {
     T** blocks = reinterpret_cast<T**>(malloc(sizeof(T*) * numberOfAllocations));
-    MemoryPoolManager<T> manager(blocksPerPage);
+    ModalPoolManager<T, Modes...> manager(blocksPerPage, options);
     for (int i = 0; i < numberOfAllocations; ++i) {
         blocks[i] = manager.allocateBlock();
     }
@@ -38,24 +69,567 @@ void performMemoryManagerAllocations(const unsigned numberOfAllocations, const u
     free(blocks);
 }
 
+template <class T>
+void performSingleBlockCalls(const unsigned numberOfAllocations, const unsigned batchSize, const unsigned blocksPerPage) {
+    T** blocks = reinterpret_cast<T**>(malloc(sizeof(T*) * batchSize));
+    MemoryPoolManager<T> manager(blocksPerPage);
+    for (unsigned n = 0; n < numberOfAllocations; n += batchSize) {
+        for (unsigned i = 0; i < batchSize; ++i) {
+            blocks[i] = manager.allocateBlock();
+        }
+        for (unsigned i = 0; i < batchSize; ++i) {
+            manager.freeBlock(blocks[i]);
+        }
+    }
+    free(blocks);
+}
+
+template <class T>
+void performBatchCalls(const unsigned numberOfAllocations, const unsigned batchSize, const unsigned blocksPerPage) {
+    T** blocks = reinterpret_cast<T**>(malloc(sizeof(T*) * batchSize));
+    MemoryPoolManager<T> manager(blocksPerPage);
+    for (unsigned n = 0; n < numberOfAllocations; n += batchSize) {
+        manager.allocateBlocks(blocks, batchSize);
+        manager.freeBlocks(blocks, batchSize);
+    }
+    free(blocks);
+}
+
+/// Object size used for latency profiling.
+struct ProfileObject {
+    char data[64];
+};
+
+/// Times every single call to allocateBlock while allocating the given number of blocks and returns the latencies
+/// in nanoseconds, sorted.
+template <class T, class... Modes>
+std::vector<double> measureAllocationLatencies(ModalPoolManager<T, Modes...>& manager,
+                                               const unsigned numberOfAllocations) {
+    std::vector<double> latencies(numberOfAllocations);
+    for (unsigned i = 0; i < numberOfAllocations; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        manager.allocateBlock();
+        auto end = std::chrono::steady_clock::now();
+        latencies[i] = std::chrono::duration<double, std::nano>(end - start).count();
+    }
+    std::sort(latencies.begin(), latencies.end());
+    return latencies;
+}
+
+/// Allocates blocks in requests of the given number of blocks, keeping all of them, and returns the latency of each
+/// request in nanoseconds, including the first write to every block, sorted. The given function is called between
+/// requests, outside of the timing.
+template <class T, class BetweenRequests, class... Modes>
+std::vector<double> measureRequestLatencies(ModalPoolManager<T, Modes...>& manager, const unsigned numberOfRequests,
+                                            const unsigned blocksPerRequest, BetweenRequests betweenRequests) {
+    std::vector<double> latencies(numberOfRequests);
+    for (unsigned request = 0; request < numberOfRequests; ++request) {
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned i = 0; i < blocksPerRequest; ++i) {
+            T* block = manager.allocateBlock();
+            memset(block, 0, sizeof(T));
+        }
+        auto end = std::chrono::steady_clock::now();
+        latencies[request] = std::chrono::duration<double, std::nano>(end - start).count();
+        betweenRequests();
+    }
+    std::sort(latencies.begin(), latencies.end());
+    return latencies;
+}
+
+/// Outputs percentiles of the given sorted latencies.
+void outputLatencyPercentiles(const char* label, const std::vector<double>& latencies) {
+    auto percentile = [&latencies](const double p) {
+        return latencies[std::min(latencies.size() - 1, static_cast<size_t>(p * latencies.size()))];
+    };
+    std::cout << label << ": p50 " << percentile(0.5) << " ns, p99 " << percentile(0.99) << " ns, p99.9 "
+              << percentile(0.999) << " ns, max " << latencies.back() << " ns" << std::endl;
+}
+
+/// Returns the resident set size of the process in bytes, or zero if it can't be determined on this platform.
+size_t currentResidentSetSize() {
+#if defined(__APPLE__)
+    mach_task_basic_info info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &count) == KERN_SUCCESS) {
+        return info.resident_size;
+    }
+    return 0;
+#elif defined(__linux__)
+    std::ifstream statm("/proc/self/statm");
+    size_t totalPages = 0;
+    size_t residentPages = 0;
+    statm >> totalPages >> residentPages;
+    return residentPages * sysconf(_SC_PAGESIZE);
+#else
+    return 0;
+#endif
+}
+
+/// Allocates and writes to the given number of blocks all at once, then frees them all, and outputs the resident set
+/// size of the process after the burst, after the blocks are freed, and after the pool has been left idle.
+template <class... Modes>
+void performBurstThenIdle(const char* label, const unsigned numberOfAllocations, const unsigned blocksPerPage,
+                          const MemoryPoolOptions& options, const bool trimWhenIdle) {
+    const double megabyte = 1024.0 * 1024.0;
+    const size_t baseline = currentResidentSetSize();
+    {
+        ModalPoolManager<ProfileObject, Modes...> manager(blocksPerPage, options);
+        std::vector<ProfileObject*> blocks(numberOfAllocations);
+        for (unsigned i = 0; i < numberOfAllocations; ++i) {
+            blocks[i] = manager.allocateBlock();
+            memset(blocks[i], 1, sizeof(ProfileObject));
+        }
+        const size_t afterBurst = currentResidentSetSize();
+        
+        for (unsigned i = 0; i < numberOfAllocations; ++i) {
+            manager.freeBlock(blocks[i]);
+        }
+        const size_t afterFree = currentResidentSetSize();
+        
+        if (trimWhenIdle) {
+            manager.trim();
+        }
+#if defined(__GLIBC__)
+        // glibc keeps freed heap memory around until asked to give it back, regardless of the pool
+        malloc_trim(0);
+#endif
+        const size_t afterIdle = currentResidentSetSize();
+        
+        std::cout << label << ": burst " << (afterBurst - baseline) / megabyte << " MB, freed "
+                  << (afterFree - baseline) / megabyte << " MB, idle " << (afterIdle - baseline) / megabyte << " MB ("
+                  << manager.getNumberOfPages() << " pages left)" << std::endl;
+    }
+}
+
+/// Block type for random access profiling. Each block fills a cache line and points to the next block to visit.
+struct ChaseNode {
+    ChaseNode* next;
+    char data[56];
+};
+
+/// Allocates the given number of blocks from pages of the given source and writes to each of them once, then links
+/// them into a single cycle in random order and follows it for the given number of steps. Outputs the time taken to
+/// allocate and first write to the blocks, which includes any page faults, and the average time of each random step,
+/// which is dominated by cache and TLB misses.
+template <class PageSource>
+void performRandomAccess(const char* label, const unsigned numberOfBlocks, const unsigned blocksPerPage,
+                         const unsigned steps) {
+    std::vector<ChaseNode*> blocks(numberOfBlocks);
+    
+    auto start = std::chrono::steady_clock::now();
+    MemoryPoolManager<ChaseNode, PageSource, DefaultValidationPolicy, SingleThreaded, NoStats,
+                      PoolModes<LazyPageCarving>> manager(blocksPerPage);
+    manager.allocateBlocks(blocks.data(), numberOfBlocks);
+    for (unsigned i = 0; i < numberOfBlocks; ++i) {
+        blocks[i]->next = nullptr;
+    }
+    auto end = std::chrono::steady_clock::now();
+    std::chrono::duration<double> firstTouch = end - start;
+    
+    std::shuffle(blocks.begin(), blocks.end(), std::mt19937(12345));
+    for (unsigned i = 0; i < numberOfBlocks; ++i) {
+        blocks[i]->next = blocks[(i + 1) % numberOfBlocks];
+    }
+    start = std::chrono::steady_clock::now();
+    ChaseNode* node = blocks[0];
+    for (unsigned i = 0; i < steps; ++i) {
+        node = node->next;
+    }
+    end = std::chrono::steady_clock::now();
+    std::chrono::duration<double, std::nano> randomAccess = end - start;
+    
+    std::cout << label << ": first touch " << firstTouch.count() << " s, random access "
+              << randomAccess.count() / steps << " ns per step" << (node ? "" : "?") << std::endl;
+}
+
+/// Allocates one counter block per thread from a single pool, then has every thread increment its own counter the
+/// given number of times at once. Returns the elapsed time in seconds.
+double timeCounterIncrements(const MemoryPoolOptions& options, const unsigned numberOfThreads,
+                             const unsigned increments) {
+    MemoryPoolManager<uint64_t> manager(numberOfThreads, options);
+    std::vector<uint64_t*> counters(numberOfThreads);
+    for (unsigned i = 0; i < numberOfThreads; ++i) {
+        counters[i] = manager.allocateBlock();
+        *counters[i] = 0;
+    }
+    
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < numberOfThreads; ++i) {
+        threads.emplace_back([&counters, i, increments]() {
+            volatile uint64_t* counter = counters[i];
+            for (unsigned n = 0; n < increments; ++n) {
+                *counter = *counter + 1;
+            }
+        });
+    }
+    for (auto i = threads.begin(); i != threads.end(); ++i) {
+        i->join();
+    }
+    auto end = std::chrono::steady_clock::now();
+    std::chrono::duration<double> diff = end - start;
+    return diff.count();
+}
+
+/// Inserts the given number of entries into the given map, then erases them all in a different order than they were
+/// inserted. Returns the elapsed time in seconds.
+template <class Map>
+double timeMapInsertErase(Map& map, const unsigned numberOfEntries) {
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < numberOfEntries; ++i) {
+        map.emplace(i * 7919u, i);
+    }
+    for (unsigned i = 0; i < numberOfEntries; ++i) {
+        map.erase(((i * 31u) % numberOfEntries) * 7919u);
+    }
+    auto end = std::chrono::steady_clock::now();
+    std::chrono::duration<double> diff = end - start;
+    return diff.count();
+}
+
+/// Pushes the given number of entries onto the given list, then erases every other one and then the rest. Returns the
+/// elapsed time in seconds.
+template <class List>
+double timeListInsertErase(List& list, const unsigned numberOfEntries) {
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < numberOfEntries; ++i) {
+        list.push_back(i);
+    }
+    for (auto i = list.begin(); i != list.end();) {
+        i = list.erase(i);
+        if (i != list.end()) {
+            ++i;
+        }
+    }
+    list.clear();
+    auto end = std::chrono::steady_clock::now();
+    std::chrono::duration<double> diff = end - start;
+    return diff.count();
+}
+
+/// Builds messages from the given resource over a number of rounds, each made of strings of varying lengths, vectors
+/// of varying sizes and map entries, then frees the round's memory. Returns the elapsed time in seconds.
+double timeMessageBuilding(std::pmr::memory_resource* resource, const unsigned rounds,
+                           const unsigned messagesPerRound) {
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned round = 0; round < rounds; ++round) {
+        std::pmr::map<unsigned, std::pmr::string> names(resource);
+        std::pmr::vector<std::pmr::vector<int>> payloads(resource);
+        for (unsigned i = 0; i < messagesPerRound; ++i) {
+            names.emplace(i, std::pmr::string(16 + (i * 37) % 200, 'x', resource));
+            payloads.emplace_back((i * 13) % 100, static_cast<int>(i));
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    std::chrono::duration<double> diff = end - start;
+    return diff.count();
+}
+
+/// Reads every block through the given references in order, a number of times over, and outputs the average time per
+/// dereference. Each reference is turned into a pointer with the given function.
+template <class Reference, class Dereference>
+void timeDereferences(const char* label, const std::vector<Reference>& references, const unsigned passes,
+                      Dereference dereference) {
+    uint64_t sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned pass = 0; pass < passes; ++pass) {
+        for (auto i = references.begin(); i != references.end(); ++i) {
+            sum += *dereference(*i);
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    std::chrono::duration<double, std::nano> diff = end - start;
+    std::cout << label << ": " << diff.count() / (static_cast<double>(passes) * references.size()) << " ns"
+              << (sum ? "" : "?") << std::endl;
+}
+
+/// Object with a position and velocity, as in a particle system that updates every live object each frame.
+struct Particle {
+    float position[3];
+    float velocity[3];
+};
+
+/// Moves a particle one step along its velocity.
+inline void updateParticle(Particle* particle) {
+    for (int i = 0; i < 3; ++i) {
+        particle->position[i] += particle->velocity[i] * 0.01f;
+    }
+}
+
+/// Returns the fastest time in nanoseconds per particle, out of several passes, for updating every particle once with
+/// the given update loop.
+template <class UpdateAll>
+double bestUpdateTime(const size_t numberOfParticles, const unsigned passes, UpdateAll updateAll) {
+    double best = std::numeric_limits<double>::max();
+    for (unsigned pass = 0; pass < passes; ++pass) {
+        auto start = std::chrono::steady_clock::now();
+        updateAll();
+        auto end = std::chrono::steady_clock::now();
+        std::chrono::duration<double, std::nano> diff = end - start;
+        best = std::min(best, diff.count() / numberOfParticles);
+    }
+    return best;
+}
+
+/// Times updating every live particle through a vector of pointers and through forEachLive.
+template <class Manager>
+void outputUpdateTimes(const char* label, Manager& manager, std::vector<Particle*>& particles, const unsigned passes) {
+    const double vectorTime = bestUpdateTime(particles.size(), passes, [&particles]() {
+        for (auto i = particles.begin(); i != particles.end(); ++i) {
+            updateParticle(*i);
+        }
+    });
+    const double poolTime = bestUpdateTime(particles.size(), passes, [&manager]() {
+        manager.forEachLive([](Particle* particle) { updateParticle(particle); });
+    });
+    std::cout << label << " (" << particles.size() << " live): vector of pointers " << vectorTime
+              << " ns, forEachLive " << poolTime << " ns per particle" << std::endl;
+}
+
+/// Returns the average number of distinct 4 KiB memory pages touched by each run of the given number of consecutive
+/// blocks, as a measure of how scattered consecutive allocations are in memory.
+template <class T>
+double averagePagesTouched(const std::vector<T*>& blocks, const size_t runLength) {
+    std::vector<uintptr_t> memoryPages;
+    size_t pagesTouched = 0;
+    size_t runs = 0;
+    for (size_t start = 0; start + runLength <= blocks.size(); start += runLength) {
+        memoryPages.clear();
+        for (size_t i = start; i < start + runLength; ++i) {
+            memoryPages.push_back(reinterpret_cast<uintptr_t>(blocks[i]) >> 12);
+        }
+        std::sort(memoryPages.begin(), memoryPages.end());
+        pagesTouched += std::unique(memoryPages.begin(), memoryPages.end()) - memoryPages.begin();
+        ++runs;
+    }
+    return runs ? static_cast<double>(pagesTouched) / runs : 0.0;
+}
+
+/// Allocates a peak number of blocks, frees most of them at random, and then runs rounds of steady churn where a random
+/// live block is freed and a new one allocated. Each round ends with a trim, and the output shows how densely the live
+/// blocks fill the pages that are left over time.
+template <class... Modes>
+void performLongChurn(const char* label) {
+    const unsigned blocksPerPage = 256;
+    const unsigned peakBlocks = 200000;
+    const unsigned liveBlocks = 50000;
+    const unsigned rounds = 20;
+    
+    ModalPoolManager<Particle, Modes...> manager(blocksPerPage);
+    std::mt19937 random(12345);
+    std::vector<Particle*> live(peakBlocks);
+    for (unsigned i = 0; i < peakBlocks; ++i) {
+        live[i] = manager.allocateBlock();
+    }
+    std::shuffle(live.begin(), live.end(), random);
+    for (unsigned i = liveBlocks; i < peakBlocks; ++i) {
+        manager.freeBlock(live[i]);
+    }
+    live.resize(liveBlocks);
+    
+    std::cout << label << ":" << std::endl;
+    size_t releasedPages = manager.trim();
+    double pagesTouched = 0.0;
+    std::vector<Particle*> allocated(liveBlocks);
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned round = 1; round <= rounds; ++round) {
+        for (unsigned i = 0; i < liveBlocks; ++i) {
+            const size_t index = random() % liveBlocks;
+            manager.freeBlock(live[index]);
+            live[index] = allocated[i] = manager.allocateBlock();
+            *live[index] = Particle{{0.0f, 0.0f, 0.0f}, {1.0f, 2.0f, 3.0f}};
+        }
+        pagesTouched += averagePagesTouched(allocated, 64);
+        releasedPages += manager.trim();
+        
+        if (round == 1 || round % 5 == 0) {
+            const double capacity = static_cast<double>(manager.getNumberOfPages()) * blocksPerPage;
+            std::cout << "  Round " << round << ": " << manager.getNumberOfPages() << " pages ("
+                      << 100.0 * liveBlocks / capacity << "% occupied)" << std::endl;
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    std::chrono::duration<double> diff = end - start;
+    std::cout << "  " << diff.count() << " s, " << releasedPages << " pages released by trim, "
+              << pagesTouched / rounds << " memory pages touched per 64 consecutive allocations" << std::endl;
+}
+
+/// Copy of the Memory Manager from before policies, without validation, used as the baseline that the policy free
+/// Memory Manager is compared against. Pages and blocks are laid out, linked and handed out exactly as they were.
+template <class T>
+class ReferenceFreeListPool {
+private:
+    struct Link {
+        Link* next;
+    };
+    
+    const unsigned int _blocksPerPage;
+    const unsigned int _blockSize;
+    Link* _memoryPages;
+    Link* _availableBlocks;
+    unsigned int _numberOfPages;
+    unsigned int _blocksRemaining;
+    
+    void allocatePage() {
+        unsigned pageAllocationSize = sizeof(Link) + _blockSize * _blocksPerPage;
+        Link* page = reinterpret_cast<Link*>(malloc(pageAllocationSize));
+        page->next = _memoryPages;
+        _memoryPages = page;
+        
+        Link* block;
+        char* pos = reinterpret_cast<char*>(page) + sizeof(Link);
+        for (unsigned int i = 0; i < _blocksPerPage; ++i) {
+            block = reinterpret_cast<Link*>(pos);
+            block->next = _availableBlocks;
+            _availableBlocks = block;
+            pos += _blockSize;
+        }
+        ++_numberOfPages;
+        _blocksRemaining += _blocksPerPage;
+    }
+    
+public:
+    ReferenceFreeListPool(const unsigned int blocksPerPage)
+    : _blocksPerPage(blocksPerPage)
+    , _blockSize(std::max(sizeof(T), sizeof(void*)))
+    , _memoryPages(nullptr)
+    , _availableBlocks(nullptr)
+    , _numberOfPages(0)
+    , _blocksRemaining(0) {
+        allocatePage();
+    }
+    
+    ~ReferenceFreeListPool() {
+        Link* pList = _memoryPages;
+        Link* pageToDealloc;
+        while (pList) {
+            pageToDealloc = pList;
+            pList = pList->next;
+            free(pageToDealloc);
+        }
+    }
+    
+    T* allocateBlock() {
+        if (!_availableBlocks) {
+            allocatePage();
+        }
+        Link* block = _availableBlocks;
+        _availableBlocks = block->next;
+        --_blocksRemaining;
+        return reinterpret_cast<T*>(block);
+    }
+    
+    void freeBlock(T* block) {
+        if (block) {
+            Link* blockLink = reinterpret_cast<Link*>(block);
+            blockLink->next = _availableBlocks;
+            _availableBlocks = blockLink;
+            ++_blocksRemaining;
+        }
+    }
+};
+
+/// Returns the fastest time in nanoseconds per operation, out of several runs, for repeatedly allocating a round of
+/// blocks from a new manager of the given type and freeing them again.
+template <class T, class Manager>
+double bestChurnTime(const unsigned blocksPerPage, const unsigned rounds, const unsigned blocksPerRound) {
+    double best = std::numeric_limits<double>::max();
+    std::vector<T*> blocks(blocksPerRound);
+    for (int run = 0; run < 5; ++run) {
+        Manager manager(blocksPerPage);
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned r = 0; r < rounds; ++r) {
+            for (unsigned i = 0; i < blocksPerRound; ++i) {
+                blocks[i] = manager.allocateBlock();
+            }
+            for (unsigned i = 0; i < blocksPerRound; ++i) {
+                manager.freeBlock(blocks[i]);
+            }
+        }
+        auto end = std::chrono::steady_clock::now();
+        std::chrono::duration<double, std::nano> diff = end - start;
+        best = std::min(best, diff.count() / (2.0 * rounds * blocksPerRound));
+    }
+    return best;
+}
+
+/// Memory Manager shared between threads by guarding every call with a single mutex.
+template <class T>
+using MutexMemoryPoolManager = MemoryPoolManager<T, MallocPageSource, DefaultValidationPolicy, MutexThreading>;
+
+/// Each thread repeatedly allocates a batch of blocks from the shared manager and then frees them all.
+template <class T, class Manager>
+void performSharedAllocations(Manager& manager, const unsigned rounds, const unsigned blocksPerRound) {
+    std::vector<T*> blocks(blocksPerRound);
+    for (unsigned r = 0; r < rounds; ++r) {
+        for (unsigned i = 0; i < blocksPerRound; ++i) {
+            blocks[i] = manager.allocateBlock();
+        }
+        for (unsigned i = 0; i < blocksPerRound; ++i) {
+            manager.freeBlock(blocks[i]);
+        }
+    }
+}
+
+/// Runs performSharedAllocations on the given number of threads at once against the same manager, and returns the
+/// elapsed time in seconds.
+template <class T, class Manager>
+double timeSharedAllocations(Manager& manager,
+                             const unsigned numberOfThreads,
+                             const unsigned rounds,
+                             const unsigned blocksPerRound) {
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned t = 0; t < numberOfThreads; ++t) {
+        threads.emplace_back([&manager, rounds, blocksPerRound]() {
+            performSharedAllocations<T>(manager, rounds, blocksPerRound);
+        });
+    }
+    for (auto i = threads.begin(); i != threads.end(); ++i) {
+        i->join();
+    }
+    auto end = std::chrono::steady_clock::now();
+    std::chrono::duration<double> diff = end - start;
+    return diff.count();
+}
+
+/// Outputs the time and throughput (allocations plus frees per second) of a multi-threaded run.
+void outputThroughput(const char* label, const unsigned numberOfThreads, const double seconds, const double operations) {
+    std::cout << label << " with " << numberOfThreads << " threads: " << seconds << " s ("
+              << operations / seconds / 1000000.0 << " M ops/s)" << std::endl;
+}
+
 template <class T>
 void profileMemoryManagerAllocations(const unsigned numberOfAllocations, const std::vector<unsigned> blocksPerPage) {
     std::cout << ">>> Profiling with " << numberOfAllocations << " allocations <<<" << std::endl;
     std::cout << "Malloc: ";
-    auto start = std::chrono::system_clock::now();
+    auto start = std::chrono::steady_clock::now();
     performMalloc<T>(numberOfAllocations);
-    auto end = std::chrono::system_clock::now();
+    auto end = std::chrono::steady_clock::now();
     std::chrono::duration<double> diff = end - start;
     std::cout << diff.count() << " s" << std::endl;
     
     for (auto i = blocksPerPage.begin(); i != blocksPerPage.end(); ++i) {
         std::cout << "Memory Manager with " << *i << " blocks per page: ";
-        start = std::chrono::system_clock::now();
+        start = std::chrono::steady_clock::now();
         performMemoryManagerAllocations<T>(numberOfAllocations, *i);
-        end = std::chrono::system_clock::now();
+        end = std::chrono::steady_clock::now();
         diff = end - start;
         std::cout << diff.count() << " s" << std::endl;
     }
+    
+    // start at the smallest page size and double up to the largest
+    MemoryPoolOptions options;
+    options.pageGrowthFactor = 2;
+    options.maxBlocksPerPage = blocksPerPage.back();
+    std::cout << "Memory Manager growing from " << blocksPerPage.front() << " to " << blocksPerPage.back()
+              << " blocks per page: ";
+    start = std::chrono::steady_clock::now();
+    performMemoryManagerAllocations<T, GrowingPages>(numberOfAllocations, blocksPerPage.front(), options);
+    end = std::chrono::steady_clock::now();
+    diff = end - start;
+    std::cout << diff.count() << " s" << std::endl;
 }
 
 void profileMemoryManger() {
@@ -74,3 +648,420 @@ void profileMemoryManger() {
     blocksPerPage.clear();
     std::cout << std::endl;
 }
+
+void profilePageSources() {
+    const unsigned numberOfBlocks = 1 << 20;
+    const unsigned blocksPerPage = numberOfBlocks / 4;
+    const unsigned steps = 10000000;
+    
+    std::cout << ">>> Profiling random access across " << numberOfBlocks << " blocks of " << sizeof(ChaseNode)
+              << " bytes <<<" << std::endl;
+    performRandomAccess<MallocPageSource>("Malloc pages", numberOfBlocks, blocksPerPage, steps);
+#if defined(__unix__) || defined(__APPLE__)
+    performRandomAccess<MmapPageSource<>>("Mmap pages", numberOfBlocks, blocksPerPage, steps);
+    performRandomAccess<MmapPageSource<true>>("Prefaulted mmap pages", numberOfBlocks, blocksPerPage, steps);
+    performRandomAccess<TransparentHugePageSource<>>("Transparent huge pages", numberOfBlocks, blocksPerPage, steps);
+    performRandomAccess<TransparentHugePageSource<true>>("Prefaulted transparent huge pages", numberOfBlocks,
+                                                         blocksPerPage, steps);
+    performRandomAccess<HugeTlbPageSource<true>>("Huge TLB pages", numberOfBlocks, blocksPerPage, steps);
+#endif
+    std::cout << std::endl;
+}
+
+void profileFalseSharing() {
+    const unsigned increments = 50000000;
+    const unsigned maxThreads = std::min(8u, std::max(2u, std::thread::hardware_concurrency()));
+    
+    std::cout << ">>> Profiling false sharing with " << increments << " counter increments per thread <<<"
+              << std::endl;
+    for (unsigned threads = 2; threads <= maxThreads; threads *= 2) {
+        MemoryPoolOptions options;
+        std::cout << "Packed blocks with " << threads << " threads: "
+                  << timeCounterIncrements(options, threads, increments) << " s" << std::endl;
+        options.cacheLineAligned = true;
+        std::cout << "Cache line aligned blocks with " << threads << " threads: "
+                  << timeCounterIncrements(options, threads, increments) << " s" << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+void profilePoolAllocator() {
+    const unsigned numberOfEntries = 1000000;
+    const unsigned blocksPerPage = 4096;
+    typedef std::pair<const unsigned, unsigned> Entry;
+    
+    std::cout << ">>> Profiling containers inserting and erasing " << numberOfEntries << " entries <<<" << std::endl;
+    {
+        std::map<unsigned, unsigned> map;
+        std::cout << "std::map with std::allocator: " << timeMapInsertErase(map, numberOfEntries) << " s" << std::endl;
+        std::map<unsigned, unsigned, std::less<unsigned>, PoolAllocator<Entry>> poolMap{
+            std::less<unsigned>(), PoolAllocator<Entry>(blocksPerPage)};
+        std::cout << "std::map with PoolAllocator: " << timeMapInsertErase(poolMap, numberOfEntries) << " s"
+                  << std::endl;
+    }
+    {
+        std::unordered_map<unsigned, unsigned> map;
+        std::cout << "std::unordered_map with std::allocator: " << timeMapInsertErase(map, numberOfEntries) << " s"
+                  << std::endl;
+        std::unordered_map<unsigned, unsigned, std::hash<unsigned>, std::equal_to<unsigned>, PoolAllocator<Entry>>
+            poolMap{0, std::hash<unsigned>(), std::equal_to<unsigned>(), PoolAllocator<Entry>(blocksPerPage)};
+        std::cout << "std::unordered_map with PoolAllocator: " << timeMapInsertErase(poolMap, numberOfEntries) << " s"
+                  << std::endl;
+    }
+    {
+        std::list<unsigned> list;
+        std::cout << "std::list with std::allocator: " << timeListInsertErase(list, numberOfEntries) << " s"
+                  << std::endl;
+        std::list<unsigned, PoolAllocator<unsigned>> poolList{PoolAllocator<unsigned>(blocksPerPage)};
+        std::cout << "std::list with PoolAllocator: " << timeListInsertErase(poolList, numberOfEntries) << " s"
+                  << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+void profileSizeClassMemoryResource() {
+    const unsigned rounds = 100;
+    const unsigned messagesPerRound = 10000;
+    
+    std::cout << ">>> Profiling pmr containers building " << rounds * messagesPerRound << " messages <<<" << std::endl;
+    std::cout << "new_delete_resource: "
+              << timeMessageBuilding(std::pmr::new_delete_resource(), rounds, messagesPerRound) << " s" << std::endl;
+    {
+        std::pmr::unsynchronized_pool_resource resource;
+        std::cout << "unsynchronized_pool_resource: " << timeMessageBuilding(&resource, rounds, messagesPerRound)
+                  << " s" << std::endl;
+    }
+    {
+        SizeClassMemoryResource resource;
+        std::cout << "SizeClassMemoryResource: " << timeMessageBuilding(&resource, rounds, messagesPerRound) << " s"
+                  << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+void profileHandles() {
+    const unsigned numberOfBlocks = 1000000;
+    const unsigned blocksPerPage = 4096;
+    const unsigned passes = 10;
+    
+    std::cout << ">>> Profiling dereferences of " << numberOfBlocks << " blocks <<<" << std::endl;
+    MemoryPoolManager<uint64_t> manager(blocksPerPage);
+    HandlePoolManager<uint64_t> handleManager(blocksPerPage);
+    std::vector<uint64_t*> pointers(numberOfBlocks);
+    std::vector<PoolHandle> handles(numberOfBlocks);
+    for (unsigned i = 0; i < numberOfBlocks; ++i) {
+        pointers[i] = manager.allocateBlock();
+        *pointers[i] = i + 1;
+        handles[i] = handleManager.allocateHandle();
+        *handleManager.resolve(handles[i]) = i + 1;
+    }
+    
+    auto pointerDereference = [](uint64_t* pointer) { return pointer; };
+    auto handleDereference = [&handleManager](const PoolHandle handle) { return handleManager.resolve(handle); };
+    timeDereferences("Raw pointers in allocation order", pointers, passes, pointerDereference);
+    timeDereferences("Handles in allocation order", handles, passes, handleDereference);
+    std::shuffle(pointers.begin(), pointers.end(), std::mt19937(12345));
+    std::shuffle(handles.begin(), handles.end(), std::mt19937(12345));
+    timeDereferences("Raw pointers in random order", pointers, passes, pointerDereference);
+    timeDereferences("Handles in random order", handles, passes, handleDereference);
+    std::cout << std::endl;
+}
+
+void profileFullestPage() {
+    std::cout << ">>> Profiling page occupancy under long churn <<<" << std::endl;
+    performLongChurn("Single list of available blocks");
+    performLongChurn<PreferFullestPage>("Fullest page first");
+    std::cout << std::endl;
+}
+
+void profileLiveIteration() {
+    const unsigned numberOfParticles = 1000000;
+    const unsigned blocksPerPage = 4096;
+    const unsigned passes = 10;
+    
+    std::cout << ">>> Profiling updates of every live particle <<<" << std::endl;
+    MemoryPoolManager<Particle, MallocPageSource, OccupancyTracking> manager(blocksPerPage);
+    std::vector<Particle*> particles(numberOfParticles);
+    for (unsigned i = 0; i < numberOfParticles; ++i) {
+        particles[i] = manager.allocateBlock();
+        *particles[i] = Particle{{0.0f, 0.0f, 0.0f}, {1.0f, 2.0f, 3.0f}};
+    }
+    outputUpdateTimes("All allocated", manager, particles, passes);
+    
+    // particles die at random and new ones reuse their blocks, as they would over many frames, which scatters the
+    // vector of pointers
+    std::mt19937 random(12345);
+    for (unsigned round = 0; round < 4; ++round) {
+        const size_t dying = particles.size() / 2;
+        for (size_t i = 0; i < dying; ++i) {
+            const size_t index = random() % particles.size();
+            manager.freeBlock(particles[index]);
+            particles[index] = particles.back();
+            particles.pop_back();
+        }
+        for (size_t i = 0; i < dying * 3 / 4; ++i) {
+            particles.push_back(manager.allocateBlock());
+            *particles.back() = Particle{{0.0f, 0.0f, 0.0f}, {1.0f, 2.0f, 3.0f}};
+        }
+    }
+    outputUpdateTimes("After churn", manager, particles, passes);
+    std::cout << std::endl;
+}
+
+void profilePolicies() {
+    const unsigned blocksPerPage = 1000;
+    const unsigned rounds = 1000;
+    const unsigned blocksPerRound = 1000;
+    typedef MemoryPoolManager<int, MallocPageSource, NoValidation, SingleThreaded, NoStats> PolicyFreeManager;
+    
+    std::cout << ">>> Profiling policy overhead (" << rounds * blocksPerRound << " allocations, best of 5) <<<"
+              << std::endl;
+    const double reference = bestChurnTime<int, ReferenceFreeListPool<int>>(blocksPerPage, rounds, blocksPerRound);
+    std::cout << "Reference free list: " << reference << " ns per operation" << std::endl;
+    std::vector<std::pair<const char*, double>> times{
+        {"No policies", bestChurnTime<int, PolicyFreeManager>(blocksPerPage, rounds, blocksPerRound)},
+        {"No policies, constant blocks per page", bestChurnTime<int,
+            MemoryPoolManager<int, MallocPageSource, NoValidation, SingleThreaded, NoStats, PoolModes<>,
+                              blocksPerPage>>(blocksPerPage, rounds, blocksPerRound)},
+        {"Counting stats", bestChurnTime<int,
+            MemoryPoolManager<int, MallocPageSource, NoValidation, SingleThreaded, CountingStats>>(
+                blocksPerPage, rounds, blocksPerRound)},
+        {"Mutex threading", bestChurnTime<int,
+            MemoryPoolManager<int, MallocPageSource, NoValidation, MutexThreading>>(
+                blocksPerPage, rounds, blocksPerRound)},
+        {"Full validation", bestChurnTime<int, MemoryPoolManager<int, MallocPageSource, FullValidation>>(
+            blocksPerPage, rounds, blocksPerRound)}
+    };
+    for (auto i = times.begin(); i != times.end(); ++i) {
+        std::cout << i->first << ": " << i->second << " ns per operation (" << i->second / reference
+                  << "x reference)" << std::endl;
+    }
+    std::cout << "Manager size with no policies: " << sizeof(PolicyFreeManager) << " bytes" << std::endl;
+    std::cout << std::endl;
+}
+
+void profileStats() {
+    const unsigned blocksPerPage = 1000;
+    const unsigned rounds = 1000;
+    const unsigned blocksPerRound = 1000;
+    
+    std::cout << ">>> Profiling stats overhead (" << rounds * blocksPerRound << " allocations, best of 5) <<<"
+              << std::endl;
+    std::vector<std::pair<const char*, double>> times{
+        {"No stats", bestChurnTime<int, MemoryPoolManager<int, MallocPageSource, NoValidation, SingleThreaded,
+            NoStats>>(blocksPerPage, rounds, blocksPerRound)},
+        {"Counting stats", bestChurnTime<int, MemoryPoolManager<int, MallocPageSource, NoValidation, SingleThreaded,
+            CountingStats>>(blocksPerPage, rounds, blocksPerRound)},
+        {"Detailed stats, 1 in 64 timed", bestChurnTime<int, MemoryPoolManager<int, MallocPageSource, NoValidation,
+            SingleThreaded, DetailedStats<64>>>(blocksPerPage, rounds, blocksPerRound)},
+        {"Detailed stats, all timed", bestChurnTime<int, MemoryPoolManager<int, MallocPageSource, NoValidation,
+            SingleThreaded, DetailedStats<1>>>(blocksPerPage, rounds, blocksPerRound)},
+        {"Thread sharded stats, 1 in 64 timed", bestChurnTime<int, MemoryPoolManager<int, MallocPageSource,
+            NoValidation, SingleThreaded, DetailedStats<64, true>>>(blocksPerPage, rounds, blocksPerRound)}
+    };
+    for (auto i = times.begin(); i != times.end(); ++i) {
+        std::cout << i->first << ": " << i->second << " ns per operation" << std::endl;
+    }
+    
+    // the pool's mutex serializes the calls, so this shows what the stats add on top of the lock
+    const unsigned maxThreads = std::max(4u, std::thread::hardware_concurrency());
+    for (unsigned threads = 1; threads <= maxThreads; threads *= 2) {
+        const double operations = 2.0 * threads * rounds * blocksPerRound / 10;
+        
+        MemoryPoolManager<int, MallocPageSource, NoValidation, MutexThreading, CountingStats> countingManager(
+            blocksPerPage);
+        double seconds = timeSharedAllocations<int>(countingManager, threads, rounds / 10, blocksPerRound);
+        outputThroughput("Mutex, counting stats", threads, seconds, operations);
+        
+        MemoryPoolManager<int, MallocPageSource, NoValidation, MutexThreading, DetailedStats<64, true>>
+            shardedManager(blocksPerPage);
+        seconds = timeSharedAllocations<int>(shardedManager, threads, rounds / 10, blocksPerRound);
+        outputThroughput("Mutex, thread sharded stats", threads, seconds, operations);
+    }
+    
+    // snapshot of a pool that grows a few times
+    MemoryPoolOptions options;
+    options.pageGrowthFactor = 2;
+    MemoryPoolManager<int, MallocPageSource, NoValidation, SingleThreaded, DetailedStats<16>, PoolModes<GrowingPages>>
+        manager(1000, options);
+    std::vector<int*> blocks;
+    for (int i = 0; i < 20000; ++i) {
+        blocks.push_back(manager.allocateBlock());
+    }
+    for (int i = 0; i < 15000; ++i) {
+        manager.freeBlock(blocks[i]);
+    }
+    PoolStatsSnapshot stats = manager.getStats().snapshot();
+    std::cout << "Snapshot after 20000 allocations and 15000 frees:" << std::endl << stats.toText();
+    std::cout << "p50 " << stats.getLatencyPercentile(0.5) << " ns, p99 " << stats.getLatencyPercentile(0.99)
+              << " ns" << std::endl;
+    std::cout << std::endl;
+}
+
+void profileConcurrentMemoryManager() {
+    const unsigned blocksPerPage = 1000;
+    const unsigned rounds = 2000;
+    const unsigned blocksPerRound = 100;
+    const unsigned maxThreads = std::max(4u, std::thread::hardware_concurrency());
+    
+    std::cout << ">>> Profiling multi-threaded allocations (" << rounds * blocksPerRound
+              << " allocations per thread) <<<" << std::endl;
+    for (unsigned threads = 1; threads <= maxThreads; threads *= 2) {
+        const double operations = 2.0 * threads * rounds * blocksPerRound;
+        
+        MutexMemoryPoolManager<int> mutexManager(blocksPerPage);
+        double seconds = timeSharedAllocations<int>(mutexManager, threads, rounds, blocksPerRound);
+        outputThroughput("Mutex Memory Manager", threads, seconds, operations);
+        
+        ConcurrentMemoryPoolManager<int> concurrentManager(blocksPerPage);
+        seconds = timeSharedAllocations<int>(concurrentManager, threads, rounds, blocksPerRound);
+        outputThroughput("Concurrent Memory Manager", threads, seconds, operations);
+    }
+    std::cout << std::endl;
+}
+
+void profileLockFreeMemoryManager() {
+    const unsigned blocksPerPage = 1000;
+    const unsigned rounds = 200;
+    const unsigned blocksPerRound = 100;
+    
+    std::cout << ">>> Profiling contended allocations (" << rounds * blocksPerRound
+              << " allocations per thread) <<<" << std::endl;
+    for (unsigned threads = 2; threads <= 64; threads *= 2) {
+        const double operations = 2.0 * threads * rounds * blocksPerRound;
+        
+        MutexMemoryPoolManager<int> mutexManager(blocksPerPage);
+        double seconds = timeSharedAllocations<int>(mutexManager, threads, rounds, blocksPerRound);
+        outputThroughput("Mutex Memory Manager", threads, seconds, operations);
+        
+        LockFreeMemoryPoolManager<int> lockFreeManager(blocksPerPage);
+        seconds = timeSharedAllocations<int>(lockFreeManager, threads, rounds, blocksPerRound);
+        outputThroughput("Lock-Free Memory Manager", threads, seconds, operations);
+    }
+    std::cout << std::endl;
+}
+
+void profileValidatedFrees() {
+    const unsigned blocksPerPage = 1000;
+    const unsigned measuredFrees = 1000;
+    std::vector<unsigned> poolSizes{10000, 100000, 1000000, 4000000};
+    
+    std::cout << ">>> Profiling validated frees (" << measuredFrees << " frees) <<<" << std::endl;
+    for (auto size = poolSizes.begin(); size != poolSizes.end(); ++size) {
+        MemoryPoolManager<int, MallocPageSource, FullValidation> manager(blocksPerPage);
+        std::vector<int*> blocks(*size);
+        for (unsigned i = 0; i < *size; ++i) {
+            blocks[i] = manager.allocateBlock();
+        }
+        
+        // free every other block first so the list of available blocks is as large as the pool
+        for (unsigned i = 0; i < *size; i += 2) {
+            manager.freeBlock(blocks[i]);
+        }
+        
+        // then time freeing a run of the remaining blocks from the middle of the pool
+        const unsigned firstBlock = *size / 2 + 1;
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned i = 0; i < measuredFrees; ++i) {
+            manager.freeBlock(blocks[firstBlock + i * 2]);
+        }
+        auto end = std::chrono::steady_clock::now();
+        std::chrono::duration<double> diff = end - start;
+        std::cout << "Validated frees with " << *size << " blocks (" << manager.getNumberOfPages() << " pages): "
+                  << diff.count() << " s (" << diff.count() / measuredFrees * 1e9 << " ns per free)" << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+void profileBatchAllocations() {
+    const unsigned numberOfAllocations = 1000000;
+    const unsigned blocksPerPage = 1000;
+    std::vector<unsigned> batchSizes{8, 32, 128};
+    
+    std::cout << ">>> Profiling batched allocations (" << numberOfAllocations << " allocations) <<<" << std::endl;
+    for (auto i = batchSizes.begin(); i != batchSizes.end(); ++i) {
+        std::cout << "Single calls in groups of " << *i << ": ";
+        auto start = std::chrono::steady_clock::now();
+        performSingleBlockCalls<int>(numberOfAllocations, *i, blocksPerPage);
+        auto end = std::chrono::steady_clock::now();
+        std::chrono::duration<double> diff = end - start;
+        std::cout << diff.count() << " s" << std::endl;
+        
+        std::cout << "Batch calls of " << *i << ": ";
+        start = std::chrono::steady_clock::now();
+        performBatchCalls<int>(numberOfAllocations, *i, blocksPerPage);
+        end = std::chrono::steady_clock::now();
+        diff = end - start;
+        std::cout << diff.count() << " s" << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+void profileLazyPageCarving() {
+    const unsigned numberOfAllocations = 1000000;
+    const unsigned blocksPerPage = 50000;
+    
+    std::cout << ">>> Profiling allocateBlock latency (" << numberOfAllocations << " allocations, " << blocksPerPage
+              << " blocks per page) <<<" << std::endl;
+    {
+        MemoryPoolManager<ProfileObject> manager(blocksPerPage);
+        outputLatencyPercentiles("Linked pages", measureAllocationLatencies(manager, numberOfAllocations));
+    }
+    {
+        ModalPoolManager<ProfileObject, LazyPageCarving> manager(blocksPerPage);
+        outputLatencyPercentiles("Lazily carved pages", measureAllocationLatencies(manager, numberOfAllocations));
+    }
+    std::cout << std::endl;
+}
+
+void profileReserve() {
+    const unsigned numberOfRequests = 1000;
+    const unsigned blocksPerRequest = 1000;
+    const unsigned blocksPerPage = 50000;
+    auto nothing = []() {};
+    
+    std::cout << ">>> Profiling request latency growing the pool ahead of time (" << numberOfRequests
+              << " requests of " << blocksPerRequest << " allocations, " << blocksPerPage << " blocks per page) <<<"
+              << std::endl;
+    {
+        MemoryPoolManager<ProfileObject> manager(blocksPerPage);
+        outputLatencyPercentiles("Growing on demand",
+                                 measureRequestLatencies(manager, numberOfRequests, blocksPerRequest, nothing));
+    }
+    {
+        ModalPoolManager<ProfileObject, LazyPageCarving> manager(blocksPerPage);
+        outputLatencyPercentiles("Lazily carved pages",
+                                 measureRequestLatencies(manager, numberOfRequests, blocksPerRequest, nothing));
+    }
+    {
+        MemoryPoolManager<ProfileObject> manager(blocksPerPage);
+        manager.reserve(numberOfRequests * blocksPerRequest);
+        outputLatencyPercentiles("Reserved up front",
+                                 measureRequestLatencies(manager, numberOfRequests, blocksPerRequest, nothing));
+    }
+    {
+        MemoryPoolOptions options;
+        options.lowWatermark = blocksPerRequest;
+        MemoryPoolManager<ProfileObject> manager(blocksPerPage, options);
+        manager.maintain();
+        outputLatencyPercentiles("Maintained between requests",
+                                 measureRequestLatencies(manager, numberOfRequests, blocksPerRequest,
+                                                         [&manager]() { manager.maintain(); }));
+    }
+    std::cout << std::endl;
+}
+
+void profileTrim() {
+    const unsigned numberOfAllocations = 1000000;
+    const unsigned blocksPerPage = 10000;
+    
+    std::cout << ">>> Profiling resident memory after a burst of " << numberOfAllocations << " allocations <<<"
+              << std::endl;
+    MemoryPoolOptions options;
+    performBurstThenIdle("No trimming", numberOfAllocations, blocksPerPage, options, false);
+    performBurstThenIdle("Trim when idle", numberOfAllocations, blocksPerPage, options, true);
+    options.maxEmptyPages = 2;
+    performBurstThenIdle<AutoTrim>("Automatic trim keeping 2 empty pages", numberOfAllocations, blocksPerPage, options,
+                                   false);
+    std::cout << std::endl;
+}
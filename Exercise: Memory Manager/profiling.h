@@ -10,5 +10,21 @@
 #define profiling_h
 
 void profileMemoryManger();
+void profileBatchAllocations();
+void profileLazyPageCarving();
+void profileReserve();
+void profileTrim();
+void profilePageSources();
+void profileFalseSharing();
+void profilePoolAllocator();
+void profileSizeClassMemoryResource();
+void profileHandles();
+void profileFullestPage();
+void profileLiveIteration();
+void profilePolicies();
+void profileStats();
+void profileConcurrentMemoryManager();
+void profileLockFreeMemoryManager();
+void profileValidatedFrees();
 
 #endif /* profiling_h */
@@ -8,9 +8,29 @@
 
 #include "test_cases.h"
 #include "MemoryPoolManager.h"
+#include "ConcurrentMemoryPoolManager.h"
+#include "LockFreeMemoryPoolManager.h"
+#include "PerCpuMemoryPoolManager.h"
+#include "PoolAllocator.h"
+#include "HandlePoolManager.h"
+#include "CompactPoolManager.h"
+#include "SizeClassMemoryResource.h"
+#include "MemoryPoolStats.h"
 #include <string>
+#include <cstring>
 #include <iostream>
 #include <list>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <algorithm>
+#include <thread>
+#include <vector>
+#if defined(__unix__) || defined(__APPLE__)
+#include <csignal>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 
 /// Conditions for if results should be outputted
 enum RecordResultsCondition {
@@ -34,6 +54,17 @@ struct DummyObject {
     bool boolVal;
 };
 
+/// Test object that needs stricter alignment than a pointer
+struct alignas(32) AlignedObject {
+    float values[8];
+    double extra;
+};
+
+/// Memory Manager with the default policies and the given modes
+template <class T, class... Modes>
+using ModalPoolManager = MemoryPoolManager<T, MallocPageSource, DefaultValidationPolicy, SingleThreaded, NoStats,
+                                           PoolModes<Modes...>>;
+
 struct TestResult {
     TestResult(std::string title)
     : title(title)
@@ -53,7 +84,13 @@ struct TestResult {
     bool resultFound;
 };
 
+/// Number of tests that failed or found no result so far.
+unsigned int failedTestCount = 0;
+
 void outputTestResult(TestResult& results) {
+    if (!results.resultFound || !results.isPassed) {
+        ++failedTestCount;
+    }
     std::string result = results.resultFound ? (results.isPassed ? "[PASS] " : "[FAIL] ") : "[NO RESULT] ";
     std::cout << result << results.title;
     if (results.description != "") {
@@ -67,15 +104,15 @@ bool shouldRecordResults(bool isPassed, RecordResultsCondition outputFlag) {
     return (actual & outputFlag) == actual;
 }
 
-template <class T>
-MemoryPoolManager<T>* createManager(  const unsigned blocksPerPage,
-                                      bool expectManagerException,
-                                      RecordResultsCondition resultsCondition,
-                                      TestResult& result  ) {
-    MemoryPoolManager<T>* manager = nullptr;
+template <class T, class Validation = DefaultValidationPolicy>
+MemoryPoolManager<T, MallocPageSource, Validation>* createManager(  const unsigned blocksPerPage,
+                                                                    bool expectManagerException,
+                                                                    RecordResultsCondition resultsCondition,
+                                                                    TestResult& result  ) {
+    MemoryPoolManager<T, MallocPageSource, Validation>* manager = nullptr;
     ManagerExceptionType exceptionType = NoException;
     try {
-        manager = new MemoryPoolManager<T>(blocksPerPage);
+        manager = new MemoryPoolManager<T, MallocPageSource, Validation>(blocksPerPage);
     }
     catch (const MemoryPoolException& e) {
         exceptionType = KnownException;
@@ -104,8 +141,8 @@ MemoryPoolManager<T>* createManager(  const unsigned blocksPerPage,
     return manager;
 }
 
-template <class T>
-T* allocateBlock(   MemoryPoolManager<T>* manager,
+template <class T, class Validation = DefaultValidationPolicy>
+T* allocateBlock(   MemoryPoolManager<T, MallocPageSource, Validation>* manager,
                     bool expectManagerException,
                     RecordResultsCondition resultsCondition,
                     TestResult& result ) {
@@ -141,8 +178,8 @@ T* allocateBlock(   MemoryPoolManager<T>* manager,
     return block;
 }
 
-template <class T>
-void freeBlock( MemoryPoolManager<T>* manager,
+template <class T, class Validation = DefaultValidationPolicy>
+void freeBlock( MemoryPoolManager<T, MallocPageSource, Validation>* manager,
                 T* block,
                 bool expectManagerException,
                 RecordResultsCondition printOutput,
@@ -193,9 +230,9 @@ void writeIntToBlock( int* block, int value, RecordResultsCondition resultsCondi
     }
 }
 
-template <class T>
+template <class T, class Validation = DefaultValidationPolicy>
 void writeCorruption(bool useUnderflow, int offset, TestResult& result) {
-    auto manager = createManager<T>(10, false, FailOnly, result);
+    auto manager = createManager<T, Validation>(10, false, FailOnly, result);
     T* block = nullptr;
     if (!result.resultFound) block = allocateBlock<T>(manager, false, FailOnly, result);
     char* offsetBlock = reinterpret_cast<char*>(block);
@@ -205,7 +242,11 @@ void writeCorruption(bool useUnderflow, int offset, TestResult& result) {
     else {
         offsetBlock += std::max(sizeof(T), sizeof(void*)) + offset;
     }
-    *reinterpret_cast<int*>(offsetBlock) = 0x1234;
+    // flip every bit that is written over, since canaries are random and a fixed value could match them by chance
+    int corruption;
+    memcpy(&corruption, offsetBlock, sizeof(corruption));
+    corruption = ~corruption;
+    memcpy(offsetBlock, &corruption, sizeof(corruption));
     if (!result.resultFound) freeBlock(manager, block, true, AnyResult, result);
     delete manager;
 }
@@ -317,106 +358,2018 @@ void testDeallocation() {
 }
 
 template <class T>
-void testFreeBlockAddressLocation() {
-    TestResult result("Valid Block Address");
+void testBatchAllocation() {
+    TestResult result("Batch Allocation Across Pages");
     auto manager = createManager<T>(10, false, FailOnly, result);
-    T* block = nullptr;
-    if (!result.resultFound) block = allocateBlock<T>(manager, false, FailOnly, result);
-    if (!result.resultFound) freeBlock<T>(manager, block, false, AnyResult, result);
-    delete manager;
+    T* blocks[25];
+    if (!result.resultFound) {
+        try {
+            manager->allocateBlocks(blocks, 25);
+            bool pass = manager->getNumberOfPages() == 3 && manager->getAvailableBlocksRemaining() == 5;
+            for (int i = 0; i < 25 && pass; ++i) {
+                for (int j = i + 1; j < 25 && pass; ++j) {
+                    pass = blocks[i] != blocks[j];
+                }
+            }
+            result.setResult(pass, pass ? "" : "Allocated blocks or remaining block count are wrong.");
+        }
+        catch (...) {
+            result.setResult(false, "Allocation threw an unexpected exception.");
+        }
+    }
     outputTestResult(result);
     
-    result = TestResult("Invalid Block Address Offset");
-    manager = createManager<T>(10, false, FailOnly, result);
-    if (!result.resultFound) block = allocateBlock<T>(manager, false, FailOnly, result);
-    char* offsetBlock = reinterpret_cast<char*>(block) + sizeof(T) / 2;
-    if (!result.resultFound) freeBlock(manager, reinterpret_cast<T*>(offsetBlock), true, AnyResult, result);
+    result = TestResult("Batch Deallocation");
+    if (manager) {
+        try {
+            blocks[3] = nullptr;
+            manager->freeBlocks(blocks, 25);
+            bool pass = manager->getAvailableBlocksRemaining() == 29;
+            result.setResult(pass, pass ? "" : "Remaining block count is wrong.");
+        }
+        catch (...) {
+            result.setResult(false, "Deallocation threw an unexpected exception.");
+        }
+    }
     delete manager;
     outputTestResult(result);
+}
+
+template <class T>
+void testLazyPageCarving() {
+    TestResult result("Lazy Page Carving Allocation");
+    ModalPoolManager<T, LazyPageCarving>* manager = nullptr;
+    std::vector<T*> blocks;
+    try {
+        manager = new ModalPoolManager<T, LazyPageCarving>(10);
+        for (int i = 0; i < 25; ++i) {
+            blocks.push_back(manager->allocateBlock());
+        }
+        bool pass = manager->getNumberOfPages() == 3 && manager->getAvailableBlocksRemaining() == 5;
+        for (int i = 1; i < 10 && pass; ++i) {
+            // blocks are carved off in address order
+            pass = reinterpret_cast<char*>(blocks[i]) > reinterpret_cast<char*>(blocks[i - 1]);
+        }
+        result.setResult(pass, pass ? "" : "Carved blocks or remaining block count are wrong.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
     
-    result = TestResult("Invalid Block Address Random");
-    manager = createManager<T>(10, false, FailOnly, result);
-    offsetBlock = (char*)0x12345678;
-    if (!result.resultFound) freeBlock(manager, reinterpret_cast<T*>(offsetBlock), true, AnyResult, result);
+    result = TestResult("Lazy Page Carving Reuses Freed Blocks");
+    if (manager) {
+        try {
+            manager->freeBlock(blocks[4]);
+            T* block = manager->allocateBlock();
+            T* batch[10];
+            manager->freeBlocks(&blocks[0], 4);
+            manager->allocateBlocks(batch, 10);
+            bool pass = block == blocks[4]
+                && std::find(batch, batch + 4, blocks[0]) != batch + 4
+                && manager->getNumberOfPages() == 4
+                && manager->getAvailableBlocksRemaining() == 9;
+            result.setResult(pass, pass ? "" : "Freed blocks were not reused first.");
+        }
+        catch (...) {
+            result.setResult(false, "Unexpected exception.");
+        }
+    }
     delete manager;
     outputTestResult(result);
 }
 
+template <class T, class... Modes>
+void testTrim(const char* name) {
+    TestResult result(name);
+    try {
+        ModalPoolManager<T, Modes...> manager(10);
+        std::vector<T*> blocks;
+        for (int i = 0; i < 35; ++i) {
+            blocks.push_back(manager.allocateBlock());
+        }
+        
+        // empty out the first two pages and part of the third
+        for (int i = 0; i < 25; ++i) {
+            manager.freeBlock(blocks[i]);
+        }
+        bool pass = manager.trim(1) == 1
+            && manager.getNumberOfPages() == 3
+            && manager.getAvailableBlocksRemaining() == 20;
+        pass = pass && manager.trim() == 1
+            && manager.getNumberOfPages() == 2
+            && manager.getAvailableBlocksRemaining() == 10;
+        
+        // remaining blocks are still usable
+        for (int i = 0; i < 12; ++i) {
+            blocks[i] = manager.allocateBlock();
+        }
+        for (int i = 0; i < 12; ++i) {
+            manager.freeBlock(blocks[i]);
+        }
+        pass = pass && manager.getNumberOfPages() == 3 && manager.getAvailableBlocksRemaining() == 20;
+        result.setResult(pass, pass ? "" : "Wrong number of pages or blocks after trimming.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+}
+
 template <class T>
-void testFreeBlockDuplicateFree() {
-    TestResult result("Valid Allocation and Dellocation of Same Block");
-    auto manager = createManager<T>(1, false, FailOnly, result);
-    T* block = nullptr;
-    if (!result.resultFound) block = allocateBlock<T>(manager, false, FailOnly, result);
-    if (!result.resultFound) freeBlock(manager, block, false, FailOnly, result);
-    if (!result.resultFound) block = allocateBlock<T>(manager, false, FailOnly, result);
-    if (!result.resultFound) freeBlock(manager, block, false, AnyResult, result);
-    delete manager;
+void testAutoTrim() {
+    TestResult result("Automatic Trim");
+    MemoryPoolOptions options;
+    options.maxEmptyPages = 1;
+    try {
+        ModalPoolManager<T, AutoTrim> manager(10, options);
+        std::vector<T*> blocks;
+        for (int i = 0; i < 100; ++i) {
+            blocks.push_back(manager.allocateBlock());
+        }
+        for (int i = 0; i < 100; ++i) {
+            manager.freeBlock(blocks[i]);
+        }
+        
+        // empty pages are released as blocks are freed, and an explicit trim gets down to the configured count
+        bool pass = manager.getNumberOfPages() < 4;
+        manager.trim(1);
+        pass = pass && manager.getNumberOfPages() == 1;
+        result.setResult(pass, pass ? "" : "Empty pages were not released.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+}
+
+template <class T, class... Modes>
+void testReserve(const char* name) {
+    TestResult result(name);
+    try {
+        ModalPoolManager<T, Modes...> manager(10);
+        std::vector<T*> blocks;
+        for (int i = 0; i < 3; ++i) {
+            blocks.push_back(manager.allocateBlock());
+        }
+        
+        // the 7 blocks left in the first page and 4 more pages
+        bool pass = manager.reserve(45) == 4
+            && manager.getNumberOfPages() == 5
+            && manager.getAvailableBlocksRemaining() == 47
+            && manager.reserve(45) == 0;
+        
+        // every reserved block can be allocated without growing the pool
+        for (int i = 0; i < 47; ++i) {
+            blocks.push_back(manager.allocateBlock());
+        }
+        pass = pass && manager.getNumberOfPages() == 5
+            && std::set<T*>(blocks.begin(), blocks.end()).size() == 50;
+        for (T* block : blocks) {
+            manager.freeBlock(block);
+        }
+        pass = pass && manager.getAvailableBlocksRemaining() == 50 && manager.trim() == 5;
+        result.setResult(pass, pass ? "" : "Wrong number of pages or blocks after reserving.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+}
+
+template <class T>
+void testReserveModes() {
+    testReserve<T>("Reserve Blocks");
+    testReserve<T, LazyPageCarving>("Reserve Lazily Carved Blocks");
+    testReserve<T, LazyPageCarving, PreferFullestPage>("Reserve Lazily Carved Blocks For Fullest Page First");
+}
+
+template <class T>
+void testMaintain() {
+    TestResult result("Maintain Low Watermark");
+    MemoryPoolOptions options;
+    options.lowWatermark = 25;
+    try {
+        MemoryPoolManager<T> manager(10, options);
+        bool pass = manager.maintain() == 2 && manager.maintain() == 0;
+        T* blocks[10];
+        manager.allocateBlocks(blocks, 10);
+        pass = pass && manager.maintain() == 1 && manager.getAvailableBlocksRemaining() == 30;
+        manager.freeBlocks(blocks, 10);
+        
+        // no watermark
+        MemoryPoolManager<T> unmaintained(10);
+        pass = pass && unmaintained.maintain() == 0 && unmaintained.getNumberOfPages() == 1;
+        result.setResult(pass, pass ? "" : "Available blocks were not kept at the low watermark.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+}
+
+template <class T, class... Modes>
+void testReset(const char* name) {
+    TestResult result(name);
+    try {
+        ModalPoolManager<T, Modes...> manager(10);
+        std::vector<T*> blocks;
+        for (int i = 0; i < 35; ++i) {
+            blocks.push_back(manager.allocateBlock());
+        }
+        for (int i = 0; i < 5; ++i) {
+            manager.freeBlock(blocks[i]);
+        }
+        manager.reset();
+        bool pass = manager.getNumberOfPages() == 4 && manager.getAvailableBlocksRemaining() == 40;
+        
+        // every block of the existing pages can be allocated again without growing the pool
+        blocks.clear();
+        for (int i = 0; i < 40; ++i) {
+            blocks.push_back(manager.allocateBlock());
+        }
+        pass = pass && manager.getNumberOfPages() == 4
+            && std::set<T*>(blocks.begin(), blocks.end()).size() == 40;
+        for (T* block : blocks) {
+            manager.freeBlock(block);
+        }
+        pass = pass && manager.getAvailableBlocksRemaining() == 40 && manager.trim() == 4;
+        result.setResult(pass, pass ? "" : "Wrong number of pages or blocks after resetting.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
     outputTestResult(result);
+}
+
+template <class T>
+void testResetModes() {
+    testReset<T>("Reset");
+    testReset<T, LazyPageCarving>("Reset Lazily Carved Pages");
+    testReset<T, LazyPageCarving, PreferFullestPage>("Reset Lazily Carved Pages For Fullest Page First");
+    testReset<T, PreferFullestPage>("Reset For Fullest Page First");
     
-    result = TestResult("Duplicate Free");
-    manager = createManager<T>(10, false, FailOnly, result);
-    if (!result.resultFound) block = allocateBlock(manager, false, FailOnly, result);
-    if (!result.resultFound) freeBlock(manager, block, false, FailOnly, result);
-    if (!result.resultFound) freeBlock(manager, block, true, AnyResult, result);
-    delete manager;
+    TestResult result("Reset Discards Allocated Blocks");
+    try {
+        MemoryPoolManager<T, MallocPageSource, FullValidation, SingleThreaded, CountingStats> manager(10);
+        T* block = manager.allocateBlock();
+        manager.allocateBlock();
+        manager.reset();
+        bool pass = manager.getStats().getLiveBlocks() == 0;
+        try {
+            manager.freeBlock(block);
+            pass = false;
+        }
+        catch (const MemoryPoolException& e) {
+        }
+        result.setResult(pass, pass ? "" : "Blocks allocated before the reset were not discarded.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
     outputTestResult(result);
 }
 
 template <class T>
-void testFreeBlockMemoryCorruption() {
-    TestResult result("Buffer Underflow 1");
-    writeCorruption<T>(true, 1, result);
+void testPreferFullestPage() {
+    TestResult result("Fullest Page First");
+    try {
+        // pages of 10 blocks, allocated one after another
+        ModalPoolManager<T, PreferFullestPage> manager(10);
+        std::vector<T*> blocks;
+        for (int i = 0; i < 30; ++i) {
+            blocks.push_back(manager.allocateBlock());
+        }
+        
+        // leave 8 blocks available in the first page, 2 in the second, and 5 in the third, which is the current page
+        std::set<T*> firstPage(blocks.begin(), blocks.begin() + 8);
+        std::set<T*> secondPage(blocks.begin() + 10, blocks.begin() + 12);
+        std::set<T*> thirdPage(blocks.begin() + 20, blocks.begin() + 25);
+        manager.freeBlocks(&blocks[0], 8);
+        manager.freeBlocks(&blocks[10], 2);
+        manager.freeBlocks(&blocks[20], 5);
+        
+        // the current page is used up first, then the fullest page
+        bool pass = true;
+        for (int i = 0; i < 5; ++i) {
+            pass = pass && thirdPage.count(manager.allocateBlock()) == 1;
+        }
+        for (int i = 0; i < 2; ++i) {
+            pass = pass && secondPage.count(manager.allocateBlock()) == 1;
+        }
+        for (int i = 0; i < 8; ++i) {
+            pass = pass && firstPage.count(manager.allocateBlock()) == 1;
+        }
+        pass = pass && manager.getNumberOfPages() == 3 && manager.getAvailableBlocksRemaining() == 0;
+        result.setResult(pass, pass ? "" : "Blocks were not allocated from the fullest page.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
     outputTestResult(result);
     
-    result = TestResult("Buffer Underflow 2");
-    writeCorruption<T>(true, 2, result);
+    result = TestResult("Fullest Page First With Lazy Page Carving");
+    try {
+        ModalPoolManager<T, PreferFullestPage, LazyPageCarving> manager(10);
+        T* blocks[25];
+        manager.allocateBlocks(blocks, 25);
+        manager.freeBlocks(blocks, 5);
+        T* moreBlocks[10];
+        manager.allocateBlocks(moreBlocks, 10);
+        std::set<T*> allBlocks(blocks + 5, blocks + 25);
+        allBlocks.insert(moreBlocks, moreBlocks + 10);
+        bool pass = allBlocks.size() == 30 && manager.getNumberOfPages() == 3
+            && manager.getAvailableBlocksRemaining() == 0;
+        result.setResult(pass, pass ? "" : "Carved and reused blocks were not handed out exactly once.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
     outputTestResult(result);
     
-    result = TestResult("Buffer Underflow 3");
-    writeCorruption<T>(true, 3, result);
+    result = TestResult("Fullest Page First Trim");
+    try {
+        ModalPoolManager<T, PreferFullestPage> manager(10);
+        std::vector<T*> blocks;
+        for (int i = 0; i < 100; ++i) {
+            blocks.push_back(manager.allocateBlock());
+        }
+        
+        // empty out every other page, and leave one block in each of the rest
+        for (int i = 0; i < 100; ++i) {
+            if ((i / 10) % 2 == 0 || i % 10 != 0) {
+                manager.freeBlock(blocks[i]);
+            }
+        }
+        bool pass = manager.trim(1) == 4 && manager.getNumberOfPages() == 6
+            && manager.getAvailableBlocksRemaining() == 55;
+        
+        // the remaining blocks fill the partly used pages before the empty page
+        for (int i = 0; i < 45; ++i) {
+            manager.allocateBlock();
+        }
+        pass = pass && manager.trim() == 1 && manager.getNumberOfPages() == 5;
+        result.setResult(pass, pass ? "" : "Empty pages were not released as expected.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+}
+
+template <class T>
+void testPageGrowth() {
+    TestResult result("Geometric Page Growth");
+    MemoryPoolOptions options;
+    options.pageGrowthFactor = 2;
+    options.maxBlocksPerPage = 40;
+    try {
+        // pages of 10, 20, 40 and then 40 blocks
+        ModalPoolManager<T, GrowingPages> manager(10, options);
+        std::vector<T*> blocks;
+        for (int i = 0; i < 100; ++i) {
+            blocks.push_back(manager.allocateBlock());
+        }
+        bool pass = manager.getNumberOfPages() == 4 && manager.getAvailableBlocksRemaining() == 10
+            && manager.getNextPageBlocks() == 40;
+        for (int i = 0; i < 100; ++i) {
+            manager.freeBlock(blocks[i]);
+        }
+        pass = pass && manager.trim() == 4 && manager.getAvailableBlocksRemaining() == 0;
+        result.setResult(pass, pass ? "" : "Pages did not grow as expected.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
     outputTestResult(result);
     
-    result = TestResult("Buffer Overflow 1");
-    writeCorruption<T>(false, -3, result);
+    result = TestResult("Custom Page Growth Policy");
+    options = MemoryPoolOptions();
+    options.pageGrowthPolicy = [](size_t, unsigned int lastBlocksPerPage) {
+        return lastBlocksPerPage + 5;
+    };
+    try {
+        // pages of 5, 10 and 15 blocks
+        ModalPoolManager<T, GrowingPages, LazyPageCarving> manager(5, options);
+        T* blocks[30];
+        manager.allocateBlocks(blocks, 30);
+        bool pass = manager.getNumberOfPages() == 3 && manager.getAvailableBlocksRemaining() == 0;
+        manager.freeBlocks(blocks, 30);
+        pass = pass && manager.getAvailableBlocksRemaining() == 30;
+        result.setResult(pass, pass ? "" : "Pages did not follow the growth policy.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
     outputTestResult(result);
     
-    result = TestResult("Buffer Overflow 2");
-    writeCorruption<T>(false, -2, result);
+    result = TestResult("Invalid Page Growth Factor");
+    options = MemoryPoolOptions();
+    options.pageGrowthFactor = 0;
+    try {
+        ModalPoolManager<T, GrowingPages> manager(10, options);
+        result.setResult(false, "Expected an exception.");
+    }
+    catch (const MemoryPoolException& e) {
+        result.setResult(true, "");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
     outputTestResult(result);
     
-    result = TestResult("Buffer Overflow 3");
-    writeCorruption<T>(false, -1, result);
+    result = TestResult("Page Growth Without Growing Pages");
+    options = MemoryPoolOptions();
+    options.pageGrowthFactor = 2;
+    try {
+        MemoryPoolManager<T> manager(10, options);
+        result.setResult(false, "Expected an exception.");
+    }
+    catch (const MemoryPoolException& e) {
+        result.setResult(true, "");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+}
+
+template <class T, class PageSource>
+void testPageSource(const char* name) {
+    TestResult result(name);
+    MemoryPoolOptions options;
+    options.pageGrowthFactor = 2;
+    try {
+        MemoryPoolManager<T, PageSource, DefaultValidationPolicy, SingleThreaded, NoStats, PoolModes<GrowingPages>>
+            manager(100, options);
+        std::vector<T*> blocks;
+        for (int i = 0; i < 1000; ++i) {
+            T* block = manager.allocateBlock();
+            memset(block, 0xFF, sizeof(T));
+            blocks.push_back(block);
+        }
+        for (int i = 0; i < 1000; ++i) {
+            manager.freeBlock(blocks[i]);
+        }
+        bool pass = manager.trim() == 4 && manager.getAvailableBlocksRemaining() == 0;
+        result.setResult(pass, pass ? "" : "Pages were not allocated and released as expected.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+template <class T>
+void testReservedAddressSpace() {
+    TestResult result("Reserved Address Space");
+    MemoryPoolOptions options;
+    options.reservedAddressSpace = size_t(1) << 30;
+    try {
+        // every free is validated against the page found from the block's slot
+        MemoryPoolManager<T, MallocPageSource, FullValidation> manager(100, options);
+        std::vector<T*> blocks;
+        for (int i = 0; i < 1000; ++i) {
+            blocks.push_back(manager.allocateBlock());
+        }
+        const char* lowest = reinterpret_cast<char*>(*std::min_element(blocks.begin(), blocks.end()));
+        const char* highest = reinterpret_cast<char*>(*std::max_element(blocks.begin(), blocks.end()));
+        bool pass = manager.getNumberOfPages() == 10
+            && static_cast<size_t>(highest - lowest) < options.reservedAddressSpace;
+        for (int i = 0; i < 1000; ++i) {
+            manager.freeBlock(blocks[i]);
+        }
+        pass = pass && manager.trim() == 10 && manager.getNumberOfPages() == 0;
+        
+        // trimmed slots are committed again
+        for (int i = 0; i < 1000; ++i) {
+            blocks[i] = manager.allocateBlock();
+        }
+        manager.freeBlocks(blocks.data(), 1000);
+        pass = pass && manager.getNumberOfPages() == 10 && manager.getAvailableBlocksRemaining() == 1000;
+        result.setResult(pass, pass ? "" : "Pages were not committed and released as expected.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
     outputTestResult(result);
     
-    result = TestResult("Buffer Overflow 4");
-    writeCorruption<T>(false, 0, result);
+    result = TestResult("Free Outside Committed Pages");
+    try {
+        MemoryPoolManager<T, MallocPageSource, FullValidation> manager(100, options);
+        T* block = manager.allocateBlock();
+        
+        // the address is inside the reservation, in a slot with nothing committed
+        manager.freeBlock(reinterpret_cast<T*>(reinterpret_cast<char*>(block) + (size_t(1) << 24)));
+        result.setResult(false, "Expected an exception.");
+    }
+    catch (const MemoryPoolException& e) {
+        result.setResult(true, "");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
     outputTestResult(result);
     
-    result = TestResult("Buffer Overflow 5");
-    writeCorruption<T>(false, 1, result);
+    result = TestResult("Reserved Address Space Exhausted");
+    options.reservedAddressSpace = 2 * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    try {
+        MemoryPoolManager<T> manager(1, options);
+        for (int i = 0; i < 3; ++i) {
+            manager.allocateBlock();
+        }
+        result.setResult(false, "Expected an exception.");
+    }
+    catch (const std::bad_alloc& e) {
+        result.setResult(true, "");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+    
+    result = TestResult("Page Growth With Reserved Address Space");
+    options.pageGrowthFactor = 2;
+    try {
+        ModalPoolManager<T, GrowingPages> manager(10, options);
+        result.setResult(false, "Expected an exception.");
+    }
+    catch (const MemoryPoolException& e) {
+        result.setResult(true, "");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
     outputTestResult(result);
 }
-
-void testMemoryManager() {
-    std::cout << ">>> Int Memory Manager Tests <<<" << std::endl;
-    testConstruction<int>();
-    testAllocation<int>();
-    testDeallocation<int>();
-    testWritingIntToBlock();
-#ifdef VALIDATIONS_ENABLED
-    testFreeBlockAddressLocation<int>();
-    testFreeBlockMemoryCorruption<int>();
-    testFreeBlockDuplicateFree<int>();
 #endif
+
+template <class T>
+void testBlockAlignment() {
+    TestResult result("Block Alignment");
+    try {
+        MemoryPoolManager<T> manager(10);
+        std::vector<T*> blocks(25);
+        manager.allocateBlocks(blocks.data(), 25);
+        bool pass = true;
+        for (int i = 0; i < 25; ++i) {
+            pass = pass && reinterpret_cast<uintptr_t>(blocks[i]) % alignof(T) == 0;
+        }
+        manager.freeBlocks(blocks.data(), 25);
+        result.setResult(pass, pass ? "" : "Block is not aligned for its type.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
     
-    std::cout << std::endl << ">>> Dummy Object Memory Manager Tests <<<" << std::endl;
-    testConstruction<DummyObject>();
-    testAllocation<DummyObject>();
-    testDeallocation<DummyObject>();
-#ifdef VALIDATIONS_ENABLED
-    testFreeBlockAddressLocation<DummyObject>();
-    testFreeBlockMemoryCorruption<DummyObject>();
-    testFreeBlockDuplicateFree<DummyObject>();
-#endif
+    result = TestResult("Cache Line Aligned Blocks");
+    MemoryPoolOptions options;
+    options.cacheLineAligned = true;
+    try {
+        ModalPoolManager<T, LazyPageCarving> manager(10, options);
+        std::vector<uintptr_t> addresses;
+        for (int i = 0; i < 25; ++i) {
+            addresses.push_back(reinterpret_cast<uintptr_t>(manager.allocateBlock()));
+        }
+        std::sort(addresses.begin(), addresses.end());
+        bool pass = true;
+        for (int i = 0; i < 25; ++i) {
+            pass = pass && addresses[i] % 64 == 0 && (i == 0 || addresses[i] - addresses[i - 1] >= sizeof(T));
+            pass = pass && (i == 0 || addresses[i] / 64 != (addresses[i - 1] + sizeof(T) - 1) / 64);
+        }
+        for (int i = 0; i < 25; ++i) {
+            manager.freeBlock(reinterpret_cast<T*>(addresses[i]));
+        }
+        result.setResult(pass, pass ? "" : "Blocks share a cache line.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+}
+
+template <class T>
+void testPolicies() {
+    TestResult result("Validated and Unvalidated Pools Together");
+    try {
+        MemoryPoolManager<T, MallocPageSource, NoValidation> unvalidated(10);
+        MemoryPoolManager<T, MallocPageSource, FullValidation> validated(10);
+        T* blocks[2];
+        unvalidated.allocateBlocks(blocks, 2);
+        const std::ptrdiff_t unvalidatedStride = reinterpret_cast<char*>(blocks[1]) - reinterpret_cast<char*>(blocks[0]);
+        validated.allocateBlocks(blocks, 2);
+        const std::ptrdiff_t validatedStride = reinterpret_cast<char*>(blocks[1]) - reinterpret_cast<char*>(blocks[0]);
+        bool pass = validatedStride > unvalidatedStride;
+        validated.freeBlock(blocks[0]);
+        try {
+            validated.freeBlock(blocks[0]);
+            pass = false;
+        }
+        catch (const MemoryPoolException& e) {}
+        result.setResult(pass, pass ? "" : "Validation policy was not applied to its own pool only.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+    
+    result = TestResult("Counting Stats");
+    try {
+        MemoryPoolManager<T, MallocPageSource, DefaultValidationPolicy, SingleThreaded, CountingStats> manager(4);
+        std::vector<T*> blocks;
+        for (int i = 0; i < 10; ++i) {
+            blocks.push_back(manager.allocateBlock());
+        }
+        for (int i = 0; i < 4; ++i) {
+            manager.freeBlock(blocks[i]);
+        }
+        manager.allocateBlocks(&blocks[0], 3);
+        manager.freeBlocks(&blocks[0], 3);
+        const CountingStats& stats = manager.getStats();
+        bool pass = stats.getAllocations() == 13 && stats.getFrees() == 7 && stats.getLiveBlocks() == 6
+            && stats.getPeakLiveBlocks() == 10 && stats.getPagesAllocated() == 3;
+        for (int i = 4; i < 10; ++i) {
+            manager.freeBlock(blocks[i]);
+        }
+        pass = pass && manager.trim() == 3 && stats.getPagesReleased() == 3 && stats.getLiveBlocks() == 0;
+        result.setResult(pass, pass ? "" : "Stats did not match the calls made.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+    
+    result = TestResult("Counting Stats After Clear");
+    try {
+        MemoryPoolManager<T, MallocPageSource, DefaultValidationPolicy, SingleThreaded, CountingStats> manager(4);
+        std::vector<T*> blocks;
+        for (int i = 0; i < 10; ++i) {
+            blocks.push_back(manager.allocateBlock());
+        }
+        manager.freeBlock(blocks[0]);
+        manager.clearAllMemory();
+        const CountingStats& stats = manager.getStats();
+        bool pass = stats.getAllocations() == 10 && stats.getFrees() == 10 && stats.getLiveBlocks() == 0
+            && stats.getPeakLiveBlocks() == 10 && stats.getPagesReleased() == 3;
+        result.setResult(pass, pass ? "" : "Blocks freed by clearing the pool were not counted.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+    
+    result = TestResult("Constant Blocks Per Page");
+    try {
+        MemoryPoolManager<T, MallocPageSource, DefaultValidationPolicy, SingleThreaded, NoStats,
+                          PoolModes<LazyPageCarving>, 8> manager;
+        std::vector<T*> blocks;
+        for (int i = 0; i < 20; ++i) {
+            blocks.push_back(manager.allocateBlock());
+        }
+        bool pass = manager.getBlocksPerPage() == 8 && manager.getNumberOfPages() == 3
+            && manager.getAvailableBlocksRemaining() == 4;
+        for (int i = 0; i < 20; ++i) {
+            manager.freeBlock(blocks[i]);
+        }
+        pass = pass && manager.trim(1) == 2 && manager.getAvailableBlocksRemaining() == 8;
+        result.setResult(pass, pass ? "" : "Pages did not have the constant number of blocks.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+    
+    result = TestResult("Constant Blocks Per Page With Growth");
+    try {
+        MemoryPoolOptions options;
+        options.pageGrowthFactor = 2;
+        MemoryPoolManager<T, MallocPageSource, DefaultValidationPolicy, SingleThreaded, NoStats, PoolModes<>, 8>
+            manager(options);
+        result.setResult(false, "Expected an exception.");
+    }
+    catch (const MemoryPoolException& e) {
+        result.setResult(true, "");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+}
+
+template <class T, class Validation>
+void testForEachLive(const std::string& name) {
+    TestResult result(name + " Live Block Iteration");
+    try {
+        MemoryPoolManager<T, MallocPageSource, Validation> manager(100);
+        std::vector<T*> blocks;
+        for (int i = 0; i < 250; ++i) {
+            blocks.push_back(manager.allocateBlock());
+        }
+        // free every third block and a run of more than 64 blocks, which covers a whole bitmap word
+        std::set<T*> live(blocks.begin(), blocks.end());
+        for (int i = 0; i < 250; ++i) {
+            if (i % 3 == 0 || (i >= 110 && i < 190)) {
+                manager.freeBlock(blocks[i]);
+                live.erase(blocks[i]);
+            }
+        }
+        T* batch[5];
+        manager.allocateBlocks(batch, 5);
+        live.insert(batch, batch + 5);
+        
+        std::vector<T*> visited;
+        manager.forEachLive([&visited](T* block) { visited.push_back(block); });
+        bool pass = visited.size() == live.size() && std::set<T*>(visited.begin(), visited.end()) == live;
+        for (size_t i = 1; i < visited.size(); ++i) {
+            pass = pass && visited[i - 1] < visited[i];
+        }
+        result.setResult(pass, pass ? "" : "Visited blocks did not match the allocated blocks in address order.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+    
+    result = TestResult(name + " Live Block Iteration With Lazy Page Carving");
+    try {
+        MemoryPoolManager<T, MallocPageSource, Validation, SingleThreaded, NoStats, PoolModes<LazyPageCarving>>
+            manager(64);
+        T* blocks[100];
+        manager.allocateBlocks(blocks, 100);
+        manager.freeBlocks(blocks, 50);
+        unsigned int count = 0;
+        manager.forEachLive([&count](T*) { ++count; });
+        manager.freeBlocks(blocks + 50, 50);
+        unsigned int countAfterFree = 0;
+        manager.forEachLive([&countAfterFree](T*) { ++countAfterFree; });
+        bool pass = count == 50 && countAfterFree == 0;
+        result.setResult(pass, pass ? "" : "Iteration visited available or uncarved blocks.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+}
+
+template <class T>
+void testDetailedStats() {
+    TestResult result("Detailed Stats");
+    try {
+        MemoryPoolManager<T, MallocPageSource, DefaultValidationPolicy, SingleThreaded, DetailedStats<1>> manager(4);
+        std::vector<T*> blocks;
+        for (int i = 0; i < 10; ++i) {
+            blocks.push_back(manager.allocateBlock());
+        }
+        for (int i = 0; i < 4; ++i) {
+            manager.freeBlock(blocks[i]);
+        }
+        manager.allocateBlocks(&blocks[0], 3);
+        manager.freeBlocks(&blocks[0], 3);
+        for (int i = 4; i < 10; ++i) {
+            manager.freeBlock(blocks[i]);
+        }
+        manager.trim(1);
+        
+        // every allocateBlock call is timed, but not the batch
+        PoolStatsSnapshot stats = manager.getStats().snapshot();
+        bool pass = stats.allocations == 13 && stats.frees == 13 && stats.liveBlocks == 0 && stats.peakLiveBlocks == 10
+            && stats.pagesAllocated == 3 && stats.pagesReleased == 2 && stats.pageGrowth.size() == 3
+            && stats.getLatencySamples() == 10 && stats.getLatencyPercentile(1.0) > 0;
+        for (size_t i = 0; pass && i < stats.pageGrowth.size(); ++i) {
+            pass = stats.pageGrowth[i].blockCount == 4
+                && (i == 0 || stats.pageGrowth[i - 1].timeNanoseconds <= stats.pageGrowth[i].timeNanoseconds);
+        }
+        pass = pass && stats.toJson().find("\"peakLiveBlocks\": 10,") != std::string::npos
+            && stats.toText().find("live blocks:          0 (peak 10)") != std::string::npos;
+        result.setResult(pass, pass ? "" : "Stats did not match the calls made.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+    
+    result = TestResult("Sampled Allocation Latency");
+    try {
+        MemoryPoolManager<T, MallocPageSource, DefaultValidationPolicy, SingleThreaded, DetailedStats<8>> manager(16);
+        for (int i = 0; i < 100; ++i) {
+            manager.allocateBlock();
+        }
+        PoolStatsSnapshot stats = manager.getStats().snapshot();
+        bool pass = stats.latencySampleInterval == 8 && stats.getLatencySamples() == 12
+            && stats.latencyHistogram.size() == DetailedStats<8>::latencyBucketCount;
+        result.setResult(pass, pass ? "" : "Allocations were not sampled at the given interval.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+    
+    result = TestResult("Detailed Stats After Clear");
+    try {
+        MemoryPoolManager<T, MallocPageSource, DefaultValidationPolicy, SingleThreaded, DetailedStats<1>> manager(4);
+        for (int i = 0; i < 10; ++i) {
+            manager.allocateBlock();
+        }
+        manager.clearAllMemory();
+        manager.allocateBlock();
+        
+        // the peak is measured against the capacity left after clearing, so it isn't raised by the new page
+        PoolStatsSnapshot stats = manager.getStats().snapshot();
+        bool pass = stats.allocations == 11 && stats.frees == 10 && stats.liveBlocks == 1 && stats.peakLiveBlocks == 10
+            && stats.pagesAllocated == 4 && stats.pagesReleased == 3;
+        result.setResult(pass, pass ? "" : "Blocks freed by clearing the pool were not counted.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+}
+
+/// Returns true if a hardened pool with an encoded free list and the given modes hands out every block once, and the
+/// pointer kept in a freed block is not the next block's address.
+template <class T, class Modes>
+bool encodedFreeListHandsOutBlocksOnce() {
+    MemoryPoolOptions options;
+    options.encodeFreeList = true;
+    MemoryPoolManager<T, MallocPageSource, HardenedValidation, SingleThreaded, NoStats, Modes> manager(10, options);
+    std::vector<T*> blocks(35);
+    std::set<T*> unique;
+    manager.allocateBlocks(&blocks[0], 20);
+    for (int i = 20; i < 35; ++i) {
+        blocks[i] = manager.allocateBlock();
+    }
+    unique.insert(blocks.begin(), blocks.end());
+    manager.freeBlocks(&blocks[0], 35);
+    bool pass = unique.size() == 35 && manager.trim(1) == 3 && manager.getAvailableBlocksRemaining() == 10;
+    for (int i = 0; i < 10; ++i) {
+        blocks[i] = manager.allocateBlock();
+    }
+    pass = pass && std::set<T*>(blocks.begin(), blocks.begin() + 10).size() == 10;
+    
+    manager.freeBlock(blocks[0]);
+    manager.freeBlock(blocks[1]);
+    T* stored;
+    memcpy(&stored, blocks[1], sizeof(stored));
+    return pass && stored != blocks[0];
+}
+
+template <class T>
+void testHardenedValidation() {
+    TestResult result("Sampled Canary Validation");
+    try {
+        MemoryPoolOptions options;
+        options.validationInterval = 8;
+        MemoryPoolManager<T, MallocPageSource, HardenedValidation> manager(100, options);
+        std::vector<T*> blocks;
+        for (int i = 0; i < 1000; ++i) {
+            blocks.push_back(manager.allocateBlock());
+        }
+        // overflow every block into the canary after it, so every checked free throws
+        int detected = 0;
+        for (int i = 0; i < 1000; ++i) {
+            const char corruption = 0x5A;
+            memcpy(reinterpret_cast<char*>(blocks[i]) + std::max(sizeof(T), sizeof(void*)), &corruption, 1);
+            try {
+                manager.freeBlock(blocks[i]);
+            }
+            catch (const MemoryPoolException& e) {
+                ++detected;
+            }
+        }
+        bool pass = detected >= 60 && detected <= 250;
+        result.setResult(pass, pass ? "" : "Checked frees did not match the validation interval.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+    
+    result = TestResult("Encoded Free List");
+    try {
+        bool pass = encodedFreeListHandsOutBlocksOnce<T, PoolModes<>>()
+            && encodedFreeListHandsOutBlocksOnce<T, PoolModes<LazyPageCarving>>()
+            && encodedFreeListHandsOutBlocksOnce<T, PoolModes<PreferFullestPage>>();
+        result.setResult(pass, pass ? "" : "Encoded free list did not hand out every block once.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+    
+    result = TestResult("Corrupted Encoded Free List");
+    try {
+        MemoryPoolOptions options;
+        options.encodeFreeList = true;
+        MemoryPoolManager<T, MallocPageSource, HardenedValidation> manager(10, options);
+        T* block = manager.allocateBlock();
+        manager.freeBlock(block);
+        
+        // a write through a dangling pointer overwrites the encoded pointer
+        memset(block, 0, sizeof(void*));
+        manager.allocateBlock();
+        result.setResult(false, "Expected an exception.");
+    }
+    catch (const MemoryPoolException& e) {
+        result.setResult(true, "");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+    
+    result = TestResult("Zero Validation Interval");
+    try {
+        MemoryPoolOptions options;
+        options.validationInterval = 0;
+        MemoryPoolManager<T, MallocPageSource, HardenedValidation> manager(10, options);
+        result.setResult(false, "Expected an exception.");
+    }
+    catch (const MemoryPoolException& e) {
+        result.setResult(true, "");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+}
+
+template <class T>
+void testDebugValidation() {
+    TestResult result("Quarantined Blocks");
+    try {
+        MemoryPoolOptions options;
+        options.quarantineSize = 4;
+        MemoryPoolManager<T, MallocPageSource, DebugValidation> manager(10, options);
+        T* first = manager.allocateBlock();
+        manager.freeBlock(first);
+        
+        // the freed block is held back until four more blocks are freed after it
+        std::vector<T*> blocks;
+        for (int i = 0; i < 4; ++i) {
+            blocks.push_back(manager.allocateBlock());
+        }
+        bool pass = std::find(blocks.begin(), blocks.end(), first) == blocks.end();
+        for (int i = 0; i < 3; ++i) {
+            manager.freeBlock(blocks[i]);
+        }
+        pass = pass && manager.getAvailableBlocksRemaining() == 5;
+        manager.freeBlock(blocks[3]);
+        pass = pass && manager.getAvailableBlocksRemaining() == 6 && manager.allocateBlock() == first;
+        result.setResult(pass, pass ? "" : "Freed block was not held in the quarantine.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+    
+    result = TestResult("Write To Quarantined Block");
+    try {
+        MemoryPoolOptions options;
+        options.quarantineSize = 1;
+        MemoryPoolManager<T, MallocPageSource, DebugValidation> manager(10, options);
+        T* block = manager.allocateBlock();
+        T* other = manager.allocateBlock();
+        manager.freeBlock(block);
+        
+        // a write through a dangling pointer is found when the block leaves the quarantine
+        memset(block, 0, 1);
+        manager.freeBlock(other);
+        result.setResult(false, "Expected an exception.");
+    }
+    catch (const MemoryPoolException& e) {
+        result.setResult(true, "");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+    
+    result = TestResult("Write To Reused Block");
+    try {
+        MemoryPoolOptions options;
+        options.quarantineSize = 0;
+        MemoryPoolManager<T, MallocPageSource, DebugValidation> manager(10, options);
+        T* block = manager.allocateBlock();
+        manager.freeBlock(block);
+        
+        // the end of the block is written, which is past the pointer kept in free blocks when the block is larger
+        memset(reinterpret_cast<char*>(block) + std::max(sizeof(T), sizeof(void*)) - 1, 0, 1);
+        manager.allocateBlock();
+        bool pass = sizeof(T) <= sizeof(void*);
+        result.setResult(pass, pass ? "" : "Expected an exception.");
+    }
+    catch (const MemoryPoolException& e) {
+        bool pass = sizeof(T) > sizeof(void*);
+        result.setResult(pass, pass ? "" : "Unexpected exception.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+    
+    result = TestResult("Quarantine Without Poison");
+    try {
+        MemoryPoolOptions options;
+        options.quarantineSize = 8;
+        options.poisonFreedBlocks = false;
+        MemoryPoolManager<T, MallocPageSource, DebugValidation, SingleThreaded, NoStats, PoolModes<LazyPageCarving>>
+            manager(10, options);
+        std::vector<T*> blocks(25);
+        manager.allocateBlocks(blocks.data(), 25);
+        for (int i = 0; i < 25; ++i) {
+            memset(blocks[i], 0x11, sizeof(T));
+        }
+        manager.freeBlocks(blocks.data(), 25);
+        bool pass = manager.getAvailableBlocksRemaining() == 30 - 8 && manager.trim() == 1;
+        result.setResult(pass, pass ? "" : "Pages with quarantined blocks should not be released.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+    
+#if defined(__unix__) || defined(__APPLE__)
+    result = TestResult("Guard Page Fault");
+    pid_t child = fork();
+    if (child == 0) {
+        // write past the only block of a page until reaching the guard page after it
+        MemoryPoolManager<T, GuardedPageSource, NoValidation> manager(1);
+        volatile char* block = reinterpret_cast<volatile char*>(manager.allocateBlock());
+        for (size_t offset = 0; offset < 2 * static_cast<size_t>(sysconf(_SC_PAGESIZE)); ++offset) {
+            block[offset] = 0;
+        }
+        _exit(0);
+    }
+    // the child either dies from the fault, or exits with an error when a sanitizer reports the fault
+    int status = 0;
+    bool pass = child > 0 && waitpid(child, &status, 0) == child
+        && (WIFSIGNALED(status) ? WTERMSIG(status) == SIGSEGV || WTERMSIG(status) == SIGBUS : WEXITSTATUS(status) != 0);
+    result.setResult(pass, pass ? "" : "Writing past the end of a page did not fault.");
+    outputTestResult(result);
+#endif
+}
+
+template <class T>
+void testHandles() {
+    TestResult result("Handle Allocation and Resolution");
+    try {
+        HandlePoolManager<T> manager(10);
+        std::vector<PoolHandle> handles;
+        std::vector<T*> blocks;
+        for (int i = 0; i < 100; ++i) {
+            handles.push_back(manager.allocateHandle());
+            blocks.push_back(manager.resolve(handles.back()));
+        }
+        std::vector<T*> sortedBlocks(blocks);
+        std::sort(sortedBlocks.begin(), sortedBlocks.end());
+        bool pass = manager.getBlocksPerPage() == 16 && manager.getNumberOfPages() == 7
+            && std::adjacent_find(sortedBlocks.begin(), sortedBlocks.end()) == sortedBlocks.end();
+        for (int i = 0; i < 100; ++i) {
+            pass = pass && blocks[i] && reinterpret_cast<uintptr_t>(blocks[i]) % alignof(T) == 0
+                && manager.resolve(handles[i]) == blocks[i];
+            manager.freeHandle(handles[i]);
+        }
+        pass = pass && manager.getAvailableBlocksRemaining() == 7 * 16;
+        result.setResult(pass, pass ? "" : "Handles did not resolve to distinct blocks.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+    
+    result = TestResult("Stale Handle Detection");
+    try {
+        HandlePoolManager<T> manager(10);
+        PoolHandle handle = manager.allocateHandle();
+        T* block = manager.resolve(handle);
+        manager.freeHandle(handle);
+        
+        // the slot is reused with a new generation, and the old handle no longer resolves
+        PoolHandle reused = manager.allocateHandle();
+        bool pass = reused.index == handle.index && reused != handle && manager.resolve(reused) == block
+            && manager.resolve(handle) == nullptr && !manager.isValid(handle) && manager.isValid(reused)
+            && manager.resolve(PoolHandle()) == nullptr;
+        PoolHandle outOfRange;
+        outOfRange.index = 1000;
+        outOfRange.generation = 1;
+        pass = pass && manager.resolve(outOfRange) == nullptr;
+        result.setResult(pass, pass ? "" : "Stale handle was not detected.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+    
+    result = TestResult("Stale Handle After Clear");
+    try {
+        // the handles from before the clear are in the same slots as the new ones, at the first and a later generation
+        HandlePoolManager<T> manager(10);
+        PoolHandle first = manager.allocateHandle();
+        PoolHandle reused = manager.allocateHandle();
+        manager.freeHandle(reused);
+        reused = manager.allocateHandle();
+        manager.clearAllMemory();
+        PoolHandle newFirst = manager.allocateHandle();
+        PoolHandle newSecond = manager.allocateHandle();
+        bool pass = newFirst.index == first.index && newSecond.index == reused.index && !manager.isValid(first)
+            && !manager.isValid(reused) && !manager.resolve(first) && manager.isValid(newFirst)
+            && manager.isValid(newSecond);
+        result.setResult(pass, pass ? "" : "A handle from before the clear resolved to a new block.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+    
+    result = TestResult("Duplicate Handle Free");
+    try {
+        HandlePoolManager<T> manager(10);
+        PoolHandle handle = manager.allocateHandle();
+        manager.freeHandle(handle);
+        manager.freeHandle(handle);
+        result.setResult(false, "Expected an exception.");
+    }
+    catch (const MemoryPoolException& e) {
+        result.setResult(true, "");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+}
+
+template <class T, class Validation = DefaultValidationPolicy>
+void testFreeBlockAddressLocation() {
+    TestResult result("Valid Block Address");
+    auto manager = createManager<T, Validation>(10, false, FailOnly, result);
+    T* block = nullptr;
+    if (!result.resultFound) block = allocateBlock<T>(manager, false, FailOnly, result);
+    if (!result.resultFound) freeBlock<T>(manager, block, false, AnyResult, result);
+    delete manager;
+    outputTestResult(result);
+    
+    result = TestResult("Invalid Block Address Offset");
+    manager = createManager<T, Validation>(10, false, FailOnly, result);
+    if (!result.resultFound) block = allocateBlock<T>(manager, false, FailOnly, result);
+    char* offsetBlock = reinterpret_cast<char*>(block) + sizeof(T) / 2;
+    if (!result.resultFound) freeBlock(manager, reinterpret_cast<T*>(offsetBlock), true, AnyResult, result);
+    delete manager;
+    outputTestResult(result);
+    
+    result = TestResult("Invalid Block Address Random");
+    manager = createManager<T, Validation>(10, false, FailOnly, result);
+    offsetBlock = (char*)0x12345678;
+    if (!result.resultFound) freeBlock(manager, reinterpret_cast<T*>(offsetBlock), true, AnyResult, result);
+    delete manager;
+    outputTestResult(result);
+}
+
+template <class T, class Validation = DefaultValidationPolicy>
+void testFreeBlockDuplicateFree() {
+    TestResult result("Valid Allocation and Dellocation of Same Block");
+    auto manager = createManager<T, Validation>(1, false, FailOnly, result);
+    T* block = nullptr;
+    if (!result.resultFound) block = allocateBlock<T>(manager, false, FailOnly, result);
+    if (!result.resultFound) freeBlock(manager, block, false, FailOnly, result);
+    if (!result.resultFound) block = allocateBlock<T>(manager, false, FailOnly, result);
+    if (!result.resultFound) freeBlock(manager, block, false, AnyResult, result);
+    delete manager;
+    outputTestResult(result);
+    
+    result = TestResult("Duplicate Free");
+    manager = createManager<T, Validation>(10, false, FailOnly, result);
+    if (!result.resultFound) block = allocateBlock(manager, false, FailOnly, result);
+    if (!result.resultFound) freeBlock(manager, block, false, FailOnly, result);
+    if (!result.resultFound) freeBlock(manager, block, true, AnyResult, result);
+    delete manager;
+    outputTestResult(result);
+}
+
+template <class T, class Validation = DefaultValidationPolicy>
+void testFreeBlockMemoryCorruption() {
+    TestResult result("Buffer Underflow 1");
+    writeCorruption<T, Validation>(true, 1, result);
+    outputTestResult(result);
+    
+    result = TestResult("Buffer Underflow 2");
+    writeCorruption<T, Validation>(true, 2, result);
+    outputTestResult(result);
+    
+    result = TestResult("Buffer Underflow 3");
+    writeCorruption<T, Validation>(true, 3, result);
+    outputTestResult(result);
+    
+    result = TestResult("Buffer Overflow 1");
+    writeCorruption<T, Validation>(false, -3, result);
+    outputTestResult(result);
+    
+    result = TestResult("Buffer Overflow 2");
+    writeCorruption<T, Validation>(false, -2, result);
+    outputTestResult(result);
+    
+    result = TestResult("Buffer Overflow 3");
+    writeCorruption<T, Validation>(false, -1, result);
+    outputTestResult(result);
+    
+    result = TestResult("Buffer Overflow 4");
+    writeCorruption<T, Validation>(false, 0, result);
+    outputTestResult(result);
+    
+    result = TestResult("Buffer Overflow 5");
+    writeCorruption<T, Validation>(false, 1, result);
+    outputTestResult(result);
+}
+
+template <class T, class Index>
+void testCompactPoolManager(const char* name) {
+    TestResult result(std::string(name) + " Allocation");
+    try {
+        CompactPoolManager<T, MallocPageSource, Index> manager(100);
+        std::vector<T*> blocks;
+        for (int i = 0; i < 250; ++i) {
+            blocks.push_back(manager.allocateBlock());
+        }
+        
+        // blocks of a page are packed with no space between them
+        bool pass = manager.getNumberOfPages() == 3 && manager.getAvailableBlocksRemaining() == 50
+            && std::set<T*>(blocks.begin(), blocks.end()).size() == 250;
+        for (int i = 1; i < 100; ++i) {
+            pass = pass && reinterpret_cast<char*>(blocks[i]) - reinterpret_cast<char*>(blocks[i - 1]) == sizeof(T);
+        }
+        for (int i = 0; i < 250; ++i) {
+            pass = pass && reinterpret_cast<uintptr_t>(blocks[i]) % alignof(T) == 0;
+            manager.freeBlock(blocks[i]);
+        }
+        pass = pass && manager.getAvailableBlocksRemaining() == 300;
+        result.setResult(pass, pass ? "" : "Blocks were not packed or counted as expected.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+    
+    result = TestResult(std::string(name) + " Reuse After Writes To Freed Blocks");
+    try {
+        CompactPoolManager<T, MallocPageSource, Index> manager(10);
+        std::vector<T*> blocks;
+        for (int i = 0; i < 30; ++i) {
+            blocks.push_back(manager.allocateBlock());
+        }
+        
+        // writing over freed blocks doesn't affect which blocks are handed out next
+        for (int i = 0; i < 30; i += 2) {
+            manager.freeBlock(blocks[i]);
+            memset(blocks[i], 0xFF, sizeof(T));
+        }
+        std::set<T*> reused;
+        for (int i = 0; i < 15; ++i) {
+            reused.insert(manager.allocateBlock());
+        }
+        bool pass = reused.size() == 15 && manager.getNumberOfPages() == 3;
+        for (int i = 0; i < 30; i += 2) {
+            pass = pass && reused.count(blocks[i]) == 1;
+        }
+        result.setResult(pass, pass ? "" : "Freed blocks were not reused.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+    
+    result = TestResult(std::string(name) + " Invalid Free");
+    try {
+        CompactPoolManager<T, MallocPageSource, Index> manager(10);
+        T outside;
+        manager.freeBlock(&outside);
+        result.setResult(false, "Expected an exception.");
+    }
+    catch (const MemoryPoolException& e) {
+        result.setResult(true, "");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+    
+    result = TestResult(std::string(name) + " Free After Clear");
+    try {
+        CompactPoolManager<T, MallocPageSource, Index> manager(10);
+        T* block = manager.allocateBlock();
+        manager.clearAllMemory();
+        manager.freeBlock(block);
+        result.setResult(false, "Expected an exception.");
+    }
+    catch (const MemoryPoolException& e) {
+        result.setResult(true, "");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+    
+    result = TestResult(std::string(name) + " Duplicate Free");
+    try {
+        CompactPoolManager<T, MallocPageSource, Index> manager(10);
+        T* block = manager.allocateBlock();
+        manager.freeBlock(block);
+        manager.freeBlock(block);
+        result.setResult(false, "Expected an exception.");
+    }
+    catch (const MemoryPoolException& e) {
+        result.setResult(true, "");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+    
+    result = TestResult(std::string(name) + " Too Many Blocks Per Page");
+    try {
+        // a page of as many blocks as the index can count is allowed, but not one more block. 32-bit indices can count
+        // any number of blocks, so a page of zero blocks is used instead.
+        const bool narrowIndex = sizeof(Index) < sizeof(unsigned int);
+        const unsigned int largest = narrowIndex ? std::numeric_limits<Index>::max() + 1u : 1u << 16;
+        CompactPoolManager<T, MallocPageSource, Index> manager(largest);
+        CompactPoolManager<T, MallocPageSource, Index> tooLarge(narrowIndex ? largest + 1 : 0);
+        result.setResult(false, "Expected an exception.");
+    }
+    catch (const MemoryPoolException& e) {
+        result.setResult(true, "");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+}
+
+void testPoolAllocator() {
+    TestResult result("Allocator Rebinding and Equality");
+    PoolAllocator<int> allocator(100);
+    PoolAllocator<double> rebound(allocator);
+    PoolAllocator<int> other(100);
+    bool pass = allocator == rebound && allocator != other && PoolAllocator<int>(rebound) == allocator;
+    result.setResult(pass, pass ? "" : "Allocators do not compare as expected.");
+    outputTestResult(result);
+    
+    result = TestResult("Node Containers");
+    try {
+        std::list<int, PoolAllocator<int>> list(allocator);
+        std::map<int, int, std::less<int>, PoolAllocator<std::pair<const int, int>>> map(std::less<int>(), allocator);
+        std::set<int, std::less<int>, PoolAllocator<int>> set(std::less<int>(), allocator);
+        std::unordered_map<int, int, std::hash<int>, std::equal_to<int>, PoolAllocator<std::pair<const int, int>>>
+            unorderedMap(0, std::hash<int>(), std::equal_to<int>(), allocator);
+        for (int i = 0; i < 1000; ++i) {
+            list.push_back(i);
+            map[i] = i;
+            set.insert(i);
+            unorderedMap[i] = i;
+        }
+        for (int i = 0; i < 1000; i += 2) {
+            map.erase(i);
+            set.erase(i);
+            unorderedMap.erase(i);
+        }
+        list.remove_if([](int value) { return value % 2 == 0; });
+        
+        pass = list.size() == 500 && map.size() == 500 && set.size() == 500 && unorderedMap.size() == 500;
+        for (int i = 1; i < 1000 && pass; i += 2) {
+            pass = map[i] == i && set.count(i) == 1 && unorderedMap[i] == i;
+        }
+        pass = pass && std::equal(list.begin(), list.end(), set.begin());
+        pass = pass && allocator.getPools()->getNumberOfPools() >= 3;
+        result.setResult(pass, pass ? "" : "Container contents are incorrect.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+    
+    result = TestResult("Over-Aligned Arrays");
+    try {
+        PoolAllocator<AlignedObject> alignedAllocator(100);
+        std::vector<AlignedObject*> arrays;
+        pass = true;
+        for (size_t count = 2; count < 10; ++count) {
+            arrays.push_back(alignedAllocator.allocate(count));
+            pass = pass && reinterpret_cast<uintptr_t>(arrays.back()) % alignof(AlignedObject) == 0;
+        }
+        for (size_t i = 0; i < arrays.size(); ++i) {
+            alignedAllocator.deallocate(arrays[i], i + 2);
+        }
+        result.setResult(pass, pass ? "" : "Arrays were not aligned for their type.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+    
+    result = TestResult("Array Length Overflow");
+    try {
+        PoolAllocator<double> doubleAllocator(100);
+        doubleAllocator.allocate(doubleAllocator.max_size() + 1);
+        result.setResult(false, "Expected an exception.");
+    }
+    catch (const std::bad_array_new_length& e) {
+        result.setResult(true, "");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+}
+
+void testSizeClassMemoryResource() {
+    TestResult result("Size Class Rounding");
+    bool pass = SizeClassMemoryResource::blockSizeFor(1) == 16 && SizeClassMemoryResource::blockSizeFor(16) == 16
+        && SizeClassMemoryResource::blockSizeFor(17) == 32 && SizeClassMemoryResource::blockSizeFor(129) == 160
+        && SizeClassMemoryResource::blockSizeFor(4096) == 4096 && SizeClassMemoryResource::blockSizeFor(4097) == 0;
+    result.setResult(pass, pass ? "" : "Sizes are not rounded to the expected size classes.");
+    outputTestResult(result);
+    
+    result = TestResult("Direct Allocation of Mixed Sizes");
+    try {
+        SizeClassMemoryResource resource(1024);
+        std::vector<std::pair<void*, size_t>> allocations;
+        pass = true;
+        for (size_t bytes = 1; bytes <= 5000; bytes += 37) {
+            void* block = resource.allocate(bytes, alignof(std::max_align_t));
+            pass = pass && reinterpret_cast<uintptr_t>(block) % alignof(std::max_align_t) == 0;
+            memset(block, static_cast<int>(bytes), bytes);
+            allocations.push_back(std::make_pair(block, bytes));
+        }
+        for (auto i = allocations.begin(); i != allocations.end(); ++i) {
+            pass = pass && *reinterpret_cast<unsigned char*>(i->first) == static_cast<unsigned char>(i->second);
+            resource.deallocate(i->first, i->second, alignof(std::max_align_t));
+        }
+        pass = pass && resource.is_equal(resource) && !resource.is_equal(*std::pmr::new_delete_resource());
+        result.setResult(pass, pass ? "" : "Blocks were overwritten or misaligned.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+    
+    result = TestResult("Pmr Containers");
+    try {
+        SizeClassMemoryResource resource;
+        std::pmr::vector<std::pmr::string> strings(&resource);
+        std::pmr::map<int, std::pmr::string> map(&resource);
+        for (int i = 0; i < 1000; ++i) {
+            strings.emplace_back(std::string(i % 100, 'a' + i % 26));
+            map.emplace(i, strings.back());
+        }
+        for (int i = 0; i < 1000; i += 2) {
+            map.erase(i);
+        }
+        pass = strings.size() == 1000 && map.size() == 500;
+        for (int i = 1; i < 1000 && pass; i += 2) {
+            pass = map[i] == strings[i] && strings[i].size() == static_cast<size_t>(i % 100);
+        }
+        result.setResult(pass, pass ? "" : "Container contents are incorrect.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+}
+
+/// Allocates blocks from the shared manager, writes a value unique to the thread in each, and checks that no other
+/// thread has written over them before freeing them. Returns false if any block was overwritten.
+template <class Manager>
+bool performConcurrentWrites(Manager& manager, const int threadValue, const unsigned count) {
+    std::vector<int*> blocks;
+    for (unsigned i = 0; i < count; ++i) {
+        blocks.push_back(manager.allocateBlock());
+        *blocks.back() = threadValue;
+    }
+    bool pass = true;
+    for (auto i = blocks.begin(); i != blocks.end(); ++i) {
+        pass = pass && **i == threadValue;
+        manager.freeBlock(*i);
+    }
+    return pass;
+}
+
+/// Runs the thread safety tests on a manager of the given type, constructed with the given arguments. Each of four
+/// threads allocates and frees the given number of rounds of blocks at once.
+template <class Manager, class... Args>
+void testThreadSafeManager(const std::string& name, const int rounds, const unsigned blocksPerRound,
+                           const Args... managerArgs) {
+    TestResult result(name + " Allocation and Deallocation");
+    try {
+        Manager manager(managerArgs...);
+        bool pass = performConcurrentWrites(manager, 42, 100);
+        result.setResult(pass, pass ? "" : "Block values were overwritten.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+    
+    result = TestResult(name + " Multi Thread Allocation and Deallocation");
+    try {
+        Manager manager(managerArgs...);
+        std::vector<std::thread> threads;
+        bool passes[4] = {false, false, false, false};
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([&manager, &passes, t, rounds, blocksPerRound]() {
+                bool pass = true;
+                for (int round = 0; round < rounds; ++round) {
+                    pass = performConcurrentWrites(manager, t, blocksPerRound) && pass;
+                }
+                passes[t] = pass;
+            });
+        }
+        for (auto i = threads.begin(); i != threads.end(); ++i) {
+            i->join();
+        }
+        bool pass = passes[0] && passes[1] && passes[2] && passes[3];
+        result.setResult(pass, pass ? "" : "Block values were overwritten by another thread.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+    
+    result = TestResult(name + " Cross Thread Deallocation");
+    try {
+        Manager manager(managerArgs...);
+        std::vector<int*> blocks;
+        for (int i = 0; i < 100; ++i) {
+            blocks.push_back(manager.allocateBlock());
+        }
+        std::thread freeingThread([&manager, &blocks]() {
+            for (auto i = blocks.begin(); i != blocks.end(); ++i) {
+                manager.freeBlock(*i);
+            }
+        });
+        freeingThread.join();
+        bool pass = performConcurrentWrites(manager, 7, 200);
+        result.setResult(pass, pass ? "" : "Block values were overwritten.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+}
+
+void testLockFreeManager() {
+    TestResult result("Lock-Free Page Growth Race");
+    try {
+        // with one block per page, the list runs empty all the time and threads race to grow the pool and to pop the
+        // same blocks
+        LockFreeMemoryPoolManager<int> manager(1);
+        std::vector<std::thread> threads;
+        bool passes[8] = {};
+        for (int t = 0; t < 8; ++t) {
+            threads.emplace_back([&manager, &passes, t]() {
+                bool pass = true;
+                for (int round = 0; round < 200; ++round) {
+                    pass = performConcurrentWrites(manager, t, 4) && pass;
+                }
+                passes[t] = pass;
+            });
+        }
+        for (auto i = threads.begin(); i != threads.end(); ++i) {
+            i->join();
+        }
+        
+        // every block came back, so draining the pool gets each block of every page exactly once without growing it
+        const size_t pages = manager.getNumberOfPages();
+        bool pass = std::all_of(std::begin(passes), std::end(passes), [](bool p) { return p; })
+            && manager.getAvailableBlocksRemaining() == pages;
+        std::set<int*> drained;
+        for (size_t i = 0; pass && i < pages; ++i) {
+            drained.insert(manager.allocateBlock());
+        }
+        pass = pass && drained.size() == pages && manager.getAvailableBlocksRemaining() == 0
+            && manager.getNumberOfPages() == pages;
+        result.setResult(pass, pass ? "" : "Blocks were handed out twice or lost while growing the pool.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+}
+
+void testThreadShardedStats() {
+    TestResult result("Thread Sharded Stats");
+    try {
+        MemoryPoolManager<int, MallocPageSource, DefaultValidationPolicy, MutexThreading, DetailedStats<1, true>>
+            manager(64);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([&manager]() {
+                int* blocks[8];
+                for (int round = 0; round < 1000; ++round) {
+                    for (int i = 0; i < 8; ++i) {
+                        blocks[i] = manager.allocateBlock();
+                    }
+                    for (int i = 0; i < 8; ++i) {
+                        manager.freeBlock(blocks[i]);
+                    }
+                }
+            });
+        }
+        for (auto i = threads.begin(); i != threads.end(); ++i) {
+            i->join();
+        }
+        PoolStatsSnapshot stats = manager.getStats().snapshot();
+        bool pass = stats.allocations == 32000 && stats.frees == 32000 && stats.liveBlocks == 0
+            && stats.peakLiveBlocks >= 8 && stats.peakLiveBlocks <= 32 && stats.getLatencySamples() == 32000;
+        result.setResult(pass, pass ? "" : "Shards did not add up to the calls made by every thread.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+}
+
+void testPerCpuManager() {
+    TestResult result("Per-CPU Invalid Batch Size");
+    try {
+        PerCpuMemoryPoolManager<int> manager(10, 0);
+        result.setResult(false, "Exception not thrown.");
+    }
+    catch (const MemoryPoolException& e) {
+        result.setResult(true, "");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+    
+    result = TestResult("Per-CPU Freed Blocks Reused");
+    try {
+        PerCpuMemoryPoolManager<int> manager(16, 8);
+        std::vector<int*> blocks;
+        for (int round = 0; round < 10; ++round) {
+            for (int i = 0; i < 100; ++i) {
+                blocks.push_back(manager.allocateBlock());
+            }
+            for (auto i = blocks.begin(); i != blocks.end(); ++i) {
+                manager.freeBlock(*i);
+            }
+            blocks.clear();
+        }
+        
+        // 100 live blocks, plus up to two batches cached by each shard and one more in the central pool's last page
+        const unsigned int bound = (100 + manager.getShardCount() * 16 + 8) / 16 + 1;
+        bool pass = manager.getNumberOfPages() <= bound;
+        result.setResult(pass, pass ? "" : "Freed blocks were not reused.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+    
+    result = TestResult("Per-CPU Memory Bounded By Shards");
+    try {
+        // far more threads than shards, which would each keep their own cache with per thread caches
+        PerCpuMemoryPoolManager<int> manager(16, 8, 2);
+        std::vector<std::thread> threads;
+        bool passes[64];
+        for (int t = 0; t < 64; ++t) {
+            threads.emplace_back([&manager, &passes, t]() {
+                bool pass = true;
+                for (int round = 0; round < 50; ++round) {
+                    pass = performConcurrentWrites(manager, t, 4) && pass;
+                }
+                passes[t] = pass;
+            });
+        }
+        for (auto i = threads.begin(); i != threads.end(); ++i) {
+            i->join();
+        }
+        
+        // every thread's live blocks, up to three batches per shard, and one more batch and page in the central pool
+        bool pass = std::all_of(std::begin(passes), std::end(passes), [](bool threadPass) { return threadPass; })
+            && manager.getNumberOfPages() <= (64 * 4 + 2 * 3 * 8 + 8) / 16 + 1;
+        result.setResult(pass, pass ? "" : "Block values were overwritten, or pages grew with the number of threads.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+}
+
+template <class Validation>
+void testOwnerThreading(const std::string& name) {
+    typedef MemoryPoolManager<int, MallocPageSource, Validation, OwnerThreading> Manager;
+    TestResult result(name + " Remote Frees Are Collected");
+    try {
+        Manager manager(10);
+        std::vector<int*> blocks;
+        for (int i = 0; i < 10; ++i) {
+            blocks.push_back(manager.allocateBlock());
+        }
+        std::thread freeingThread([&manager, &blocks]() {
+            for (auto i = blocks.begin(); i != blocks.end(); ++i) {
+                manager.freeBlock(*i);
+            }
+        });
+        freeingThread.join();
+        
+        // the freed blocks wait on the remote list until the owner runs out, and are then reused instead of a new page
+        bool pass = manager.getAvailableBlocksRemaining() == 0;
+        int* block = manager.allocateBlock();
+        pass = pass && manager.getNumberOfPages() == 1 && manager.getAvailableBlocksRemaining() == 9
+            && std::find(blocks.begin(), blocks.end(), block) != blocks.end();
+        result.setResult(pass, pass ? "" : "Blocks freed by another thread were not collected by the owner.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+    
+    result = TestResult(name + " Remote Batch Free");
+    try {
+        Manager manager(10);
+        int* blocks[11];
+        for (int i = 0; i < 10; ++i) {
+            blocks[i] = manager.allocateBlock();
+        }
+        blocks[10] = nullptr;
+        std::thread freeingThread([&manager, &blocks]() {
+            manager.freeBlocks(blocks, 11);
+        });
+        freeingThread.join();
+        bool pass = manager.getAvailableBlocksRemaining() == 0;
+        manager.allocateBlock();
+        manager.allocateBlock();
+        pass = pass && manager.getNumberOfPages() == 1 && manager.getAvailableBlocksRemaining() == 8;
+        result.setResult(pass, pass ? "" : "A batch freed by another thread was not collected by the owner.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+    
+    result = TestResult(name + " Trim Collects Remote Frees");
+    try {
+        Manager manager(10);
+        std::vector<int*> blocks;
+        for (int i = 0; i < 20; ++i) {
+            blocks.push_back(manager.allocateBlock());
+        }
+        std::thread freeingThread([&manager, &blocks]() {
+            for (auto i = blocks.begin(); i != blocks.end(); ++i) {
+                manager.freeBlock(*i);
+            }
+        });
+        freeingThread.join();
+        bool pass = manager.trim() == 2 && manager.getNumberOfPages() == 0;
+        result.setResult(pass, pass ? "" : "Trim did not release pages emptied by another thread.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+    
+    result = TestResult(name + " Producer Consumer");
+    try {
+        Manager manager(16);
+        std::mutex queueMutex;
+        std::vector<int*> queue;
+        bool done = false;
+        bool pass = true;
+        std::thread consumer([&]() {
+            std::vector<int*> taken;
+            for (;;) {
+                {
+                    std::lock_guard<std::mutex> guard(queueMutex);
+                    taken.swap(queue);
+                    if (taken.empty() && done) {
+                        return;
+                    }
+                }
+                for (auto i = taken.begin(); i != taken.end(); ++i) {
+                    pass = pass && **i == 42;
+                    **i = -1;
+                    manager.freeBlock(*i);
+                }
+                taken.clear();
+                std::this_thread::yield();
+            }
+        });
+        for (int i = 0; i < 10000; ++i) {
+            int* block = manager.allocateBlock();
+            *block = 42;
+            std::lock_guard<std::mutex> guard(queueMutex);
+            queue.push_back(block);
+        }
+        {
+            std::lock_guard<std::mutex> guard(queueMutex);
+            done = true;
+        }
+        consumer.join();
+        manager.trim();
+        pass = pass && manager.getNumberOfPages() == 0;
+        result.setResult(pass, pass ? "" : "Blocks were reused before they were freed, or were never collected.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+    
+    result = TestResult(name + " Claim Ownership");
+    try {
+        Manager manager(10);
+        bool pass = false;
+        std::thread owner([&manager, &pass]() {
+            manager.claimOwnership();
+            std::vector<int*> blocks;
+            for (int i = 0; i < 10; ++i) {
+                blocks.push_back(manager.allocateBlock());
+            }
+            manager.freeBlocks(blocks.data(), 10);
+            pass = manager.getAvailableBlocksRemaining() == 10;
+        });
+        owner.join();
+        result.setResult(pass, pass ? "" : "Frees from the new owner were not freed right away.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+}
+
+void testOwnerThreadingDuplicateFree() {
+    TestResult result("Owner Threading Remote Duplicate Free");
+    try {
+        MemoryPoolManager<int, MallocPageSource, FullValidation, OwnerThreading> manager(1);
+        int* block = manager.allocateBlock();
+        std::thread freeingThread([&manager, block]() {
+            manager.freeBlock(block);
+            manager.freeBlock(block);
+        });
+        freeingThread.join();
+        
+        // remote frees are only checked when the owner collects them
+        manager.allocateBlock();
+        result.setResult(false, "Exception not thrown.");
+    }
+    catch (const MemoryPoolException& e) {
+        result.setResult(true, "");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+    
+    result = TestResult("Owner Threading Remote Frees After A Failed One");
+    try {
+        MemoryPoolManager<int, MallocPageSource, FullValidation, OwnerThreading> manager(4);
+        int* blocks[3];
+        for (int i = 0; i < 3; ++i) {
+            blocks[i] = manager.allocateBlock();
+        }
+        
+        // the list is collected newest first, so the foreign block fails after the third block and before the others
+        alignas(std::max_align_t) char foreign[64] = {};
+        std::thread remoteThread([&manager, &blocks, &foreign]() {
+            manager.freeBlock(blocks[0]);
+            manager.freeBlock(blocks[1]);
+            manager.freeBlock(reinterpret_cast<int*>(foreign));
+            manager.freeBlock(blocks[2]);
+        });
+        remoteThread.join();
+        bool threw = false;
+        try {
+            manager.trim(1);
+        }
+        catch (const MemoryPoolException& e) {
+            threw = true;
+        }
+        
+        // the blocks after the failed free are collected by the next call
+        const size_t availableAfterThrow = manager.getAvailableBlocksRemaining();
+        manager.trim(1);
+        bool pass = threw && availableAfterThrow == 2 && manager.getAvailableBlocksRemaining() == 4;
+        result.setResult(pass, pass ? "" : "Blocks freed after the failed free were lost.");
+    }
+    catch (...) {
+        result.setResult(false, "Unexpected exception.");
+    }
+    outputTestResult(result);
+}
+
+unsigned int testMemoryManager() {
+    failedTestCount = 0;
+    std::cout << ">>> Int Memory Manager Tests <<<" << std::endl;
+    testConstruction<int>();
+    testAllocation<int>();
+    testDeallocation<int>();
+    testBatchAllocation<int>();
+    testLazyPageCarving<int>();
+    testTrim<int>("Trim Empty Pages");
+    testTrim<int, LazyPageCarving>("Trim Empty Lazily Carved Pages");
+    testAutoTrim<int>();
+    testReserveModes<int>();
+    testMaintain<int>();
+    testResetModes<int>();
+    testPreferFullestPage<int>();
+    testPageGrowth<int>();
+    testBlockAlignment<int>();
+    testPolicies<int>();
+    testForEachLive<int, OccupancyTracking>("Occupancy Tracking");
+    testForEachLive<int, FullValidation>("Full Validation");
+    testDetailedStats<int>();
+    testWritingIntToBlock();
+    testFreeBlockAddressLocation<int, FullValidation>();
+    testFreeBlockMemoryCorruption<int, FullValidation>();
+    testFreeBlockMemoryCorruption<int, HardenedValidation>();
+    testHardenedValidation<int>();
+    testFreeBlockDuplicateFree<int, FullValidation>();
+    testFreeBlockMemoryCorruption<int, DebugValidation>();
+    testFreeBlockDuplicateFree<int, DebugValidation>();
+    testDebugValidation<int>();
+    
+    std::cout << std::endl << ">>> Dummy Object Memory Manager Tests <<<" << std::endl;
+    testConstruction<DummyObject>();
+    testAllocation<DummyObject>();
+    testDeallocation<DummyObject>();
+    testBatchAllocation<DummyObject>();
+    testLazyPageCarving<DummyObject>();
+    testTrim<DummyObject>("Trim Empty Pages");
+    testTrim<DummyObject, LazyPageCarving>("Trim Empty Lazily Carved Pages");
+    testAutoTrim<DummyObject>();
+    testReserveModes<DummyObject>();
+    testMaintain<DummyObject>();
+    testResetModes<DummyObject>();
+    testPreferFullestPage<DummyObject>();
+    testPageGrowth<DummyObject>();
+    testBlockAlignment<DummyObject>();
+    testPolicies<DummyObject>();
+    testForEachLive<DummyObject, OccupancyTracking>("Occupancy Tracking");
+    testDetailedStats<DummyObject>();
+    testFreeBlockAddressLocation<DummyObject, FullValidation>();
+    testFreeBlockMemoryCorruption<DummyObject, FullValidation>();
+    testHardenedValidation<DummyObject>();
+    testFreeBlockDuplicateFree<DummyObject, FullValidation>();
+    testDebugValidation<DummyObject>();
+    
+    std::cout << std::endl << ">>> Aligned Object Memory Manager Tests <<<" << std::endl;
+    testAllocation<AlignedObject>();
+    testDeallocation<AlignedObject>();
+    testLazyPageCarving<AlignedObject>();
+    testPreferFullestPage<AlignedObject>();
+    testBlockAlignment<AlignedObject>();
+    testBlockAlignment<double>();
+    testPolicies<AlignedObject>();
+    testForEachLive<AlignedObject, OccupancyTracking>("Occupancy Tracking");
+    testFreeBlockAddressLocation<AlignedObject, FullValidation>();
+    testFreeBlockMemoryCorruption<AlignedObject, FullValidation>();
+    testFreeBlockMemoryCorruption<AlignedObject, HardenedValidation>();
+    testHardenedValidation<AlignedObject>();
+    testFreeBlockDuplicateFree<AlignedObject, FullValidation>();
+    testFreeBlockMemoryCorruption<AlignedObject, DebugValidation>();
+    testDebugValidation<AlignedObject>();
+    
+    std::cout << std::endl << ">>> Page Source Tests <<<" << std::endl;
+    testPageSource<DummyObject, MallocPageSource>("Malloc Page Source");
+#if defined(__unix__) || defined(__APPLE__)
+    testPageSource<DummyObject, MmapPageSource<>>("Mmap Page Source");
+    testPageSource<DummyObject, MmapPageSource<true>>("Prefaulted Mmap Page Source");
+    testPageSource<DummyObject, TransparentHugePageSource<>>("Transparent Huge Page Source");
+    testPageSource<DummyObject, HugeTlbPageSource<true>>("Huge TLB Page Source");
+    testPageSource<DummyObject, GuardedPageSource>("Guarded Page Source");
+    testReservedAddressSpace<DummyObject>();
+#endif
+    
+    std::cout << std::endl << ">>> Handle Memory Manager Tests <<<" << std::endl;
+    testHandles<int>();
+    testHandles<AlignedObject>();
+    
+    std::cout << std::endl << ">>> Compact Memory Manager Tests <<<" << std::endl;
+    testCompactPoolManager<uint8_t, uint16_t>("8-bit Blocks, 16-bit Indices");
+    testCompactPoolManager<uint16_t, uint16_t>("16-bit Blocks, 16-bit Indices");
+    testCompactPoolManager<uint32_t, uint32_t>("32-bit Blocks, 32-bit Indices");
+    testCompactPoolManager<DummyObject, uint8_t>("Dummy Object, 8-bit Indices");
+    
+    std::cout << std::endl << ">>> Pool Allocator Tests <<<" << std::endl;
+    testPoolAllocator();
+    
+    std::cout << std::endl << ">>> Size Class Memory Resource Tests <<<" << std::endl;
+    testSizeClassMemoryResource();
+    
+    std::cout << std::endl << ">>> Concurrent Memory Manager Tests <<<" << std::endl;
+    testThreadSafeManager<ConcurrentMemoryPoolManager<int>>("Concurrent", 100, 50u, 10u, 4u);
+    testThreadSafeManager<MemoryPoolManager<int, MallocPageSource, DefaultValidationPolicy, MutexThreading>>(
+        "Mutex", 25, 200u, 10u);
+    testThreadSafeManager<PerCpuMemoryPoolManager<int>>("Per-CPU", 25, 200u, 10u);
+    testPerCpuManager();
+    testThreadShardedStats();
+    
+    std::cout << std::endl << ">>> Owner Threading Tests <<<" << std::endl;
+    testOwnerThreading<NoValidation>("No Validation");
+    testOwnerThreading<FullValidation>("Full Validation");
+    testOwnerThreadingDuplicateFree();
+    
+    std::cout << std::endl << ">>> Lock-Free Memory Manager Tests <<<" << std::endl;
+    testThreadSafeManager<LockFreeMemoryPoolManager<int>>("Lock-Free", 25, 200u, 10u);
+    testLockFreeManager();
+    return failedTestCount;
 }
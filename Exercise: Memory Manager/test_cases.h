@@ -9,6 +9,7 @@
 #ifndef test_cases_h
 #define test_cases_h
 
-void testMemoryManager();
+/// Runs every test case and returns the number that failed.
+unsigned int testMemoryManager();
 
 #endif /* test_cases_h */